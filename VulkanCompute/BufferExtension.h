@@ -1,101 +1,416 @@
-#ifndef BUFFER_EXTENSION_H
-#define BUFFER_EXTENSION_H
-#include <vulkan/vulkan.hpp>
-
-namespace vkExt {
-	struct SharedMemory {
-		vk::DeviceMemory memory;
-		vk::DeviceSize size;
-		void* mapped;
-		bool isMapped = false;
-		bool isAlive = true;
-
-		vk::Result map(vk::Device device, vk::DeviceSize offset, vk::MemoryMapFlags flags) {
-			if (isMapped) return vk::Result::eSuccess;
-			auto res = device.mapMemory(memory, offset, size, flags, &mapped);
-			if (res == vk::Result::eSuccess) isMapped = true;
-			return res;
-		}
-		void unmap(vk::Device device) {
-			if (!isMapped) return;
-			device.unmapMemory(memory);
-			mapped = nullptr;
-			isMapped = false;
-		}
-		void free(vk::Device device) {
-			if (!isAlive) return;
-			isAlive = false;
-			device.freeMemory(memory);
-		}
-	};
-
-	struct Buffer {
-		vk::Device device;
-		vk::Buffer buffer;
-		vk::DescriptorBufferInfo descriptor;
-		uint32_t memoryOffset;
-		vkExt::SharedMemory* memory;
-		
-		void* mapped() {
-			if (!memory->isMapped) {
-				auto res = map();
-				if (res != vk::Result::eSuccess) return nullptr;
-			}
-			return (void*)((uint32_t *)(memory->mapped) + memoryOffset);
-		}
-
-		// Flags
-		vk::BufferUsageFlags usageFlags;
-
-		vk::Result map() {
-			return memory->map(device, descriptor.offset, vk::MemoryMapFlags());
-		}
-
-		void unmap() {
-			memory->unmap(device);
-		}
-
-		void bind(vk::DeviceSize offset = 0) {
-			device.bindBufferMemory(buffer, memory->memory, offset);
-		}
-
-		void setupDescriptor(vk::DeviceSize size = VK_WHOLE_SIZE, vk::DeviceSize offset = 0) {
-			descriptor.offset = offset;
-			descriptor.buffer = buffer;
-			descriptor.range = size;
-		}
-
-		void copyTo(void* data, vk::DeviceSize size) {
-			assert(memory->mapped);
-			memcpy(memory->mapped, data, (size_t)size);
-		}
-
-		vk::Result flush() {
-			vk::MappedMemoryRange mappedRange = vk::MappedMemoryRange()
-				.setMemory(memory->memory)
-				.setOffset(descriptor.offset)
-				.setSize(descriptor.range);
-			return device.flushMappedMemoryRanges(1, &mappedRange);
-		}
-
-		vk::Result invalidate() {
-			vk::MappedMemoryRange mappedRange = vk::MappedMemoryRange()
-				.setMemory(memory->memory)
-				.setOffset(descriptor.offset)
-				.setSize(descriptor.range);
-			return device.invalidateMappedMemoryRanges(1, &mappedRange);
-		}
-
-		void destroy(bool freeMem = false) {
-			unmap();
-			if (buffer) {
-				device.destroyBuffer(buffer);
-			}
-			if (freeMem) {
-				memory->free(device);
-			}
-		}
-	};
-}
-
+#ifndef BUFFER_EXTENSION_H
+#define BUFFER_EXTENSION_H
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace vkExt {
+	struct SharedMemory {
+		vk::DeviceMemory memory;
+		vk::DeviceSize size;
+		void* mapped = nullptr;
+		bool isMapped = false;
+		bool isAlive = true;
+		bool persistent = false; // shared by several buffers, stays mapped until it is freed
+
+		vk::Result map(vk::Device device, vk::DeviceSize offset, vk::MemoryMapFlags flags) {
+			if (isMapped) return vk::Result::eSuccess;
+			auto res = device.mapMemory(memory, offset, size, flags, &mapped);
+			if (res == vk::Result::eSuccess) isMapped = true;
+			return res;
+		}
+		void unmap(vk::Device device) {
+			if (!isMapped || persistent) return;
+			device.unmapMemory(memory);
+			mapped = nullptr;
+			isMapped = false;
+		}
+		void free(vk::Device device) {
+			if (!isAlive) return;
+			isAlive = false;
+			if (isMapped) device.unmapMemory(memory);
+			mapped = nullptr;
+			isMapped = false;
+			device.freeMemory(memory);
+		}
+	};
+
+	// a sub-range of a memory block handed out by MemoryAllocator
+	struct Allocation {
+		vkExt::SharedMemory* memory = nullptr;
+		vk::DeviceSize offset = 0;		// aligned offset of the allocation in the block
+		vk::DeviceSize size = 0;
+		vk::DeviceSize rangeOffset = 0;	// range taken from the free list, including alignment padding
+		vk::DeviceSize rangeSize = 0;
+		uint32_t memoryTypeIndex = 0;
+
+		explicit operator bool() const { return memory != nullptr; }
+	};
+
+	struct Buffer {
+		vk::Device device;
+		vk::Buffer buffer;
+		vk::DescriptorBufferInfo descriptor;
+		vk::DeviceSize memoryOffset = 0;		// byte offset of the buffer in memory
+		vk::DeviceSize memorySize = VK_WHOLE_SIZE;
+		vkExt::SharedMemory* memory = nullptr;
+		vkExt::Allocation allocation;		// set when the memory comes from a MemoryAllocator
+		
+		void* mapped() {
+			if (!memory->isMapped) {
+				auto res = map();
+				if (res != vk::Result::eSuccess) return nullptr;
+			}
+			return (void*)((uint8_t *)(memory->mapped) + memoryOffset);
+		}
+
+		// Flags
+		vk::BufferUsageFlags usageFlags;
+
+		vk::Result map() {
+			return memory->map(device, 0, vk::MemoryMapFlags());
+		}
+
+		void unmap() {
+			memory->unmap(device);
+		}
+
+		void bind(vk::DeviceSize offset = 0) {
+			device.bindBufferMemory(buffer, memory->memory, offset);
+		}
+
+		void setupDescriptor(vk::DeviceSize size = VK_WHOLE_SIZE, vk::DeviceSize offset = 0) {
+			descriptor.offset = offset;
+			descriptor.buffer = buffer;
+			descriptor.range = size;
+		}
+
+		void copyTo(void* data, vk::DeviceSize size) {
+			assert(memory->mapped);
+			memcpy(mapped(), data, (size_t)size);
+		}
+
+		// the allocator aligns memoryOffset and memorySize to nonCoherentAtomSize for non coherent memory
+		vk::Result flush() {
+			vk::MappedMemoryRange mappedRange = vk::MappedMemoryRange()
+				.setMemory(memory->memory)
+				.setOffset(memoryOffset)
+				.setSize(memorySize);
+			return device.flushMappedMemoryRanges(1, &mappedRange);
+		}
+
+		vk::Result invalidate() {
+			vk::MappedMemoryRange mappedRange = vk::MappedMemoryRange()
+				.setMemory(memory->memory)
+				.setOffset(memoryOffset)
+				.setSize(memorySize);
+			return device.invalidateMappedMemoryRanges(1, &mappedRange);
+		}
+
+		void destroy(bool freeMem = false) {
+			unmap();
+			if (buffer) {
+				device.destroyBuffer(buffer);
+			}
+			if (freeMem) {
+				memory->free(device);
+			}
+		}
+	};
+
+	// a Buffer holding count elements of T. the element type picks the kernel variant of typed ops
+	template<typename T>
+	struct TypedBuffer {
+		typedef T Element;
+
+		Buffer buffer;
+		size_t count = 0;
+
+		vk::DeviceSize bytes() const { return static_cast<vk::DeviceSize>(count) * sizeof(T); }
+		const vk::DescriptorBufferInfo& descriptor() const { return buffer.descriptor; }
+		// host visible buffers only
+		T* data() { return static_cast<T*>(buffer.mapped()); }
+		T& operator[](size_t i) { return data()[i]; }
+	};
+
+	struct MemoryStats {
+		uint32_t blockCount = 0;
+		uint32_t allocationCount = 0;
+		vk::DeviceSize reserved = 0;			// bytes allocated from the driver
+		vk::DeviceSize used = 0;				// bytes handed out, including alignment padding
+		vk::DeviceSize largestFreeRange = 0;
+
+		// 0 when all free memory is one contiguous range, approaching 1 when it is split into many small ones
+		float fragmentation() const {
+			vk::DeviceSize free = reserved - used;
+			return free ? 1.0f - (float)largestFreeRange / (float)free : 0.0f;
+		}
+
+		MemoryStats& operator+=(const MemoryStats &other) {
+			blockCount += other.blockCount;
+			allocationCount += other.allocationCount;
+			reserved += other.reserved;
+			used += other.used;
+			largestFreeRange = std::max(largestFreeRange, other.largestFreeRange);
+			return *this;
+		}
+	};
+
+	// One vk::DeviceMemory with a first-fit free list. Adjacent free ranges are merged on release.
+	struct MemoryBlock {
+		vkExt::SharedMemory memory;
+		std::map<vk::DeviceSize, vk::DeviceSize> freeRanges;	// offset -> size
+		uint32_t allocationCount = 0;
+		vk::DeviceSize used = 0;
+
+		bool allocate(vk::DeviceSize size, vk::DeviceSize alignment, Allocation &allocation) {
+			for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+				vk::DeviceSize aligned = (it->first + alignment - 1) / alignment * alignment;
+				if (aligned + size > it->first + it->second) continue;
+
+				allocation.memory = &memory;
+				allocation.offset = aligned;
+				allocation.size = size;
+				allocation.rangeOffset = it->first;
+				allocation.rangeSize = aligned + size - it->first;
+
+				vk::DeviceSize rest = it->second - allocation.rangeSize;
+				freeRanges.erase(it);
+				if (rest > 0) {
+					freeRanges[allocation.rangeOffset + allocation.rangeSize] = rest;
+				}
+				allocationCount++;
+				used += allocation.rangeSize;
+				return true;
+			}
+			return false;
+		}
+
+		void release(const Allocation &allocation) {
+			auto it = freeRanges.emplace(allocation.rangeOffset, allocation.rangeSize).first;
+			auto next = std::next(it);
+			if (next != freeRanges.end() && it->first + it->second == next->first) {
+				it->second += next->second;
+				freeRanges.erase(next);
+			}
+			if (it != freeRanges.begin()) {
+				auto prev = std::prev(it);
+				if (prev->first + prev->second == it->first) {
+					prev->second += it->second;
+					freeRanges.erase(it);
+				}
+			}
+			allocationCount--;
+			used -= allocation.rangeSize;
+		}
+
+		MemoryStats stats() const {
+			MemoryStats s;
+			s.blockCount = 1;
+			s.allocationCount = allocationCount;
+			s.reserved = memory.size;
+			s.used = used;
+			for (const auto &range : freeRanges) {
+				s.largestFreeRange = std::max(s.largestFreeRange, range.second);
+			}
+			return s;
+		}
+	};
+
+	// Sub-allocates buffers from large vk::DeviceMemory blocks, one pool of blocks per memory type.
+	// This keeps the number of vkAllocateMemory calls far below maxMemoryAllocationCount.
+	class MemoryAllocator {
+	public:
+		void init(vk::PhysicalDevice physicalDevice, vk::Device device, vk::DeviceSize blockSize = 64 * 1024 * 1024) {
+			m_device = device;
+			m_memoryProperties = physicalDevice.getMemoryProperties();
+			m_nonCoherentAtomSize = physicalDevice.getProperties().limits.nonCoherentAtomSize;
+			m_blockSize = blockSize;
+		}
+
+		// picks a memory type with all of the requested flags out of memoryTypeBits
+		vk::ResultValue<uint32_t> findMemoryType(uint32_t memoryTypeBits, vk::MemoryPropertyFlags flags) const {
+			uint32_t index = 0;
+			for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; i++) {
+				if ((memoryTypeBits & (1u << i)) && (m_memoryProperties.memoryTypes[i].propertyFlags & flags) == flags) {
+					index = i;
+					return vk::ResultValue<uint32_t>(vk::Result::eSuccess, index);
+				}
+			}
+			return vk::ResultValue<uint32_t>(vk::Result::eErrorFeatureNotPresent, index);
+		}
+
+		vk::Result allocate(const vk::MemoryRequirements &requirements, vk::MemoryPropertyFlags flags, Allocation &allocation) {
+			auto type = findMemoryType(requirements.memoryTypeBits, flags);
+			if (type.result != vk::Result::eSuccess) return type.result;
+			const uint32_t typeIndex = type.value;
+			const vk::MemoryPropertyFlags typeFlags = m_memoryProperties.memoryTypes[typeIndex].propertyFlags;
+
+			vk::DeviceSize alignment = std::max<vk::DeviceSize>(requirements.alignment, 1);
+			vk::DeviceSize size = requirements.size;
+			if ((typeFlags & vk::MemoryPropertyFlagBits::eHostVisible) && !(typeFlags & vk::MemoryPropertyFlagBits::eHostCoherent)) {
+				// flush / invalidate ranges have to be aligned to the atom size
+				alignment = std::max(alignment, m_nonCoherentAtomSize);
+				size = (size + m_nonCoherentAtomSize - 1) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+			}
+
+			auto &pool = m_pools[typeIndex];
+			for (auto &block : pool) {
+				if (block->allocate(size, alignment, allocation)) {
+					allocation.memoryTypeIndex = typeIndex;
+					return vk::Result::eSuccess;
+				}
+			}
+
+			// no room left, requests larger than the block size get a block of their own
+			const vk::MemoryHeap &heap = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[typeIndex].heapIndex];
+			vk::DeviceSize blockSize = std::max(std::min(m_blockSize, heap.size / 8), size);
+			std::unique_ptr<MemoryBlock> block(new MemoryBlock());
+			vk::MemoryAllocateInfo memAllocInfo = vk::MemoryAllocateInfo()
+				.setAllocationSize(blockSize)
+				.setMemoryTypeIndex(typeIndex);
+			vk::Result res = m_device.allocateMemory(&memAllocInfo, nullptr, &block->memory.memory);
+			if (res != vk::Result::eSuccess) return res;
+			block->memory.size = blockSize;
+			block->memory.persistent = true;
+			block->freeRanges[0] = blockSize;
+			if (typeFlags & vk::MemoryPropertyFlagBits::eHostVisible) {
+				// host visible blocks are mapped once, buffers only add their offset
+				res = block->memory.map(m_device, 0, vk::MemoryMapFlags());
+				if (res != vk::Result::eSuccess) {
+					block->memory.free(m_device);
+					return res;
+				}
+			}
+			block->allocate(size, alignment, allocation);
+			allocation.memoryTypeIndex = typeIndex;
+			pool.push_back(std::move(block));
+			return vk::Result::eSuccess;
+		}
+
+		void free(Allocation &allocation) {
+			if (!allocation) return;
+			auto &pool = m_pools[allocation.memoryTypeIndex];
+			for (size_t i = 0; i < pool.size(); i++) {
+				if (&pool[i]->memory != allocation.memory) continue;
+				pool[i]->release(allocation);
+				// keep one empty block around for reuse, give the others back to the driver
+				if (pool[i]->allocationCount == 0 && countEmptyBlocks(pool) > 1) {
+					pool[i]->memory.free(m_device);
+					pool.erase(pool.begin() + i);
+				}
+				break;
+			}
+			allocation = Allocation();
+		}
+
+		// creates the buffer, binds it to a sub-allocation and fills out the vkExt::Buffer.
+		// more than one queue family makes the buffer concurrently shared between them
+		vk::Result createBuffer(vkExt::Buffer &buffer, vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags flags, const std::vector<uint32_t> &queueFamilies) {
+			vk::BufferCreateInfo bufferCreateInfo = vk::BufferCreateInfo()
+				.setSize(size)
+				.setUsage(usage)
+				.setSharingMode(queueFamilies.size() > 1 ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive)
+				.setQueueFamilyIndexCount(static_cast<uint32_t>(queueFamilies.size()))
+				.setPQueueFamilyIndices(queueFamilies.data());
+			vk::Result res = m_device.createBuffer(&bufferCreateInfo, nullptr, &buffer.buffer);
+			if (res != vk::Result::eSuccess) return res;
+
+			vk::MemoryRequirements requirements = m_device.getBufferMemoryRequirements(buffer.buffer);
+			res = allocate(requirements, flags, buffer.allocation);
+			if (res != vk::Result::eSuccess) {
+				m_device.destroyBuffer(buffer.buffer);
+				buffer.buffer = nullptr;
+				return res;
+			}
+			m_device.bindBufferMemory(buffer.buffer, buffer.allocation.memory->memory, buffer.allocation.offset);
+
+			buffer.device = m_device;
+			buffer.memory = buffer.allocation.memory;
+			buffer.memoryOffset = buffer.allocation.offset;
+			buffer.memorySize = buffer.allocation.size;
+			buffer.usageFlags = usage;
+			buffer.setupDescriptor(size);
+			return vk::Result::eSuccess;
+		}
+
+		void destroyBuffer(vkExt::Buffer &buffer) {
+			if (buffer.buffer) {
+				m_device.destroyBuffer(buffer.buffer);
+				buffer.buffer = nullptr;
+			}
+			free(buffer.allocation);
+			buffer.memory = nullptr;
+		}
+
+		vk::MemoryPropertyFlags memoryTypeFlags(uint32_t memoryTypeIndex) const {
+			return m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+		}
+
+		MemoryStats stats(uint32_t memoryTypeIndex) const {
+			MemoryStats s;
+			for (const auto &block : m_pools[memoryTypeIndex]) {
+				s += block->stats();
+			}
+			return s;
+		}
+
+		MemoryStats stats() const {
+			MemoryStats s;
+			for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; i++) {
+				s += stats(i);
+			}
+			return s;
+		}
+
+		void destroy() {
+			for (auto &pool : m_pools) {
+				for (auto &block : pool) {
+					block->memory.free(m_device);
+				}
+				pool.clear();
+			}
+		}
+
+	private:
+		vk::Device m_device;
+		vk::PhysicalDeviceMemoryProperties m_memoryProperties;
+		vk::DeviceSize m_nonCoherentAtomSize = 1;
+		vk::DeviceSize m_blockSize = 0;
+		std::vector<std::unique_ptr<MemoryBlock>> m_pools[VK_MAX_MEMORY_TYPES];
+
+		static size_t countEmptyBlocks(const std::vector<std::unique_ptr<MemoryBlock>> &pool) {
+			size_t count = 0;
+			for (const auto &block : pool) {
+				if (block->allocationCount == 0) count++;
+			}
+			return count;
+		}
+	};
+
+	// Host visible upload region that hands out consecutive slices and wraps around at the end.
+	// The caller has to make sure the GPU is done with a slice before it is handed out again.
+	struct StagingRing {
+		vkExt::Buffer* buffer = nullptr;
+		vk::DeviceSize size = 0;
+		vk::DeviceSize head = 0;
+
+		vk::DeviceSize allocate(vk::DeviceSize bytes, vk::DeviceSize alignment = 16) {
+			assert(bytes <= size);
+			vk::DeviceSize offset = (head + alignment - 1) / alignment * alignment;
+			if (offset + bytes > size) offset = 0;
+			head = offset + bytes;
+			return offset;
+		}
+
+		void* at(vk::DeviceSize offset) {
+			uint8_t* base = (uint8_t*)buffer->mapped();
+			return base ? (void*)(base + offset) : nullptr;
+		}
+	};
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,274 @@
+#include "ComputeContext.h"
+
+namespace {
+	// descriptor sets per pool, pools are added when a layout runs out
+	const uint32_t SetsPerPool = 64;
+}
+
+#pragma region descriptorsetpool
+vk::ResultValue<vk::DescriptorSet> DescriptorSetPool::acquire(const ComputeKernel &kernel) {
+	vk::DescriptorSet set;
+	if (kernel.setLayouts().empty()) {
+		TRACE_FULL("kernel has no descriptor set");
+		return vk::ResultValue<vk::DescriptorSet>(vk::Result::eErrorInitializationFailed, set);
+	}
+	vk::DescriptorSetLayout layout = kernel.setLayout(0);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	LayoutSets &sets = m_layouts[static_cast<VkDescriptorSetLayout>(layout)];
+	if (!sets.free.empty()) {
+		set = sets.free.back();
+		sets.free.pop_back();
+		return vk::ResultValue<vk::DescriptorSet>(vk::Result::eSuccess, set);
+	}
+
+	if (sets.poolSizes.empty()) {
+		std::map<vk::DescriptorType, uint32_t> counts;
+		for (const auto &binding : kernel.reflection().bindings) {
+			if (binding.set == 0) counts[binding.type] += binding.count * SetsPerPool;
+		}
+		for (const auto &count : counts) {
+			sets.poolSizes.push_back(vk::DescriptorPoolSize(count.first, count.second));
+		}
+	}
+	vk::DescriptorSetAllocateInfo allocInfo = vk::DescriptorSetAllocateInfo()
+		.setDescriptorSetCount(1)
+		.setPSetLayouts(&layout);
+	vk::Result res = vk::Result::eErrorOutOfPoolMemory;
+	if (!sets.pools.empty()) {
+		allocInfo.setDescriptorPool(sets.pools.back());
+		res = m_device.allocateDescriptorSets(&allocInfo, &set);
+	}
+	if (res != vk::Result::eSuccess) {
+		// the last pool is exhausted, sets are never freed individually so older pools are as well
+		vk::DescriptorPoolCreateInfo poolCI = vk::DescriptorPoolCreateInfo()
+			.setMaxSets(SetsPerPool)
+			.setPoolSizeCount(static_cast<uint32_t>(sets.poolSizes.size()))
+			.setPPoolSizes(sets.poolSizes.data());
+		vk::DescriptorPool pool;
+		res = m_device.createDescriptorPool(&poolCI, nullptr, &pool);
+		if (res != vk::Result::eSuccess) {
+			TRACE_FULL("unable to create descriptor pool");
+			return vk::ResultValue<vk::DescriptorSet>(res, set);
+		}
+		sets.pools.push_back(pool);
+		allocInfo.setDescriptorPool(pool);
+		res = m_device.allocateDescriptorSets(&allocInfo, &set);
+		if (res != vk::Result::eSuccess) {
+			TRACE_FULL("unable to allocate descriptor set");
+		}
+	}
+	return vk::ResultValue<vk::DescriptorSet>(res, set);
+}
+
+void DescriptorSetPool::release(vk::DescriptorSetLayout layout, vk::DescriptorSet set) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_layouts[static_cast<VkDescriptorSetLayout>(layout)].free.push_back(set);
+}
+
+void DescriptorSetPool::destroy() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto &layout : m_layouts) {
+		for (auto pool : layout.second.pools) {
+			m_device.destroyDescriptorPool(pool);
+		}
+	}
+	m_layouts.clear();
+}
+
+size_t DescriptorSetPool::poolCount() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	size_t count = 0;
+	for (const auto &layout : m_layouts) {
+		count += layout.second.pools.size();
+	}
+	return count;
+}
+#pragma endregion descriptorsetpool
+
+#pragma region computecontext
+ComputeContext::~ComputeContext() {
+	// jobs still hold descriptor sets
+	m_app.scheduler().waitIdle();
+	m_descriptorSets.destroy();
+}
+
+vk::Result ComputeContext::init() {
+	vk::Result res = m_app.init();
+	if (res != vk::Result::eSuccess) return res;
+	m_descriptorSets.init(m_app.device());
+	m_limits = m_app.physicalDevice().getProperties().limits;
+	return vk::Result::eSuccess;
+}
+
+vk::ResultValue<ComputeKernel*> ComputeContext::loadKernel(const std::string &name, const std::string &spirvFile,
+	uint32_t workGroupSize, const KernelSpecialization &specialization) {
+	return m_app.kernels().load(name, spirvFile, workGroupSize, specialization);
+}
+
+vk::ResultValue<ComputeKernel*> ComputeContext::loadKernel(const std::string &name, const std::vector<uint32_t> &code,
+	uint32_t workGroupSize, const KernelSpecialization &specialization) {
+	return m_app.kernels().load(name, code, workGroupSize, specialization);
+}
+
+vk::Result ComputeContext::loadKernels(const std::vector<KernelSource> &kernels) {
+	return m_app.kernels().loadAll(kernels, m_app.hostPool());
+}
+
+ComputeKernel* ComputeContext::kernel(const std::string &name) {
+	return m_app.kernels().get(name);
+}
+
+vk::ResultValue<ComputeKernel*> ComputeContext::loadVariant(const std::string &name, const std::string &spirvBase,
+	const std::vector<KernelVariant> &variants, const KernelSpecialization &specialization) {
+	const DeviceFeatures &features = m_app.features();
+	for (const KernelVariant &variant : variants) {
+		if (!features.supports(variant.required)) continue;
+		const std::string variantName = name + variant.suffix;
+		{
+			std::lock_guard<std::mutex> lock(m_variantMutex);
+			if (m_unavailable.count(variantName)) continue;
+		}
+		// loaded variants come straight from the registry, which also checks the specialization
+		vk::ResultValue<ComputeKernel*> loaded = loadKernel(variantName, spirvBase + variant.suffix + ".spv", 0, specialization);
+		if (loaded.result != vk::Result::eSuccess) {
+			if (m_app.kernels().get(variantName)) {
+				// loaded with other constants, a mistake of this caller that must not disable the variant for others
+				return loaded;
+			}
+			TRACE_FULL("unable to load " + variantName);
+			std::lock_guard<std::mutex> lock(m_variantMutex);
+			m_unavailable.insert(variantName);
+			continue;
+		}
+		ComputeKernel* kernel = loaded.value;
+		// the workgroup size is only known once the module is loaded
+		if (variant.fullSubgroups && (features.subgroupSize == 0 || kernel->workGroupSize() % features.subgroupSize != 0)) continue;
+		return vk::ResultValue<ComputeKernel*>(vk::Result::eSuccess, kernel);
+	}
+	TRACE_FULL("no variant of " + name + " runs on this device");
+	return vk::ResultValue<ComputeKernel*>(vk::Result::eErrorFeatureNotPresent, nullptr);
+}
+
+vk::Result ComputeContext::createBuffer(vkExt::Buffer &buffer, vk::DeviceSize size, vk::MemoryPropertyFlags flags) {
+	return m_app.createBuffer(buffer, size, flags);
+}
+
+void ComputeContext::destroyBuffer(vkExt::Buffer &buffer) {
+	m_app.destroyBuffer(buffer);
+}
+
+std::future<vk::Result> ComputeContext::submit(const ComputeKernel &kernel, const JobBuffers &buffers, const void* pushConstants, uint32_t pushConstantSize,
+	uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+	KernelDispatch dispatch;
+	dispatch.kernel = &kernel;
+	dispatch.buffers = buffers;
+	const uint8_t* pushBytes = static_cast<const uint8_t*>(pushConstants);
+	dispatch.pushConstants.assign(pushBytes, pushBytes + (pushConstants ? pushConstantSize : 0));
+	dispatch.groupCountX = groupCountX;
+	dispatch.groupCountY = groupCountY;
+	dispatch.groupCountZ = groupCountZ;
+	return submit(std::vector<KernelDispatch>(1, dispatch));
+}
+
+std::future<vk::Result> ComputeContext::submit(const std::vector<KernelDispatch> &dispatches, const JobComplete &complete) {
+	struct Recorded {
+		const ComputeKernel* kernel;
+		vk::Pipeline pipeline;
+		vk::PipelineLayout pipelineLayout;
+		vk::DescriptorSetLayout setLayout;
+		vk::DescriptorSet set;		// not used with push descriptors
+		JobBuffers buffers;			// push descriptors only
+		std::vector<uint8_t> push;
+		uint32_t groupCount[3];
+	};
+	std::vector<Recorded> recorded;
+	auto releaseSets = [this](const std::vector<Recorded> &sets) {
+		for (const auto &r : sets) {
+			if (r.set) m_descriptorSets.release(r.setLayout, r.set);
+		}
+	};
+	auto fail = [&](vk::Result result) {
+		releaseSets(recorded);
+		if (complete) complete(result);
+		return readyFuture(result);
+	};
+
+	for (const auto &dispatch : dispatches) {
+		const ComputeKernel &kernel = *dispatch.kernel;
+		const KernelReflection &reflection = kernel.reflection();
+		if (reflection.setCount() > 1 || dispatch.pushConstants.size() > reflection.pushConstantSize) {
+			TRACE_FULL("kernel interface does not match the job");
+			return fail(vk::Result::eErrorInitializationFailed);
+		}
+		if (dispatch.buffers.size() < reflection.bindings.size()) {
+			TRACE_FULL("kernel expects more buffers");
+			return fail(vk::Result::eErrorInitializationFailed);
+		}
+		Recorded r;
+		r.kernel = &kernel;
+		r.pipeline = kernel.pipeline();
+		r.pipelineLayout = kernel.pipelineLayout();
+		if (kernel.setLayouts().empty()) {
+			// no bindings, nothing to acquire, write or bind
+		}
+		else if (kernel.usesPushDescriptors()) {
+			// recorded with the dispatch, no set to acquire or write
+			r.buffers = dispatch.buffers;
+		}
+		else {
+			r.setLayout = kernel.setLayout(0);
+			vk::ResultValue<vk::DescriptorSet> set = m_descriptorSets.acquire(kernel);
+			if (set.result != vk::Result::eSuccess) {
+				return fail(set.result);
+			}
+			std::vector<vk::WriteDescriptorSet> writes;
+			for (size_t i = 0; i < reflection.bindings.size(); i++) {
+				const KernelBinding &binding = reflection.bindings[i];
+				writes.push_back(vk::WriteDescriptorSet(set.value, binding.binding, 0, 1, binding.type, nullptr, &dispatch.buffers[i], nullptr));
+			}
+			// the set belongs to this job alone, no other thread touches it until it is released
+			m_app.device().updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+			r.set = set.value;
+		}
+		r.push = dispatch.pushConstants;
+		r.groupCount[0] = dispatch.groupCountX;
+		r.groupCount[1] = dispatch.groupCountY;
+		r.groupCount[2] = dispatch.groupCountZ;
+		recorded.push_back(r);
+	}
+
+	return m_app.scheduler().submit([recorded](vk::CommandBuffer commandBuffer) {
+		for (size_t i = 0; i < recorded.size(); i++) {
+			const Recorded &r = recorded[i];
+			if (i > 0) {
+				// the next dispatch reads what the previous ones wrote
+				vk::MemoryBarrier barrier = vk::MemoryBarrier()
+					.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+					.setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+				commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+					vk::DependencyFlags(), 1, &barrier, 0, nullptr, 0, nullptr);
+			}
+			commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, r.pipeline);
+			if (r.set) {
+				commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, r.pipelineLayout, 0, 1, &r.set, 0, nullptr);
+			}
+			else if (!r.buffers.empty()) {
+				r.kernel->pushDescriptors(commandBuffer, r.buffers.data());
+			}
+			if (!r.push.empty()) {
+				commandBuffer.pushConstants(r.pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, static_cast<uint32_t>(r.push.size()), r.push.data());
+			}
+			commandBuffer.dispatch(r.groupCount[0], r.groupCount[1], r.groupCount[2]);
+		}
+		vk::MemoryBarrier barrier = vk::MemoryBarrier()
+			.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eHostRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead);
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+			vk::PipelineStageFlagBits::eHost | vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
+			vk::DependencyFlags(), 1, &barrier, 0, nullptr, 0, nullptr);
+	}, [releaseSets, recorded, complete](vk::Result result) {
+		releaseSets(recorded);
+		if (complete) complete(result);
+	});
+}
+#pragma endregion computecontext
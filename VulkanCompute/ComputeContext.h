@@ -0,0 +1,128 @@
+#ifndef COMPUTE_CONTEXT_H
+#define COMPUTE_CONTEXT_H
+
+#include "VulkanCompute.h"
+
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
+
+// one buffer range per binding of set 0 of a kernel, in binding order
+typedef std::vector<vk::DescriptorBufferInfo> JobBuffers;
+
+// one dispatch of a job made of several dependent dispatches, see ComputeContext::submit()
+struct KernelDispatch {
+	const ComputeKernel* kernel = nullptr;
+	JobBuffers buffers;
+	std::vector<uint8_t> pushConstants;
+	uint32_t groupCountX = 1;
+	uint32_t groupCountY = 1;
+	uint32_t groupCountZ = 1;
+};
+
+// future that already holds result, for jobs that fail or finish before anything is submitted
+inline std::future<vk::Result> readyFuture(vk::Result result) {
+	std::promise<vk::Result> promise;
+	promise.set_value(result);
+	return promise.get_future();
+}
+
+// Descriptor sets per set layout that are handed back once the job using them finished.
+// New pools are only created when every set of a layout is in use.
+class DescriptorSetPool {
+public:
+	void init(vk::Device device) { m_device = device; }
+
+	vk::ResultValue<vk::DescriptorSet> acquire(const ComputeKernel &kernel);
+	void release(vk::DescriptorSetLayout layout, vk::DescriptorSet set);
+	// no set may be in use anymore
+	void destroy();
+
+	size_t poolCount() const;
+
+private:
+	struct LayoutSets {
+		std::vector<vk::DescriptorPoolSize> poolSizes;	// for SetsPerPool sets
+		std::vector<vk::DescriptorPool> pools;
+		std::vector<vk::DescriptorSet> free;
+	};
+
+	vk::Device m_device;
+	mutable std::mutex m_mutex;
+	std::map<VkDescriptorSetLayout, LayoutSets> m_layouts;
+};
+
+// Long lived device context that any number of host threads can submit kernels to at the same time.
+// Jobs run on the JobScheduler of the underlying application, so every submission thread records
+// into its own command pools. Kernel buffers are recorded as push descriptors where the device has
+// VK_KHR_push_descriptor, otherwise descriptor sets come from a DescriptorSetPool and are recycled.
+class ComputeContext {
+public:
+	ComputeContext(ComputeSettings settings = ComputeSettings()) : m_app(deviceSettings(settings)) {}
+	ComputeContext(const ComputeContext&) = delete;
+	ComputeContext& operator=(const ComputeContext&) = delete;
+	~ComputeContext();
+
+	vk::Result init();
+
+	// kernels are shared by all callers and stay valid until the context is destroyed
+	vk::ResultValue<ComputeKernel*> loadKernel(const std::string &name, const std::string &spirvFile,
+		uint32_t workGroupSize = 0, const KernelSpecialization &specialization = KernelSpecialization());
+	vk::ResultValue<ComputeKernel*> loadKernel(const std::string &name, const std::vector<uint32_t> &code,
+		uint32_t workGroupSize = 0, const KernelSpecialization &specialization = KernelSpecialization());
+	// creates the pipelines on the host threads of the application in parallel
+	vk::Result loadKernels(const std::vector<KernelSource> &kernels);
+	ComputeKernel* kernel(const std::string &name);
+	// the first of variants the device supports, loaded as name + suffix from spirvBase + suffix + ".spv".
+	// builds that fail to load are skipped and not tried again, eErrorFeatureNotPresent if none is left.
+	// a build already loaded with other constants fails the call, see KernelRegistry::load()
+	vk::ResultValue<ComputeKernel*> loadVariant(const std::string &name, const std::string &spirvBase,
+		const std::vector<KernelVariant> &variants, const KernelSpecialization &specialization = KernelSpecialization());
+
+	// host visible by default, so callers can fill and read buffers without staging
+	vk::Result createBuffer(vkExt::Buffer &buffer, vk::DeviceSize size,
+		vk::MemoryPropertyFlags flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+	void destroyBuffer(vkExt::Buffer &buffer);
+	template<typename T>
+	vk::Result createBuffer(vkExt::TypedBuffer<T> &buffer, size_t count,
+		vk::MemoryPropertyFlags flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent) {
+		buffer.count = count;
+		return createBuffer(buffer.buffer, buffer.bytes(), flags);
+	}
+	template<typename T>
+	void destroyBuffer(vkExt::TypedBuffer<T> &buffer) {
+		destroyBuffer(buffer.buffer);
+		buffer.count = 0;
+	}
+
+	// dispatches kernel over groupCount workgroups with buffers bound to set 0. pushConstants are copied.
+	// the future becomes ready once the results are visible to the host and to later jobs
+	std::future<vk::Result> submit(const ComputeKernel &kernel, const JobBuffers &buffers, const void* pushConstants, uint32_t pushConstantSize,
+		uint32_t groupCountX, uint32_t groupCountY = 1, uint32_t groupCountZ = 1);
+	// runs the dispatches in order as one job, each one sees the writes of the ones before it.
+	// complete runs on a scheduler thread once the job finished, before the future becomes ready
+	std::future<vk::Result> submit(const std::vector<KernelDispatch> &dispatches, const JobComplete &complete = JobComplete());
+	// blocks until every submitted job finished
+	void waitIdle() { m_app.scheduler().waitIdle(); }
+
+	VulkanComputeApplication& application() { return m_app; }
+	const vk::PhysicalDeviceLimits& limits() const { return m_limits; }
+	const DeviceFeatures& features() const { return m_app.features(); }
+	DescriptorSetPool& descriptorSets() { return m_descriptorSets; }
+
+private:
+	VulkanComputeApplication m_app;
+
+	// kernels always run on the device, the batches of the application are never used here
+	static ComputeSettings deviceSettings(ComputeSettings settings) {
+		settings.backend = ComputeBackend::eGpu;
+		return settings;
+	}
+	DescriptorSetPool m_descriptorSets;
+	vk::PhysicalDeviceLimits m_limits;
+	std::mutex m_variantMutex;
+	std::set<std::string> m_unavailable;	// variants that failed to load once
+};
+
+#endif
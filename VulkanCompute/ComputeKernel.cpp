@@ -0,0 +1,621 @@
+#include "ComputeKernel.h"
+#include "EmbeddedShaders.h"
+#include "VulkanCompute.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#pragma region spirvreflection
+namespace {
+	// the subset of the SPIR-V spec needed to reflect compute interfaces
+	const uint32_t SpvMagicNumber = 0x07230203;
+
+	enum SpvOp : uint32_t {
+		OpEntryPoint = 15,
+		OpExecutionMode = 16,
+		OpTypeBool = 20,
+		OpTypeInt = 21,
+		OpTypeFloat = 22,
+		OpTypeVector = 23,
+		OpTypeMatrix = 24,
+		OpTypeImage = 25,
+		OpTypeSampler = 26,
+		OpTypeSampledImage = 27,
+		OpTypeArray = 28,
+		OpTypeRuntimeArray = 29,
+		OpTypeStruct = 30,
+		OpTypePointer = 32,
+		OpConstant = 43,
+		OpSpecConstant = 50,
+		OpSpecConstantComposite = 51,
+		OpVariable = 59,
+		OpExecutionModeId = 331,
+		OpDecorate = 71,
+		OpMemberDecorate = 72
+	};
+
+	enum SpvDecoration : uint32_t {
+		DecorationSpecId = 1,
+		DecorationBlock = 2,
+		DecorationBufferBlock = 3,
+		DecorationArrayStride = 6,
+		DecorationMatrixStride = 7,
+		DecorationBuiltIn = 11,
+		DecorationBinding = 33,
+		DecorationDescriptorSet = 34,
+		DecorationOffset = 35
+	};
+
+	enum SpvStorageClass : uint32_t {
+		StorageClassUniformConstant = 0,
+		StorageClassUniform = 2,
+		StorageClassPushConstant = 9,
+		StorageClassStorageBuffer = 12
+	};
+
+	const uint32_t ExecutionModelGLCompute = 5;
+	const uint32_t ExecutionModeLocalSize = 17;
+	const uint32_t ExecutionModeLocalSizeId = 38;
+	const uint32_t BuiltInWorkgroupSize = 25;
+	const uint32_t DimBuffer = 5;
+
+	struct SpvInstruction {
+		uint32_t opcode;
+		std::vector<uint32_t> operands;
+	};
+
+	struct SpvModule {
+		std::map<uint32_t, SpvInstruction> types;		// types and constants by result id
+		std::map<uint32_t, std::map<uint32_t, uint32_t>> decorations;	// id -> decoration -> first literal
+		std::map<uint32_t, std::map<uint32_t, uint32_t>> memberOffsets;	// struct id -> member -> offset
+		std::vector<SpvInstruction> variables;
+
+		bool hasDecoration(uint32_t id, uint32_t decoration) const {
+			auto it = decorations.find(id);
+			return it != decorations.end() && it->second.count(decoration) > 0;
+		}
+
+		uint32_t decoration(uint32_t id, uint32_t decoration, uint32_t fallback = 0) const {
+			auto it = decorations.find(id);
+			if (it == decorations.end()) return fallback;
+			auto dec = it->second.find(decoration);
+			return dec == it->second.end() ? fallback : dec->second;
+		}
+
+		const SpvInstruction* type(uint32_t id) const {
+			auto it = types.find(id);
+			return it == types.end() ? nullptr : &it->second;
+		}
+
+		uint32_t constantValue(uint32_t id) const {
+			const SpvInstruction* constant = type(id);
+			return constant && constant->operands.size() > 2 ? constant->operands[2] : 0;
+		}
+
+		// byte size of a type in an explicitly laid out block (push constants)
+		uint32_t typeSize(uint32_t id) const {
+			const SpvInstruction* t = type(id);
+			if (!t) return 0;
+			switch (t->opcode) {
+			case OpTypeBool: return 4;
+			case OpTypeInt:
+			case OpTypeFloat: return t->operands[1] / 8;
+			case OpTypeVector: return typeSize(t->operands[1]) * t->operands[2];
+			case OpTypeMatrix: return decoration(id, DecorationMatrixStride, typeSize(t->operands[1])) * t->operands[2];
+			case OpTypeArray: {
+				uint32_t stride = decoration(id, DecorationArrayStride, typeSize(t->operands[1]));
+				return stride * constantValue(t->operands[2]);
+			}
+			case OpTypeStruct: {
+				uint32_t size = 0;
+				auto offsets = memberOffsets.find(id);
+				for (uint32_t m = 1; m < t->operands.size(); m++) {
+					uint32_t offset = 0;
+					if (offsets != memberOffsets.end() && offsets->second.count(m - 1)) offset = offsets->second.at(m - 1);
+					size = std::max(size, offset + typeSize(t->operands[m]));
+				}
+				return size;
+			}
+			default: return 0;
+			}
+		}
+	};
+
+	bool descriptorTypeOf(const SpvModule &module, uint32_t storageClass, uint32_t typeId, vk::DescriptorType &type, uint32_t &count) {
+		count = 1;
+		const SpvInstruction* t = module.type(typeId);
+		// arrays of descriptors
+		while (t && (t->opcode == OpTypeArray || t->opcode == OpTypeRuntimeArray)) {
+			if (t->opcode == OpTypeArray) count *= module.constantValue(t->operands[2]);
+			typeId = t->operands[1];
+			t = module.type(typeId);
+		}
+		if (!t) return false;
+
+		if (storageClass == StorageClassStorageBuffer) {
+			type = vk::DescriptorType::eStorageBuffer;
+			return true;
+		}
+		if (storageClass == StorageClassUniform) {
+			type = module.hasDecoration(typeId, DecorationBufferBlock) ? vk::DescriptorType::eStorageBuffer : vk::DescriptorType::eUniformBuffer;
+			return true;
+		}
+		if (storageClass != StorageClassUniformConstant) return false;
+
+		switch (t->opcode) {
+		case OpTypeSampler: type = vk::DescriptorType::eSampler; return true;
+		case OpTypeSampledImage: type = vk::DescriptorType::eCombinedImageSampler; return true;
+		case OpTypeImage: {
+			// operands: result, sampled type, dim, depth, arrayed, ms, sampled
+			const bool storage = t->operands[6] == 2;
+			if (t->operands[2] == DimBuffer) {
+				type = storage ? vk::DescriptorType::eStorageTexelBuffer : vk::DescriptorType::eUniformTexelBuffer;
+			}
+			else {
+				type = storage ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eSampledImage;
+			}
+			return true;
+		}
+		default: return false;
+		}
+	}
+}
+
+vk::Result reflectSpirv(const std::vector<uint32_t> &code, KernelReflection &reflection) {
+	if (code.size() < 5 || code[0] != SpvMagicNumber) {
+		return vk::Result::eErrorFormatNotSupported;
+	}
+
+	SpvModule module;
+	uint32_t entryPointId = 0;
+	uint32_t workgroupSizeId = 0;
+	std::vector<SpvInstruction> executionModes;
+
+	for (size_t pos = 5; pos < code.size();) {
+		const uint32_t wordCount = code[pos] >> 16;
+		const uint32_t opcode = code[pos] & 0xffff;
+		if (wordCount == 0 || pos + wordCount > code.size()) {
+			return vk::Result::eErrorFormatNotSupported;
+		}
+		SpvInstruction inst;
+		inst.opcode = opcode;
+		inst.operands.assign(code.begin() + pos + 1, code.begin() + pos + wordCount);
+		pos += wordCount;
+
+		switch (opcode) {
+		case OpEntryPoint:
+			if (inst.operands[0] == ExecutionModelGLCompute && entryPointId == 0) {
+				entryPointId = inst.operands[1];
+				reflection.entryPoint = std::string(reinterpret_cast<const char*>(&inst.operands[2]));
+			}
+			break;
+		case OpExecutionMode:
+		case OpExecutionModeId:
+			executionModes.push_back(inst);
+			break;
+		case OpDecorate:
+			if (inst.operands.size() >= 2) {
+				module.decorations[inst.operands[0]][inst.operands[1]] = inst.operands.size() > 2 ? inst.operands[2] : 0;
+				if (inst.operands[1] == DecorationBuiltIn && inst.operands.size() > 2 && inst.operands[2] == BuiltInWorkgroupSize) {
+					workgroupSizeId = inst.operands[0];
+				}
+			}
+			break;
+		case OpMemberDecorate:
+			if (inst.operands.size() >= 4 && inst.operands[2] == DecorationOffset) {
+				module.memberOffsets[inst.operands[0]][inst.operands[1]] = inst.operands[3];
+			}
+			break;
+		case OpTypeBool:
+		case OpTypeInt:
+		case OpTypeFloat:
+		case OpTypeVector:
+		case OpTypeMatrix:
+		case OpTypeImage:
+		case OpTypeSampler:
+		case OpTypeSampledImage:
+		case OpTypeArray:
+		case OpTypeRuntimeArray:
+		case OpTypeStruct:
+		case OpTypePointer:
+			module.types[inst.operands[0]] = inst;
+			break;
+		case OpConstant:
+		case OpSpecConstant:
+		case OpSpecConstantComposite:
+			module.types[inst.operands[1]] = inst;
+			break;
+		case OpVariable:
+			module.variables.push_back(inst);
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (entryPointId == 0) {
+		return vk::Result::eErrorFormatNotSupported;
+	}
+
+	for (const auto &mode : executionModes) {
+		if (mode.operands[0] != entryPointId || mode.operands.size() < 5) continue;
+		if (mode.operands[1] == ExecutionModeLocalSize) {
+			for (int i = 0; i < 3; i++) reflection.localSize[i] = mode.operands[2 + i];
+		}
+		else if (mode.operands[1] == ExecutionModeLocalSizeId) {
+			for (int i = 0; i < 3; i++) {
+				uint32_t id = mode.operands[2 + i];
+				reflection.localSize[i] = module.constantValue(id);
+				if (module.hasDecoration(id, DecorationSpecId)) {
+					reflection.localSizeSpecId[i] = static_cast<int32_t>(module.decoration(id, DecorationSpecId));
+				}
+			}
+		}
+	}
+	// local_size_x_id in GLSL shows up as a WorkgroupSize builtin built from spec constants
+	const SpvInstruction* workgroupSize = module.type(workgroupSizeId);
+	if (workgroupSize && workgroupSize->opcode == OpSpecConstantComposite && workgroupSize->operands.size() >= 5) {
+		for (int i = 0; i < 3; i++) {
+			uint32_t id = workgroupSize->operands[2 + i];
+			reflection.localSize[i] = module.constantValue(id);
+			if (module.hasDecoration(id, DecorationSpecId)) {
+				reflection.localSizeSpecId[i] = static_cast<int32_t>(module.decoration(id, DecorationSpecId));
+			}
+		}
+	}
+
+	for (const auto &variable : module.variables) {
+		const uint32_t id = variable.operands[1];
+		const uint32_t storageClass = variable.operands[2];
+		const SpvInstruction* pointer = module.type(variable.operands[0]);
+		if (!pointer || pointer->opcode != OpTypePointer) continue;
+		const uint32_t pointee = pointer->operands[2];
+
+		if (storageClass == StorageClassPushConstant) {
+			reflection.pushConstantSize = std::max(reflection.pushConstantSize, module.typeSize(pointee));
+			continue;
+		}
+		if (!module.hasDecoration(id, DecorationBinding)) continue;
+
+		KernelBinding binding;
+		if (!descriptorTypeOf(module, storageClass, pointee, binding.type, binding.count)) continue;
+		binding.set = module.decoration(id, DecorationDescriptorSet);
+		binding.binding = module.decoration(id, DecorationBinding);
+		reflection.bindings.push_back(binding);
+	}
+
+	std::sort(reflection.bindings.begin(), reflection.bindings.end(), [](const KernelBinding &a, const KernelBinding &b) {
+		return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+	});
+	// blocks aliasing one binding (e.g. float and vec4 views of a buffer) share its layout entry
+	auto last = std::unique(reflection.bindings.begin(), reflection.bindings.end(), [](const KernelBinding &a, const KernelBinding &b) {
+		return a.set == b.set && a.binding == b.binding;
+	});
+	reflection.bindings.erase(last, reflection.bindings.end());
+	return vk::Result::eSuccess;
+}
+#pragma endregion spirvreflection
+
+std::vector<uint32_t> readSpirvFile(const std::string &filename) {
+	std::vector<char> bytes = readFile(filename);
+	std::vector<uint32_t> code(bytes.size() / sizeof(uint32_t));
+	memcpy(code.data(), bytes.data(), code.size() * sizeof(uint32_t));
+	return code;
+}
+
+bool KernelLayoutCache::pushable(const std::vector<KernelBinding> &bindings) const {
+	if (!m_push.cmdPushDescriptorSet || bindings.size() > m_push.maxPushDescriptors || bindings.size() > MaxPushDescriptorBindings) return false;
+	for (const auto &b : bindings) {
+		// pushDescriptors() writes buffer infos only, one per binding. dynamic buffers, images, samplers
+		// and texel buffers keep pooled sets
+		if ((b.type != vk::DescriptorType::eStorageBuffer && b.type != vk::DescriptorType::eUniformBuffer) || b.count != 1) {
+			return false;
+		}
+	}
+	return true;
+}
+
+vk::ResultValue<vk::DescriptorSetLayout> KernelLayoutCache::getSetLayout(const std::vector<KernelBinding> &bindings, bool push) {
+	std::stringstream key;
+	if (push) key << "push;";
+	for (const auto &b : bindings) {
+		key << b.binding << ":" << static_cast<uint32_t>(b.type) << ":" << b.count << ";";
+	}
+	auto it = m_setLayouts.find(key.str());
+	if (it != m_setLayouts.end()) {
+		return vk::ResultValue<vk::DescriptorSetLayout>(vk::Result::eSuccess, it->second);
+	}
+
+	std::vector<vk::DescriptorSetLayoutBinding> layoutBindings;
+	for (const auto &b : bindings) {
+		layoutBindings.push_back(vk::DescriptorSetLayoutBinding(b.binding, b.type, b.count, vk::ShaderStageFlagBits::eCompute));
+	}
+	vk::DescriptorSetLayoutCreateInfo descLayoutCI = vk::DescriptorSetLayoutCreateInfo()
+		.setFlags(push ? vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR : vk::DescriptorSetLayoutCreateFlags())
+		.setBindingCount(static_cast<uint32_t>(layoutBindings.size()))
+		.setPBindings(layoutBindings.data());
+
+	vk::DescriptorSetLayout layout;
+	vk::Result res = m_device.createDescriptorSetLayout(&descLayoutCI, nullptr, &layout);
+	if (res == vk::Result::eSuccess) {
+		m_setLayouts[key.str()] = layout;
+	}
+	return vk::ResultValue<vk::DescriptorSetLayout>(res, layout);
+}
+
+vk::Result KernelLayoutCache::getLayouts(const KernelReflection &reflection, std::vector<vk::DescriptorSetLayout> &setLayouts, vk::PipelineLayout &pipelineLayout,
+	bool &pushDescriptors) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	setLayouts.clear();
+	pushDescriptors = false;
+	std::stringstream key;
+	for (uint32_t set = 0; set < reflection.setCount(); set++) {
+		std::vector<KernelBinding> bindings;
+		for (const auto &b : reflection.bindings) {
+			if (b.set == set) bindings.push_back(b);
+		}
+		// only one set of a pipeline layout may be pushed
+		const bool push = set == 0 && pushable(bindings);
+		if (push) {
+			pushDescriptors = true;
+			key << "push";
+		}
+		auto layout = getSetLayout(bindings, push);
+		if (layout.result != vk::Result::eSuccess) {
+			TRACE_FULL("unable to create compute descriptor set layout");
+			return layout.result;
+		}
+		setLayouts.push_back(layout.value);
+		key << set << "{";
+		for (const auto &b : bindings) {
+			key << b.binding << ":" << static_cast<uint32_t>(b.type) << ":" << b.count << ";";
+		}
+		key << "}";
+	}
+	key << "pc" << reflection.pushConstantSize;
+
+	auto it = m_pipelineLayouts.find(key.str());
+	if (it != m_pipelineLayouts.end()) {
+		pipelineLayout = it->second;
+		return vk::Result::eSuccess;
+	}
+
+	vk::PushConstantRange pushConstantRange = vk::PushConstantRange()
+		.setStageFlags(vk::ShaderStageFlagBits::eCompute)
+		.setSize(reflection.pushConstantSize)
+		.setOffset(0);
+
+	vk::PipelineLayoutCreateInfo pipeLayoutCI = vk::PipelineLayoutCreateInfo()
+		.setSetLayoutCount(static_cast<uint32_t>(setLayouts.size()))
+		.setPSetLayouts(setLayouts.data())
+		.setPushConstantRangeCount(reflection.pushConstantSize > 0 ? 1 : 0)
+		.setPPushConstantRanges(&pushConstantRange);
+
+	vk::Result res = m_device.createPipelineLayout(&pipeLayoutCI, nullptr, &pipelineLayout);
+	if (res != vk::Result::eSuccess) {
+		TRACE_FULL("unable to create compute pipeline layout");
+		return res;
+	}
+	m_pipelineLayouts[key.str()] = pipelineLayout;
+	return vk::Result::eSuccess;
+}
+
+void KernelLayoutCache::destroy() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto &layout : m_pipelineLayouts) {
+		m_device.destroyPipelineLayout(layout.second);
+	}
+	for (auto &layout : m_setLayouts) {
+		m_device.destroyDescriptorSetLayout(layout.second);
+	}
+	m_pipelineLayouts.clear();
+	m_setLayouts.clear();
+}
+
+vk::Result ComputeKernel::create(vk::Device device, KernelLayoutCache &layouts, vk::PipelineCache pipelineCache, const std::vector<uint32_t> &code,
+	uint32_t workGroupSize, const KernelSpecialization &specialization) {
+	m_device = device;
+	vk::Result res = reflectSpirv(code, m_reflection);
+	if (res != vk::Result::eSuccess) {
+		TRACE_FULL("unable to reflect kernel SPIR-V");
+		return res;
+	}
+	bool pushDescriptors = false;
+	res = layouts.getLayouts(m_reflection, m_setLayouts, m_pipelineLayout, pushDescriptors);
+	if (res != vk::Result::eSuccess) return res;
+	m_cmdPushDescriptorSet = pushDescriptors ? layouts.pushSupport().cmdPushDescriptorSet : nullptr;
+
+	// the local size only follows workGroupSize if the kernel exposes it as a specialization constant
+	KernelSpecialization constants = specialization;
+	m_workGroupSize = m_reflection.localSize[0];
+	if (m_reflection.localSizeSpecId[0] >= 0 && workGroupSize > 0) {
+		constants[static_cast<uint32_t>(m_reflection.localSizeSpecId[0])] = workGroupSize;
+		m_workGroupSize = workGroupSize;
+	}
+
+	std::vector<vk::SpecializationMapEntry> entries;
+	std::vector<uint32_t> data;
+	for (const auto &constant : constants) {
+		entries.push_back(vk::SpecializationMapEntry()
+			.setConstantID(constant.first)
+			.setOffset(static_cast<uint32_t>(data.size() * sizeof(uint32_t)))
+			.setSize(sizeof(uint32_t)));
+		data.push_back(constant.second);
+	}
+	vk::SpecializationInfo specializationInfo = vk::SpecializationInfo()
+		.setMapEntryCount(static_cast<uint32_t>(entries.size()))
+		.setPMapEntries(entries.data())
+		.setDataSize(data.size() * sizeof(uint32_t))
+		.setPData(data.data());
+
+	vk::ShaderModuleCreateInfo moduleCI = vk::ShaderModuleCreateInfo()
+		.setCodeSize(code.size() * sizeof(uint32_t))
+		.setPCode(code.data());
+	vk::ShaderModule shaderModule;
+	res = m_device.createShaderModule(&moduleCI, nullptr, &shaderModule);
+	if (res != vk::Result::eSuccess) {
+		TRACE_FULL("unable to create kernel shader module");
+		return res;
+	}
+
+	vk::ComputePipelineCreateInfo computePipeCI = vk::ComputePipelineCreateInfo()
+		.setStage(vk::PipelineShaderStageCreateInfo(
+			vk::PipelineShaderStageCreateFlags(),
+			vk::ShaderStageFlagBits::eCompute,
+			shaderModule,
+			m_reflection.entryPoint.c_str(),
+			entries.empty() ? nullptr : &specializationInfo
+		))
+		.setLayout(m_pipelineLayout);
+	res = m_device.createComputePipelines(pipelineCache, 1, &computePipeCI, nullptr, &m_pipeline);
+	m_device.destroyShaderModule(shaderModule);
+	if (res != vk::Result::eSuccess) {
+		TRACE_FULL("unable to create compute pipeline");
+	}
+	return res;
+}
+
+void ComputeKernel::pushDescriptors(vk::CommandBuffer commandBuffer, const vk::DescriptorBufferInfo* buffers) const {
+	VkWriteDescriptorSet writes[KernelLayoutCache::MaxPushDescriptorBindings];
+	uint32_t count = 0;
+	for (const auto &binding : m_reflection.bindings) {
+		if (binding.set != 0) break;
+		writes[count] = vk::WriteDescriptorSet(vk::DescriptorSet(), binding.binding, 0, 1, binding.type, nullptr, &buffers[count], nullptr);
+		count++;
+	}
+	m_cmdPushDescriptorSet(static_cast<VkCommandBuffer>(commandBuffer), VK_PIPELINE_BIND_POINT_COMPUTE,
+		static_cast<VkPipelineLayout>(m_pipelineLayout), 0, count, writes);
+}
+
+void ComputeKernel::pushDescriptors(vk::CommandBuffer commandBuffer, const std::vector<vk::WriteDescriptorSet> &writes) const {
+	m_cmdPushDescriptorSet(static_cast<VkCommandBuffer>(commandBuffer), VK_PIPELINE_BIND_POINT_COMPUTE,
+		static_cast<VkPipelineLayout>(m_pipelineLayout), 0, static_cast<uint32_t>(writes.size()),
+		reinterpret_cast<const VkWriteDescriptorSet*>(writes.data()));
+}
+
+void ComputeKernel::destroy() {
+	// layouts belong to the KernelLayoutCache
+	if (m_pipeline) {
+		m_device.destroyPipeline(m_pipeline);
+		m_pipeline = nullptr;
+	}
+}
+
+void KernelRegistry::init(vk::Device device, vk::PipelineCache pipelineCache, const vk::PhysicalDeviceLimits &limits,
+	const PushDescriptorSupport &push) {
+	m_device = device;
+	m_pipelineCache = pipelineCache;
+	m_limits = limits;
+	m_layouts.init(device, push);
+}
+
+vk::ResultValue<ComputeKernel*> KernelRegistry::load(const std::string &name, const std::string &spirvFile,
+	uint32_t workGroupSize, const KernelSpecialization &specialization) {
+	// loaded kernels skip reading the module again
+	ComputeKernel* kernel = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		vk::Result res = cached(name, chooseWorkGroupSize(m_limits, workGroupSize), specialization, kernel);
+		if (res != vk::Result::eSuccess || kernel) return vk::ResultValue<ComputeKernel*>(res, kernel);
+	}
+	std::vector<uint32_t> code;
+	// shaders compiled into the binary skip the file system
+	const EmbeddedShader* embedded = findEmbeddedShader(spirvFile);
+	try {
+		if (embedded) {
+			code.assign(embedded->code, embedded->code + embedded->words);
+		}
+		else {
+			code = readSpirvFile(spirvFile);
+		}
+	}
+	catch (const std::runtime_error& e) {
+		TRACE_FULL(e.what());
+		ComputeKernel* none = nullptr;
+		return vk::ResultValue<ComputeKernel*>(vk::Result::eIncomplete, none);
+	}
+	return load(name, code, workGroupSize, specialization);
+}
+
+vk::ResultValue<ComputeKernel*> KernelRegistry::load(const std::string &name, const std::vector<uint32_t> &code,
+	uint32_t workGroupSize, const KernelSpecialization &specialization) {
+	const uint32_t size = chooseWorkGroupSize(m_limits, workGroupSize);
+	ComputeKernel* kernel = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		vk::Result res = cached(name, size, specialization, kernel);
+		if (res != vk::Result::eSuccess || kernel) return vk::ResultValue<ComputeKernel*>(res, kernel);
+	}
+	// the pipeline is built without the lock, so other kernels can be created at the same time
+	std::unique_ptr<ComputeKernel> created(new ComputeKernel());
+	vk::Result res = created->create(m_device, m_layouts, m_pipelineCache, code, size, specialization);
+	if (res != vk::Result::eSuccess) {
+		created->destroy();
+		return vk::ResultValue<ComputeKernel*>(res, kernel);
+	}
+	std::lock_guard<std::mutex> lock(m_mutex);
+	res = cached(name, size, specialization, kernel);
+	if (res != vk::Result::eSuccess || kernel) {
+		// another thread loaded the same name first
+		created->destroy();
+		return vk::ResultValue<ComputeKernel*>(res, kernel);
+	}
+	Entry &entry = m_kernels[name];
+	entry.kernel = std::move(created);
+	entry.workGroupSize = size;
+	entry.specialization = specialization;
+	kernel = entry.kernel.get();
+	return vk::ResultValue<ComputeKernel*>(vk::Result::eSuccess, kernel);
+}
+
+vk::Result KernelRegistry::cached(const std::string &name, uint32_t workGroupSize, const KernelSpecialization &specialization,
+	ComputeKernel* &kernel) const {
+	auto it = m_kernels.find(name);
+	if (it == m_kernels.end()) {
+		kernel = nullptr;
+		return vk::Result::eSuccess;
+	}
+	if (it->second.workGroupSize != workGroupSize || it->second.specialization != specialization) {
+		// the name would silently stand for the pipeline of the first load
+		TRACE_FULL("kernel " + name + " is already loaded with other constants");
+		kernel = nullptr;
+		return vk::Result::eErrorInitializationFailed;
+	}
+	kernel = it->second.kernel.get();
+	return vk::Result::eSuccess;
+}
+
+vk::Result KernelRegistry::loadAll(const std::vector<KernelSource> &kernels, ThreadPool &pool) {
+	std::atomic<int> failure(static_cast<int>(vk::Result::eSuccess));
+	pool.parallelFor(kernels.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end && failure == static_cast<int>(vk::Result::eSuccess); i++) {
+			const KernelSource &source = kernels[i];
+			vk::Result res = source.code.empty()
+				? load(source.name, source.spirvFile, source.workGroupSize, source.specialization).result
+				: load(source.name, source.code, source.workGroupSize, source.specialization).result;
+			if (res != vk::Result::eSuccess) {
+				TRACE_FULL("unable to load kernel " + source.name);
+				failure = static_cast<int>(res);
+			}
+		}
+	});
+	return static_cast<vk::Result>(failure.load());
+}
+
+ComputeKernel* KernelRegistry::get(const std::string &name) const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_kernels.find(name);
+	return it == m_kernels.end() ? nullptr : it->second.kernel.get();
+}
+
+void KernelRegistry::destroy() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto &kernel : m_kernels) {
+		kernel.second.kernel->destroy();
+	}
+	m_kernels.clear();
+	m_layouts.destroy();
+}
\ No newline at end of file
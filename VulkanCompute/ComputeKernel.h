@@ -0,0 +1,166 @@
+#ifndef COMPUTE_KERNEL_H
+#define COMPUTE_KERNEL_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "HostPrep.h"
+
+struct KernelBinding {
+	uint32_t set = 0;
+	uint32_t binding = 0;
+	vk::DescriptorType type = vk::DescriptorType::eStorageBuffer;
+	uint32_t count = 1;
+};
+
+// interface of a compute entry point as read from its SPIR-V
+struct KernelReflection {
+	std::string entryPoint = "main";
+	std::vector<KernelBinding> bindings;	// sorted by set, then binding
+	uint32_t pushConstantSize = 0;
+	uint32_t localSize[3] = { 1, 1, 1 };
+	int32_t localSizeSpecId[3] = { -1, -1, -1 };	// specialization constant per dimension, -1 for a literal size
+
+	uint32_t setCount() const {
+		return bindings.empty() ? 0 : bindings.back().set + 1;
+	}
+};
+
+// specialization constant id -> value
+typedef std::map<uint32_t, uint32_t> KernelSpecialization;
+
+vk::Result reflectSpirv(const std::vector<uint32_t> &code, KernelReflection &reflection);
+std::vector<uint32_t> readSpirvFile(const std::string &filename);
+
+// VK_KHR_push_descriptor as enabled on the device, cmdPushDescriptorSet is nullptr without it
+struct PushDescriptorSupport {
+	PFN_vkCmdPushDescriptorSetKHR cmdPushDescriptorSet = nullptr;
+	uint32_t maxPushDescriptors = 0;
+};
+
+// Shares descriptor set layouts and pipeline layouts between kernels with identical interfaces.
+// With push descriptor support set 0 of every kernel that fits is a push descriptor set, its buffers
+// are recorded into the command buffer and no descriptor set is allocated or written for it.
+// getLayouts() may be called from several threads.
+class KernelLayoutCache {
+public:
+	// bindings of a push descriptor set, ComputeKernel::pushDescriptors() writes them from the stack
+	static const uint32_t MaxPushDescriptorBindings = 32;
+
+	void init(vk::Device device, const PushDescriptorSupport &push = PushDescriptorSupport()) {
+		m_device = device;
+		m_push = push;
+	}
+
+	// pushDescriptors receives whether set 0 is a push descriptor set
+	vk::Result getLayouts(const KernelReflection &reflection, std::vector<vk::DescriptorSetLayout> &setLayouts, vk::PipelineLayout &pipelineLayout,
+		bool &pushDescriptors);
+	const PushDescriptorSupport& pushSupport() const { return m_push; }
+
+	size_t setLayoutCount() const { return m_setLayouts.size(); }
+	size_t pipelineLayoutCount() const { return m_pipelineLayouts.size(); }
+
+	void destroy();
+
+private:
+	vk::Device m_device;
+	PushDescriptorSupport m_push;
+	std::mutex m_mutex;
+	std::map<std::string, vk::DescriptorSetLayout> m_setLayouts;
+	std::map<std::string, vk::PipelineLayout> m_pipelineLayouts;
+
+	// true if the bindings of set 0 can be pushed: single storage or uniform buffers, within the push limits
+	bool pushable(const std::vector<KernelBinding> &bindings) const;
+	vk::ResultValue<vk::DescriptorSetLayout> getSetLayout(const std::vector<KernelBinding> &bindings, bool push);
+};
+
+// A compute pipeline built from arbitrary SPIR-V. Descriptor set layouts, push constant range
+// and local size come from reflection, layouts are owned by the KernelLayoutCache.
+class ComputeKernel {
+public:
+	// workGroupSize is applied through the local_size_x specialization constant if the module declares one
+	vk::Result create(vk::Device device, KernelLayoutCache &layouts, vk::PipelineCache pipelineCache, const std::vector<uint32_t> &code,
+		uint32_t workGroupSize, const KernelSpecialization &specialization = KernelSpecialization());
+	void destroy();
+
+	const KernelReflection& reflection() const { return m_reflection; }
+	vk::Pipeline pipeline() const { return m_pipeline; }
+	vk::PipelineLayout pipelineLayout() const { return m_pipelineLayout; }
+	const std::vector<vk::DescriptorSetLayout>& setLayouts() const { return m_setLayouts; }
+	vk::DescriptorSetLayout setLayout(uint32_t set = 0) const { return m_setLayouts[set]; }
+	// effective local_size_x of the pipeline
+	uint32_t workGroupSize() const { return m_workGroupSize; }
+
+	// true if set 0 is a push descriptor set: its buffers are recorded with pushDescriptors() instead of
+	// binding a descriptor set, and setLayout(0) cannot be used to allocate sets
+	bool usesPushDescriptors() const { return m_cmdPushDescriptorSet != nullptr; }
+	// records buffers[i] for the i-th binding of set 0 (reflection order) into commandBuffer, after bindPipeline()
+	void pushDescriptors(vk::CommandBuffer commandBuffer, const vk::DescriptorBufferInfo* buffers) const;
+	// records writes of set 0 into commandBuffer, their dstSet is ignored
+	void pushDescriptors(vk::CommandBuffer commandBuffer, const std::vector<vk::WriteDescriptorSet> &writes) const;
+
+private:
+	vk::Device m_device;
+	PFN_vkCmdPushDescriptorSetKHR m_cmdPushDescriptorSet = nullptr;
+	KernelReflection m_reflection;
+	vk::Pipeline m_pipeline;
+	vk::PipelineLayout m_pipelineLayout;
+	std::vector<vk::DescriptorSetLayout> m_setLayouts;
+	uint32_t m_workGroupSize = 1;
+};
+
+// a kernel for KernelRegistry::loadAll(), code is used when it is not empty, spirvFile otherwise
+struct KernelSource {
+	std::string name;
+	std::string spirvFile;
+	std::vector<uint32_t> code;
+	uint32_t workGroupSize = 0;
+	KernelSpecialization specialization;
+};
+
+// Named kernels sharing one device, pipeline cache and layout cache. All functions but destroy()
+// may be called from several threads.
+class KernelRegistry {
+public:
+	void init(vk::Device device, vk::PipelineCache pipelineCache, const vk::PhysicalDeviceLimits &limits,
+		const PushDescriptorSupport &push = PushDescriptorSupport());
+
+	// workGroupSize 0 picks a size from the device limits. a name that is already loaded returns the same kernel,
+	// or eErrorInitializationFailed if it was built with another workgroup size or specialization
+	vk::ResultValue<ComputeKernel*> load(const std::string &name, const std::string &spirvFile,
+		uint32_t workGroupSize = 0, const KernelSpecialization &specialization = KernelSpecialization());
+	vk::ResultValue<ComputeKernel*> load(const std::string &name, const std::vector<uint32_t> &code,
+		uint32_t workGroupSize = 0, const KernelSpecialization &specialization = KernelSpecialization());
+
+	// creates the pipelines of all kernels in parallel on the pool, stops at the first failure
+	vk::Result loadAll(const std::vector<KernelSource> &kernels, ThreadPool &pool);
+
+	ComputeKernel* get(const std::string &name) const;
+	KernelLayoutCache& layouts() { return m_layouts; }
+
+	void destroy();
+
+private:
+	struct Entry {
+		std::unique_ptr<ComputeKernel> kernel;
+		uint32_t workGroupSize = 0;		// as passed to ComputeKernel::create()
+		KernelSpecialization specialization;
+	};
+
+	vk::Device m_device;
+	vk::PipelineCache m_pipelineCache;
+	vk::PhysicalDeviceLimits m_limits;
+	KernelLayoutCache m_layouts;
+	mutable std::mutex m_mutex;
+	std::map<std::string, Entry> m_kernels;
+
+	// sets kernel to the one loaded as name, nullptr if there is none. called with m_mutex held
+	vk::Result cached(const std::string &name, uint32_t workGroupSize, const KernelSpecialization &specialization, ComputeKernel* &kernel) const;
+};
+
+#endif
\ No newline at end of file
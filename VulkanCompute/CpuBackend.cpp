@@ -0,0 +1,406 @@
+#include "CpuBackend.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#if defined(__AVX512F__)
+#  include <immintrin.h>
+#  define CPU_SIMD_AVX512
+#elif defined(__AVX2__)
+#  include <immintrin.h>
+#  define CPU_SIMD_AVX2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#  include <arm_neon.h>
+#  define CPU_SIMD_NEON
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define CPU_SIMD_SSE2
+#endif
+
+namespace {
+	// elements per parallelFor chunk of the element-wise loops
+	const size_t ElementwiseChunk = 64 * 1024;
+	// elements per reduction partial. fixed, so the order partials are combined in never changes
+	const size_t ReduceChunk = 64 * 1024;
+
+	// integer arithmetic wraps around, signed overflow would be undefined in C++
+	inline int32_t wrapAdd(int32_t a, int32_t b) { return static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b)); }
+	inline int32_t wrapMul(int32_t a, int32_t b) { return static_cast<int32_t>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b)); }
+	inline float scalarAdd(float a, float b) { return a + b; }
+	inline int32_t scalarAdd(int32_t a, int32_t b) { return wrapAdd(a, b); }
+	inline float scalarMul(float a, float b) { return a * b; }
+	inline int32_t scalarMul(int32_t a, int32_t b) { return wrapMul(a, b); }
+	// single rounding like the fmadd of the vector loops, so a tail element matches its neighbours
+	inline float scalarFma(float a, float b, float c) { return std::fma(a, b, c); }
+	inline int32_t scalarFma(int32_t a, int32_t b, int32_t c) { return wrapAdd(wrapMul(a, b), c); }
+
+	// one element at a time, the tails of the vector loops and the types without a vector version
+	template<typename T>
+	struct Scalar {
+		typedef T V;
+		static const size_t Width = 1;
+		static V load(const T* p) { return *p; }
+		static void store(T* p, V v) { *p = v; }
+		static V set1(T x) { return x; }
+		static V add(V a, V b) { return scalarAdd(a, b); }
+		static V mul(V a, V b) { return scalarMul(a, b); }
+		static V min(V a, V b) { return std::min(a, b); }
+		static V max(V a, V b) { return std::max(a, b); }
+		static V fma(V a, V b, V c) { return scalarFma(a, b, c); }
+		static T sum(V v) { return v; }
+		static T hmin(V v) { return v; }
+		static T hmax(V v) { return v; }
+	};
+
+	template<typename T>
+	struct Simd : Scalar<T> {};
+
+#if defined(CPU_SIMD_AVX512)
+	template<>
+	struct Simd<float> {
+		typedef __m512 V;
+		static const size_t Width = 16;
+		static V load(const float* p) { return _mm512_loadu_ps(p); }
+		static void store(float* p, V v) { _mm512_storeu_ps(p, v); }
+		static V set1(float x) { return _mm512_set1_ps(x); }
+		static V add(V a, V b) { return _mm512_add_ps(a, b); }
+		static V mul(V a, V b) { return _mm512_mul_ps(a, b); }
+		static V min(V a, V b) { return _mm512_min_ps(a, b); }
+		static V max(V a, V b) { return _mm512_max_ps(a, b); }
+		static V fma(V a, V b, V c) { return _mm512_fmadd_ps(a, b, c); }
+		static float sum(V v) { return _mm512_reduce_add_ps(v); }
+		static float hmin(V v) { return _mm512_reduce_min_ps(v); }
+		static float hmax(V v) { return _mm512_reduce_max_ps(v); }
+	};
+
+	template<>
+	struct Simd<int32_t> {
+		typedef __m512i V;
+		static const size_t Width = 16;
+		static V load(const int32_t* p) { return _mm512_loadu_si512(p); }
+		static void store(int32_t* p, V v) { _mm512_storeu_si512(p, v); }
+		static V set1(int32_t x) { return _mm512_set1_epi32(x); }
+		static V add(V a, V b) { return _mm512_add_epi32(a, b); }
+		static V mul(V a, V b) { return _mm512_mullo_epi32(a, b); }
+		static V min(V a, V b) { return _mm512_min_epi32(a, b); }
+		static V max(V a, V b) { return _mm512_max_epi32(a, b); }
+		static V fma(V a, V b, V c) { return add(mul(a, b), c); }
+		static int32_t sum(V v) { return _mm512_reduce_add_epi32(v); }
+		static int32_t hmin(V v) { return _mm512_reduce_min_epi32(v); }
+		static int32_t hmax(V v) { return _mm512_reduce_max_epi32(v); }
+	};
+#elif defined(CPU_SIMD_AVX2)
+	template<>
+	struct Simd<float> {
+		typedef __m256 V;
+		static const size_t Width = 8;
+		static V load(const float* p) { return _mm256_loadu_ps(p); }
+		static void store(float* p, V v) { _mm256_storeu_ps(p, v); }
+		static V set1(float x) { return _mm256_set1_ps(x); }
+		static V add(V a, V b) { return _mm256_add_ps(a, b); }
+		static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+		static V min(V a, V b) { return _mm256_min_ps(a, b); }
+		static V max(V a, V b) { return _mm256_max_ps(a, b); }
+#if defined(__FMA__) || defined(_MSC_VER)
+		static V fma(V a, V b, V c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+		static V fma(V a, V b, V c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+		static float sum(V v) {
+			__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+			s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+			return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+		}
+		static float hmin(V v) {
+			__m128 m = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+			m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+			return _mm_cvtss_f32(_mm_min_ss(m, _mm_shuffle_ps(m, m, 1)));
+		}
+		static float hmax(V v) {
+			__m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+			m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+			return _mm_cvtss_f32(_mm_max_ss(m, _mm_shuffle_ps(m, m, 1)));
+		}
+	};
+
+	template<>
+	struct Simd<int32_t> {
+		typedef __m256i V;
+		static const size_t Width = 8;
+		static V load(const int32_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+		static void store(int32_t* p, V v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+		static V set1(int32_t x) { return _mm256_set1_epi32(x); }
+		static V add(V a, V b) { return _mm256_add_epi32(a, b); }
+		static V mul(V a, V b) { return _mm256_mullo_epi32(a, b); }
+		static V min(V a, V b) { return _mm256_min_epi32(a, b); }
+		static V max(V a, V b) { return _mm256_max_epi32(a, b); }
+		static V fma(V a, V b, V c) { return add(mul(a, b), c); }
+		static int32_t sum(V v) { return horizontal(v, wrapAdd); }
+		static int32_t hmin(V v) { return horizontal(v, [](int32_t a, int32_t b) { return std::min(a, b); }); }
+		static int32_t hmax(V v) { return horizontal(v, [](int32_t a, int32_t b) { return std::max(a, b); }); }
+
+		template<typename Fn>
+		static int32_t horizontal(V v, Fn fn) {
+			int32_t lanes[Width];
+			store(lanes, v);
+			int32_t acc = lanes[0];
+			for (size_t i = 1; i < Width; i++) acc = fn(acc, lanes[i]);
+			return acc;
+		}
+	};
+#elif defined(CPU_SIMD_NEON)
+	template<>
+	struct Simd<float> {
+		typedef float32x4_t V;
+		static const size_t Width = 4;
+		static V load(const float* p) { return vld1q_f32(p); }
+		static void store(float* p, V v) { vst1q_f32(p, v); }
+		static V set1(float x) { return vdupq_n_f32(x); }
+		static V add(V a, V b) { return vaddq_f32(a, b); }
+		static V mul(V a, V b) { return vmulq_f32(a, b); }
+		static V min(V a, V b) { return vminq_f32(a, b); }
+		static V max(V a, V b) { return vmaxq_f32(a, b); }
+		static V fma(V a, V b, V c) { return vfmaq_f32(c, a, b); }
+		static float sum(V v) { return vaddvq_f32(v); }
+		static float hmin(V v) { return vminvq_f32(v); }
+		static float hmax(V v) { return vmaxvq_f32(v); }
+	};
+
+	template<>
+	struct Simd<int32_t> {
+		typedef int32x4_t V;
+		static const size_t Width = 4;
+		static V load(const int32_t* p) { return vld1q_s32(p); }
+		static void store(int32_t* p, V v) { vst1q_s32(p, v); }
+		static V set1(int32_t x) { return vdupq_n_s32(x); }
+		static V add(V a, V b) { return vaddq_s32(a, b); }
+		static V mul(V a, V b) { return vmulq_s32(a, b); }
+		static V min(V a, V b) { return vminq_s32(a, b); }
+		static V max(V a, V b) { return vmaxq_s32(a, b); }
+		static V fma(V a, V b, V c) { return vmlaq_s32(c, a, b); }
+		static int32_t sum(V v) { return vaddvq_s32(v); }
+		static int32_t hmin(V v) { return vminvq_s32(v); }
+		static int32_t hmax(V v) { return vmaxvq_s32(v); }
+	};
+#elif defined(CPU_SIMD_SSE2)
+	// SSE2 has no 32 bit integer multiply, min or max, int32_t stays scalar
+	template<>
+	struct Simd<float> {
+		typedef __m128 V;
+		static const size_t Width = 4;
+		static V load(const float* p) { return _mm_loadu_ps(p); }
+		static void store(float* p, V v) { _mm_storeu_ps(p, v); }
+		static V set1(float x) { return _mm_set1_ps(x); }
+		static V add(V a, V b) { return _mm_add_ps(a, b); }
+		static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+		static V min(V a, V b) { return _mm_min_ps(a, b); }
+		static V max(V a, V b) { return _mm_max_ps(a, b); }
+		static V fma(V a, V b, V c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+		static float sum(V v) {
+			__m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+			return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+		}
+		static float hmin(V v) {
+			__m128 m = _mm_min_ps(v, _mm_movehl_ps(v, v));
+			return _mm_cvtss_f32(_mm_min_ss(m, _mm_shuffle_ps(m, m, 1)));
+		}
+		static float hmax(V v) {
+			__m128 m = _mm_max_ps(v, _mm_movehl_ps(v, v));
+			return _mm_cvtss_f32(_mm_max_ss(m, _mm_shuffle_ps(m, m, 1)));
+		}
+	};
+#endif
+
+	// the operations of ElementwiseOp, for vectors and single elements alike
+	struct AddOp { template<typename S> static typename S::V apply(typename S::V a, typename S::V b, typename S::V, typename S::V) { return S::add(a, b); } };
+	struct MulOp { template<typename S> static typename S::V apply(typename S::V a, typename S::V b, typename S::V, typename S::V) { return S::mul(a, b); } };
+	struct FmaOp { template<typename S> static typename S::V apply(typename S::V a, typename S::V b, typename S::V c, typename S::V) { return S::fma(a, b, c); } };
+	struct SaxpyOp { template<typename S> static typename S::V apply(typename S::V a, typename S::V b, typename S::V, typename S::V alpha) { return S::fma(alpha, a, b); } };
+	struct MinOp { template<typename S> static typename S::V apply(typename S::V a, typename S::V b, typename S::V, typename S::V) { return S::min(a, b); } };
+	struct MaxOp { template<typename S> static typename S::V apply(typename S::V a, typename S::V b, typename S::V, typename S::V) { return S::max(a, b); } };
+
+	// [i, end) in steps of S::Width, returns where the last full step ended
+	template<typename Op, typename S, typename T>
+	size_t applySteps(const T* a, const T* b, const T* c, T alpha, T* out, size_t i, size_t end) {
+		const typename S::V valpha = S::set1(alpha);
+		for (; i + S::Width <= end; i += S::Width) {
+			S::store(out + i, Op::template apply<S>(S::load(a + i), S::load(b + i), S::load(c + i), valpha));
+		}
+		return i;
+	}
+
+	template<typename Op, typename T>
+	void applyRange(const T* a, const T* b, const T* c, T alpha, T* out, size_t begin, size_t end) {
+		size_t i = applySteps<Op, Simd<T>>(a, b, c, alpha, out, begin, end);
+		applySteps<Op, Scalar<T>>(a, b, c, alpha, out, i, end);
+	}
+
+	// op over [begin, end), false for an unknown op
+	template<typename T>
+	bool applyOp(ElementwiseOp op, const T* a, const T* b, const T* c, T alpha, T* out, size_t begin, size_t end) {
+		switch (op) {
+		case ElementwiseOp::eAdd: applyRange<AddOp>(a, b, c, alpha, out, begin, end); return true;
+		case ElementwiseOp::eMul: applyRange<MulOp>(a, b, c, alpha, out, begin, end); return true;
+		case ElementwiseOp::eFma: applyRange<FmaOp>(a, b, c, alpha, out, begin, end); return true;
+		case ElementwiseOp::eSaxpy: applyRange<SaxpyOp>(a, b, c, alpha, out, begin, end); return true;
+		case ElementwiseOp::eMin: applyRange<MinOp>(a, b, c, alpha, out, begin, end); return true;
+		case ElementwiseOp::eMax: applyRange<MaxOp>(a, b, c, alpha, out, begin, end); return true;
+		default: return false;
+		}
+	}
+
+	template<typename T>
+	vk::Result elementwiseImpl(ElementwiseOp op, const T* a, const T* b, const T* c, T alpha, T* out, size_t count, ThreadPool &pool) {
+		if (op > ElementwiseOp::eMax) {
+			TRACE_FULL("unknown element-wise op");
+			return vk::Result::eErrorInitializationFailed;
+		}
+		pool.parallelFor(count, ElementwiseChunk, [&](size_t begin, size_t end) {
+			applyOp(op, a, b, c, alpha, out, begin, end);
+		});
+		return vk::Result::eSuccess;
+	}
+
+	// identities of shaders/reduce.comp
+	template<typename T>
+	T reduceIdentity(ReduceOp op) {
+		if (op == ReduceOp::eSum) return T(0);
+		if (std::numeric_limits<T>::has_infinity) {
+			return op == ReduceOp::eMin ? std::numeric_limits<T>::infinity() : -std::numeric_limits<T>::infinity();
+		}
+		return op == ReduceOp::eMin ? std::numeric_limits<T>::max() : std::numeric_limits<T>::lowest();
+	}
+
+	template<typename T>
+	T combine(ReduceOp op, T a, T b) {
+		switch (op) {
+		case ReduceOp::eSum: return scalarAdd(a, b);
+		case ReduceOp::eMin: return std::min(a, b);
+		default: return std::max(a, b);
+		}
+	}
+
+	// the value ops of ReduceOp, step combines lanes and finish the lanes of one vector
+	struct SumReduce {
+		template<typename S> static typename S::V step(typename S::V a, typename S::V b) { return S::add(a, b); }
+		template<typename S, typename T> static T finish(typename S::V v) { return S::sum(v); }
+	};
+	struct MinReduce {
+		template<typename S> static typename S::V step(typename S::V a, typename S::V b) { return S::min(a, b); }
+		template<typename S, typename T> static T finish(typename S::V v) { return S::hmin(v); }
+	};
+	struct MaxReduce {
+		template<typename S> static typename S::V step(typename S::V a, typename S::V b) { return S::max(a, b); }
+		template<typename S, typename T> static T finish(typename S::V v) { return S::hmax(v); }
+	};
+
+	// [i, end) in steps of S::Width, the identity for an empty range
+	template<typename Op, typename S, typename T>
+	T reduceSteps(ReduceOp op, const T* input, size_t &i, size_t end) {
+		typename S::V acc = S::set1(reduceIdentity<T>(op));
+		for (; i + S::Width <= end; i += S::Width) {
+			acc = Op::template step<S>(acc, S::load(input + i));
+		}
+		return Op::template finish<S, T>(acc);
+	}
+
+	template<typename Op, typename T>
+	T reduceRange(ReduceOp op, const T* input, size_t begin, size_t end) {
+		size_t i = begin;
+		T value = reduceSteps<Op, Simd<T>>(op, input, i, end);
+		return combine(op, value, reduceSteps<Op, Scalar<T>>(op, input, i, end));
+	}
+
+	// op is eSum, eMin or eMax
+	template<typename T>
+	T reduceChunk(ReduceOp op, const T* input, size_t begin, size_t end) {
+		switch (op) {
+		case ReduceOp::eSum: return reduceRange<SumReduce>(op, input, begin, end);
+		case ReduceOp::eMin: return reduceRange<MinReduce>(op, input, begin, end);
+		default: return reduceRange<MaxReduce>(op, input, begin, end);
+		}
+	}
+
+	template<typename T>
+	vk::Result reduceImpl(ReduceOp op, const T* input, size_t count, T &value, uint32_t &index, ThreadPool &pool) {
+		value = reduceIdentity<T>(op);
+		index = 0xffffffffu;
+		if (count > std::numeric_limits<uint32_t>::max()) {
+			TRACE_FULL("reductions are limited to 2^32 - 1 elements");
+			return vk::Result::eErrorInitializationFailed;
+		}
+		if (count == 0) return vk::Result::eSuccess;
+
+		// argmax finds the largest value first, then the first element holding it within its chunk
+		const ReduceOp valueOp = op == ReduceOp::eArgMax ? ReduceOp::eMax : op;
+		const size_t chunks = (count + ReduceChunk - 1) / ReduceChunk;
+		std::vector<T> values(chunks);
+		std::vector<uint32_t> indices(chunks, 0xffffffffu);
+		pool.parallelFor(chunks, 1, [&](size_t first, size_t last) {
+			for (size_t chunk = first; chunk < last; chunk++) {
+				const size_t begin = chunk * ReduceChunk;
+				const size_t end = std::min(count, begin + ReduceChunk);
+				values[chunk] = reduceChunk(valueOp, input, begin, end);
+				if (op == ReduceOp::eArgMax) {
+					const T* found = std::find(input + begin, input + end, values[chunk]);
+					if (found != input + end) indices[chunk] = static_cast<uint32_t>(found - input);
+				}
+			}
+		});
+
+		for (size_t chunk = 0; chunk < chunks; chunk++) {
+			if (op == ReduceOp::eArgMax) {
+				// the lowest index wins ties, chunks are visited in order
+				if (indices[chunk] != 0xffffffffu && (index == 0xffffffffu || values[chunk] > value)) {
+					value = values[chunk];
+					index = indices[chunk];
+				}
+			}
+			else {
+				value = combine(op, value, values[chunk]);
+			}
+		}
+		return vk::Result::eSuccess;
+	}
+}
+
+const char* cpuSimdName() {
+#if defined(CPU_SIMD_AVX512)
+	return "avx512";
+#elif defined(CPU_SIMD_AVX2)
+	return "avx2";
+#elif defined(CPU_SIMD_NEON)
+	return "neon";
+#elif defined(CPU_SIMD_SSE2)
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
+
+vk::Result CpuKernels::elementwise(ElementwiseOp op, const float* a, const float* b, const float* c, float alpha, float* out, size_t count) {
+	return elementwiseImpl(op, a, b, c, alpha, out, count, m_pool);
+}
+
+vk::Result CpuKernels::elementwise(ElementwiseOp op, const int32_t* a, const int32_t* b, const int32_t* c, int32_t alpha, int32_t* out, size_t count) {
+	return elementwiseImpl(op, a, b, c, alpha, out, count, m_pool);
+}
+
+void CpuKernels::apply(ElementwiseOp op, const float* a, const float* b, const float* c, float alpha, float* out, size_t count) {
+	applyOp(op, a, b, c, alpha, out, 0, count);
+}
+
+void CpuKernels::apply(ElementwiseOp op, const int32_t* a, const int32_t* b, const int32_t* c, int32_t alpha, int32_t* out, size_t count) {
+	applyOp(op, a, b, c, alpha, out, 0, count);
+}
+
+vk::Result CpuKernels::reduceRange(ReduceOp op, const float* input, size_t count, float &value, uint32_t &index) {
+	return reduceImpl(op, input, count, value, index, m_pool);
+}
+
+vk::Result CpuKernels::reduceRange(ReduceOp op, const int32_t* input, size_t count, int32_t &value, uint32_t &index) {
+	return reduceImpl(op, input, count, value, index, m_pool);
+}
@@ -0,0 +1,68 @@
+#ifndef CPU_BACKEND_H
+#define CPU_BACKEND_H
+
+#include "HostPrep.h"
+#include "ParallelPrimitives.h"
+
+#include <type_traits>
+
+// instruction set the host kernels were compiled for: "avx512", "avx2", "neon", "sse2" or "scalar"
+const char* cpuSimdName();
+
+// The element-wise operations of Elementwise and the reductions of ParallelPrimitives on host memory,
+// for hosts without a suitable device and for problems too small to pay for a submit.
+// Loops use the widest of AVX-512, AVX2, NEON and SSE2 the compiler targets and are split over the pool.
+// float and int32_t only, integer results wrap around like on the GPU. Reductions combine fixed size
+// chunks in order, so results do not depend on the thread count
+class CpuKernels {
+public:
+	explicit CpuKernels(ThreadPool &pool) : m_pool(pool) {}
+
+	template<typename T>
+	vk::Result add(const T* a, const T* b, T* out, size_t count) { return elementwise(ElementwiseOp::eAdd, a, b, a, T(), out, count); }
+	template<typename T>
+	vk::Result mul(const T* a, const T* b, T* out, size_t count) { return elementwise(ElementwiseOp::eMul, a, b, a, T(), out, count); }
+	template<typename T>
+	vk::Result min(const T* a, const T* b, T* out, size_t count) { return elementwise(ElementwiseOp::eMin, a, b, a, T(), out, count); }
+	template<typename T>
+	vk::Result max(const T* a, const T* b, T* out, size_t count) { return elementwise(ElementwiseOp::eMax, a, b, a, T(), out, count); }
+	// out = a * b + c
+	template<typename T>
+	vk::Result fma(const T* a, const T* b, const T* c, T* out, size_t count) { return elementwise(ElementwiseOp::eFma, a, b, c, T(), out, count); }
+	// out = alpha * x + y
+	template<typename T>
+	vk::Result saxpy(T alpha, const T* x, const T* y, T* out, size_t count) { return elementwise(ElementwiseOp::eSaxpy, x, y, x, alpha, out, count); }
+
+	// an empty input yields the identity of op and index 0xffffffff, as on the GPU
+	template<typename T>
+	ReduceResult<T> reduce(ReduceOp op, const T* input, size_t count) {
+		static_assert(std::is_same<T, float>::value || std::is_same<T, int32_t>::value, "reductions are built for float and int32_t");
+		ReduceResult<T> reduced;
+		reduced.result = reduceRange(op, input, count, reduced.value, reduced.index);
+		return reduced;
+	}
+	template<typename T>
+	ReduceResult<T> sum(const T* input, size_t count) { return reduce(ReduceOp::eSum, input, count); }
+	template<typename T>
+	ReduceResult<T> min(const T* input, size_t count) { return reduce(ReduceOp::eMin, input, count); }
+	template<typename T>
+	ReduceResult<T> max(const T* input, size_t count) { return reduce(ReduceOp::eMax, input, count); }
+	template<typename T>
+	ReduceResult<T> argmax(const T* input, size_t count) { return reduce(ReduceOp::eArgMax, input, count); }
+
+	ThreadPool& pool() { return m_pool; }
+
+	// op over [0, count) on the calling thread, for callers that split the work themselves (e.g. Validator)
+	static void apply(ElementwiseOp op, const float* a, const float* b, const float* c, float alpha, float* out, size_t count);
+	static void apply(ElementwiseOp op, const int32_t* a, const int32_t* b, const int32_t* c, int32_t alpha, int32_t* out, size_t count);
+
+private:
+	ThreadPool &m_pool;
+
+	vk::Result elementwise(ElementwiseOp op, const float* a, const float* b, const float* c, float alpha, float* out, size_t count);
+	vk::Result elementwise(ElementwiseOp op, const int32_t* a, const int32_t* b, const int32_t* c, int32_t alpha, int32_t* out, size_t count);
+	vk::Result reduceRange(ReduceOp op, const float* input, size_t count, float &value, uint32_t &index);
+	vk::Result reduceRange(ReduceOp op, const int32_t* input, size_t count, int32_t &value, uint32_t &index);
+};
+
+#endif
@@ -0,0 +1,161 @@
+#include "Elementwise.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace {
+	// elementCount() result for operands that do not fit together
+	const uint32_t InvalidCount = std::numeric_limits<uint32_t>::max();
+
+	const char* opName(ElementwiseOp op) {
+		switch (op) {
+		case ElementwiseOp::eAdd: return "add";
+		case ElementwiseOp::eMul: return "mul";
+		case ElementwiseOp::eFma: return "fma";
+		case ElementwiseOp::eSaxpy: return "saxpy";
+		case ElementwiseOp::eMin: return "min";
+		default: return "max";
+		}
+	}
+
+	// device features every build touching buffers of type needs, see Elementwise::supported()
+	KernelCapability storageCapability(const std::string &type) {
+		if (type == "f16") return KernelCapability::eStorage16;
+		if (type == "u8") return KernelCapability::eStorage8;
+		if (type == "f64") return KernelCapability::eFloat64;
+		return KernelCapability::eNone;
+	}
+
+	// the "_native" builds of shaders/elementwise.comp compute in float16_t / uint8_t instead of float / uint.
+	// u8 wraps around the same either way and single f16 operations round the same as in float,
+	// fma and saxpy in f16 would round twice, they keep the float build
+	std::vector<KernelVariant> elementwiseVariants(const std::string &type, ElementwiseOp op) {
+		const KernelCapability storage = storageCapability(type);
+		if (type == "f16" && op != ElementwiseOp::eFma && op != ElementwiseOp::eSaxpy) {
+			return { KernelVariant("_native", storage | KernelCapability::eFloat16), KernelVariant("", storage) };
+		}
+		if (type == "u8") {
+			return { KernelVariant("_native", storage | KernelCapability::eInt8), KernelVariant("", storage) };
+		}
+		return { KernelVariant("", storage) };
+	}
+
+	// push constants of shaders/elementwise.comp and shaders/convert.comp
+	struct ElementwiseParams {
+		uint32_t count;
+		uint32_t pad;
+		uint8_t alpha[8];	// ElementTraits<T>::Compute, 8 byte aligned for f64
+	};
+}
+
+#pragma region half
+uint16_t Half::floatToBits(float value) {
+	uint32_t x;
+	memcpy(&x, &value, sizeof(x));
+	const uint32_t sign = (x >> 16) & 0x8000;
+	const uint32_t absx = x & 0x7fffffff;
+	if (absx >= 0x7f800000) {
+		// infinity stays infinity, NaN stays quiet NaN
+		return static_cast<uint16_t>(sign | 0x7c00 | (absx > 0x7f800000 ? 0x200 : 0));
+	}
+	if (absx >= 0x477ff000) {
+		// 65520 and above round past the largest half
+		return static_cast<uint16_t>(sign | 0x7c00);
+	}
+	if (absx < 0x38800000) {
+		// below 2^-14 the result is subnormal, in units of 2^-24
+		if (absx <= 0x33000000) return static_cast<uint16_t>(sign);
+		const uint32_t exponent = absx >> 23;
+		const uint32_t mantissa = (absx & 0x7fffff) | 0x800000;
+		const uint32_t shift = 126 - exponent;
+		uint32_t h = mantissa >> shift;
+		const uint32_t rest = mantissa & ((1u << shift) - 1);
+		const uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (h & 1))) h++;
+		return static_cast<uint16_t>(sign | h);
+	}
+	// rebias the exponent from 127 to 15 and round the 13 dropped mantissa bits
+	uint32_t h = (absx - 0x38000000) >> 13;
+	const uint32_t rest = absx & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;
+	return static_cast<uint16_t>(sign | h);
+}
+
+float Half::bitsToFloat(uint16_t bits) {
+	const uint32_t sign = static_cast<uint32_t>(bits & 0x8000) << 16;
+	const uint32_t exponent = (bits >> 10) & 0x1f;
+	const uint32_t mantissa = bits & 0x3ff;
+	uint32_t x;
+	if (exponent == 0) {
+		float value = mantissa * (1.0f / 16777216.0f);
+		return sign ? -value : value;
+	}
+	if (exponent == 31) {
+		x = sign | 0x7f800000 | (mantissa << 13);
+	}
+	else {
+		x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+	float value;
+	memcpy(&value, &x, sizeof(value));
+	return value;
+}
+#pragma endregion half
+
+#pragma region elementwise
+bool Elementwise::supported(const std::string &type) const {
+	const DeviceFeatures &features = m_context.features();
+	if (type == "f16") return features.storage16;
+	if (type == "u8") return features.storage8;
+	if (type == "f64") return features.float64;
+	return type == "f32" || type == "i32";
+}
+
+uint32_t Elementwise::elementCount(size_t a, size_t b, size_t c, size_t out) {
+	if (a < out || b < out || c < out || out >= InvalidCount) {
+		TRACE_FULL("element-wise operands do not match");
+		return InvalidCount;
+	}
+	return static_cast<uint32_t>(out);
+}
+
+std::future<vk::Result> Elementwise::dispatch(const std::string &type, ElementwiseOp op, const JobBuffers &buffers, uint32_t count,
+	const void* alpha, uint32_t alphaSize) {
+	KernelSpecialization specialization;
+	specialization[1] = static_cast<uint32_t>(op);
+	return run("elementwise_" + type + "_" + opName(op), "shaders/elementwise_" + type, elementwiseVariants(type, op), specialization,
+		buffers, count, alpha, alphaSize);
+}
+
+std::future<vk::Result> Elementwise::dispatchConvert(const std::string &srcType, const std::string &dstType, const JobBuffers &buffers, uint32_t count) {
+	const std::string name = "convert_" + srcType + "_" + dstType;
+	// the shader declares the storage of both types
+	const KernelCapability required = storageCapability(srcType) | storageCapability(dstType);
+	return run(name, "shaders/" + name, { KernelVariant("", required) }, KernelSpecialization(), buffers, count, nullptr, 0);
+}
+
+std::future<vk::Result> Elementwise::run(const std::string &name, const std::string &spirvBase, const std::vector<KernelVariant> &variants,
+	const KernelSpecialization &specialization, const JobBuffers &buffers, uint32_t count, const void* alpha, uint32_t alphaSize) {
+	if (count == InvalidCount) {
+		return readyFuture(vk::Result::eErrorInitializationFailed);
+	}
+	if (count == 0) {
+		return readyFuture(vk::Result::eSuccess);
+	}
+	vk::ResultValue<ComputeKernel*> loaded = m_context.loadVariant(name, spirvBase, variants, specialization);
+	if (loaded.result != vk::Result::eSuccess) {
+		return readyFuture(loaded.result);
+	}
+	ComputeKernel* kernel = loaded.value;
+
+	ElementwiseParams params = {};
+	params.count = count;
+	if (alpha) memcpy(params.alpha, alpha, std::min<size_t>(alphaSize, sizeof(params.alpha)));
+	const uint32_t pushSize = alpha ? offsetof(ElementwiseParams, alpha) + alphaSize : sizeof(uint32_t);
+	return m_context.submit(*kernel, buffers, &params, pushSize,
+		computeGroupCount(m_context.limits(), count, kernel->workGroupSize()));
+}
+#pragma endregion elementwise
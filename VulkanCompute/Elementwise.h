@@ -0,0 +1,118 @@
+#ifndef ELEMENTWISE_H
+#define ELEMENTWISE_H
+
+#include "ComputeContext.h"
+
+#include <cstdint>
+#include <future>
+#include <string>
+
+// IEEE 754 binary16 as stored in f16 buffers. the host only converts, arithmetic runs on the GPU
+struct Half {
+	uint16_t bits = 0;
+
+	Half() {}
+	explicit Half(float value) : bits(floatToBits(value)) {}
+	explicit operator float() const { return bitsToFloat(bits); }
+
+	// round to nearest even, overflow becomes infinity
+	static uint16_t floatToBits(float value);
+	static float bitsToFloat(uint16_t bits);
+};
+
+// Element types the typed kernels are built for. Name is the shader variant suffix,
+// Compute the type arithmetic and push constants use on the GPU.
+// other types have no specialization and fail to compile
+template<typename T> struct ElementTraits;
+template<> struct ElementTraits<float> { typedef float Compute; static const char* name() { return "f32"; } };
+template<> struct ElementTraits<Half> { typedef float Compute; static const char* name() { return "f16"; } };
+template<> struct ElementTraits<int32_t> { typedef int32_t Compute; static const char* name() { return "i32"; } };
+template<> struct ElementTraits<uint8_t> { typedef uint32_t Compute; static const char* name() { return "u8"; } };
+template<> struct ElementTraits<double> { typedef double Compute; static const char* name() { return "f64"; } };
+
+// selects the operation of the elementwise shaders through specialization constant 1,
+// values match the OP_ constants in shaders/elementwise.comp
+enum class ElementwiseOp : uint32_t {
+	eAdd = 0,		// a + b
+	eMul = 1,		// a * b
+	eFma = 2,		// a * b + c
+	eSaxpy = 3,		// alpha * a + b
+	eMin = 4,
+	eMax = 5
+};
+
+// Element-wise kernels over TypedBuffers of one ComputeContext. Every function picks the shader variant from
+// the element type and the pipeline from the op, loads it on first use and submits one job through the context.
+// f16 and u8 compute in float16_t / uint8_t where the device has shaderFloat16 / shaderInt8, with the same results.
+// Integer results wrap around, u8 keeps the low 8 bits. Buffers have to stay alive until the future is ready.
+// f16 needs storageBuffer16BitAccess, u8 storageBuffer8BitAccess and f64 shaderFloat64, see supported()
+class Elementwise {
+public:
+	explicit Elementwise(ComputeContext &context) : m_context(context) {}
+
+	template<typename T>
+	bool supported() const { return supported(ElementTraits<T>::name()); }
+
+	template<typename T>
+	std::future<vk::Result> add(const vkExt::TypedBuffer<T> &a, const vkExt::TypedBuffer<T> &b, vkExt::TypedBuffer<T> &out) {
+		return binary(ElementwiseOp::eAdd, a, b, out);
+	}
+	template<typename T>
+	std::future<vk::Result> mul(const vkExt::TypedBuffer<T> &a, const vkExt::TypedBuffer<T> &b, vkExt::TypedBuffer<T> &out) {
+		return binary(ElementwiseOp::eMul, a, b, out);
+	}
+	template<typename T>
+	std::future<vk::Result> min(const vkExt::TypedBuffer<T> &a, const vkExt::TypedBuffer<T> &b, vkExt::TypedBuffer<T> &out) {
+		return binary(ElementwiseOp::eMin, a, b, out);
+	}
+	template<typename T>
+	std::future<vk::Result> max(const vkExt::TypedBuffer<T> &a, const vkExt::TypedBuffer<T> &b, vkExt::TypedBuffer<T> &out) {
+		return binary(ElementwiseOp::eMax, a, b, out);
+	}
+	// out = a * b + c, fused for floating point types
+	template<typename T>
+	std::future<vk::Result> fma(const vkExt::TypedBuffer<T> &a, const vkExt::TypedBuffer<T> &b, const vkExt::TypedBuffer<T> &c, vkExt::TypedBuffer<T> &out) {
+		typename ElementTraits<T>::Compute alpha = 0;
+		return dispatch(ElementTraits<T>::name(), ElementwiseOp::eFma, { a.descriptor(), b.descriptor(), c.descriptor(), out.descriptor() },
+			elementCount(a.count, b.count, c.count, out.count), &alpha, sizeof(alpha));
+	}
+	// out = alpha * x + y
+	template<typename T>
+	std::future<vk::Result> saxpy(typename ElementTraits<T>::Compute alpha, const vkExt::TypedBuffer<T> &x, const vkExt::TypedBuffer<T> &y,
+		vkExt::TypedBuffer<T> &out) {
+		return dispatch(ElementTraits<T>::name(), ElementwiseOp::eSaxpy, { x.descriptor(), y.descriptor(), x.descriptor(), out.descriptor() },
+			elementCount(x.count, y.count, x.count, out.count), &alpha, sizeof(alpha));
+	}
+	// dst = Dst(src), through the compute types of both. values outside the range of Dst are undefined
+	template<typename Src, typename Dst>
+	std::future<vk::Result> convert(const vkExt::TypedBuffer<Src> &src, vkExt::TypedBuffer<Dst> &dst) {
+		return dispatchConvert(ElementTraits<Src>::name(), ElementTraits<Dst>::name(), { src.descriptor(), dst.descriptor() },
+			elementCount(src.count, src.count, src.count, dst.count));
+	}
+
+	// true if the device enables the storage and arithmetic features the variant needs
+	bool supported(const std::string &type) const;
+
+private:
+	ComputeContext &m_context;
+
+	template<typename T>
+	std::future<vk::Result> binary(ElementwiseOp op, const vkExt::TypedBuffer<T> &a, const vkExt::TypedBuffer<T> &b, vkExt::TypedBuffer<T> &out) {
+		// binding 2 only feeds fma, a stands in for it
+		typename ElementTraits<T>::Compute alpha = 0;
+		return dispatch(ElementTraits<T>::name(), op, { a.descriptor(), b.descriptor(), a.descriptor(), out.descriptor() },
+			elementCount(a.count, b.count, a.count, out.count), &alpha, sizeof(alpha));
+	}
+
+	// out.count elements, InvalidCount if an input is shorter or the count does not fit the 32 bit push constant
+	static uint32_t elementCount(size_t a, size_t b, size_t c, size_t out);
+
+	std::future<vk::Result> dispatch(const std::string &type, ElementwiseOp op, const JobBuffers &buffers, uint32_t count,
+		const void* alpha, uint32_t alphaSize);
+	std::future<vk::Result> dispatchConvert(const std::string &srcType, const std::string &dstType, const JobBuffers &buffers, uint32_t count);
+	// loads the best of variants of name (see ComputeContext::loadVariant()) and dispatches it over count elements
+	std::future<vk::Result> run(const std::string &name, const std::string &spirvBase, const std::vector<KernelVariant> &variants,
+		const KernelSpecialization &specialization, const JobBuffers &buffers, uint32_t count, const void* alpha, uint32_t alphaSize);
+};
+
+#endif
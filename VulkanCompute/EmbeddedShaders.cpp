@@ -0,0 +1,18 @@
+#include "EmbeddedShaders.h"
+
+#ifdef VULKAN_COMPUTE_EMBED_SHADERS
+// generated into the build directory
+extern const EmbeddedShader g_embeddedShaders[];
+extern const size_t g_embeddedShaderCount;
+
+const EmbeddedShader* findEmbeddedShader(const std::string &path) {
+	for (size_t i = 0; i < g_embeddedShaderCount; i++) {
+		if (path == g_embeddedShaders[i].path) return &g_embeddedShaders[i];
+	}
+	return nullptr;
+}
+#else
+const EmbeddedShader* findEmbeddedShader(const std::string &/*path*/) {
+	return nullptr;
+}
+#endif
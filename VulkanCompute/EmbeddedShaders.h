@@ -0,0 +1,18 @@
+#ifndef EMBEDDED_SHADERS_H
+#define EMBEDDED_SHADERS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// SPIR-V compiled into the executable at build time (cmake/EmbedSpirv.cmake)
+struct EmbeddedShader {
+	const char* path;		// the path the shader would be loaded from, e.g. "shaders/glsl_shader.spv"
+	const uint32_t* code;
+	size_t words;
+};
+
+// nullptr if path was not embedded, or if the build does not embed shaders (VULKAN_COMPUTE_EMBED_SHADERS)
+const EmbeddedShader* findEmbeddedShader(const std::string &path);
+
+#endif
@@ -0,0 +1,259 @@
+#include "FusedExpression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+namespace {
+	// slot ranges, see Program
+	const uint32_t ConstantSlots = 8;
+	const uint32_t OpSlots = 16;
+	// specialization constant ids of shaders/fused.comp
+	const uint32_t SpecInputCount = 1;
+	const uint32_t SpecOpCount = 2;
+	const uint32_t SpecResult = 3;
+	const uint32_t SpecFirstOp = 4;
+	// unused inputs are bound to the first one, the output follows the inputs
+	const uint32_t OutputBinding = 8;
+
+	// push constants of shaders/fused.comp
+	struct FusedParams {
+		uint32_t count;
+		float constants[FusedKernels::MaxConstants];
+	};
+
+	uint32_t operandCount(FusedOp op) {
+		switch (op) {
+		case FusedOp::eFma: return 3;
+		case FusedOp::eNeg:
+		case FusedOp::eAbs:
+		case FusedOp::eSqrt:
+		case FusedOp::eExp:
+		case FusedOp::eLog: return 1;
+		default: return 2;
+		}
+	}
+
+	// FNV-1a over the words of the program
+	uint64_t hashWords(const std::vector<uint32_t> &words) {
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (uint32_t word : words) {
+			for (int i = 0; i < 4; i++) {
+				hash ^= (word >> (i * 8)) & 0xff;
+				hash *= 0x100000001b3ull;
+			}
+		}
+		return hash;
+	}
+}
+
+#pragma region expr
+Expr::Expr(const vkExt::TypedBuffer<float> &buffer) {
+	std::shared_ptr<ExprNode> node = std::make_shared<ExprNode>();
+	node->op = FusedOp::eInput;
+	node->buffer = buffer.descriptor();
+	node->count = buffer.count;
+	// host visible memory is mapped for good by the allocator, other buffers are never mapped here
+	const vkExt::SharedMemory* memory = buffer.buffer.memory;
+	if (memory && memory->isMapped) {
+		node->host = reinterpret_cast<const float*>(static_cast<const uint8_t*>(memory->mapped) + buffer.buffer.memoryOffset);
+	}
+	m_node = node;
+}
+
+Expr::Expr(float constant) {
+	std::shared_ptr<ExprNode> node = std::make_shared<ExprNode>();
+	node->op = FusedOp::eConstant;
+	node->constant = constant;
+	m_node = node;
+}
+
+Expr Expr::apply(FusedOp op, const Expr &a, const Expr &b, const Expr &c) {
+	std::shared_ptr<ExprNode> node = std::make_shared<ExprNode>();
+	node->op = op;
+	node->args[0] = a.m_node;
+	node->args[1] = b.m_node;
+	node->args[2] = c.m_node;
+	return Expr(node);
+}
+
+namespace {
+	bool hostVisible(const ExprNode &node) {
+		if (node.op == FusedOp::eInput) return node.host != nullptr;
+		if (node.op == FusedOp::eConstant) return true;
+		for (uint32_t i = 0; i < operandCount(node.op); i++) {
+			if (!hostVisible(*node.args[i])) return false;
+		}
+		return true;
+	}
+
+	// the operations of shaders/fused.comp
+	float evaluateNode(const ExprNode &node, size_t i) {
+		switch (node.op) {
+		case FusedOp::eInput: return node.host[i];
+		case FusedOp::eConstant: return node.constant;
+		default: break;
+		}
+		const float a = evaluateNode(*node.args[0], i);
+		const float b = operandCount(node.op) > 1 ? evaluateNode(*node.args[1], i) : 0.0f;
+		switch (node.op) {
+		case FusedOp::eAdd: return a + b;
+		case FusedOp::eSub: return a - b;
+		case FusedOp::eMul: return a * b;
+		case FusedOp::eDiv: return a / b;
+		case FusedOp::eMin: return std::min(a, b);
+		case FusedOp::eMax: return std::max(a, b);
+		case FusedOp::eFma: return std::fma(a, b, evaluateNode(*node.args[2], i));
+		case FusedOp::eNeg: return -a;
+		case FusedOp::eAbs: return std::fabs(a);
+		case FusedOp::eSqrt: return std::sqrt(a);
+		case FusedOp::eExp: return std::exp(a);
+		default: return std::log(a);
+		}
+	}
+}
+
+bool evaluateOnHost(const Expr &expression, size_t begin, size_t end, float* out) {
+	if (!hostVisible(expression.node())) {
+		TRACE_FULL("fused expression reads buffers that are not host visible");
+		return false;
+	}
+	for (size_t i = begin; i < end; i++) {
+		out[i - begin] = evaluateNode(expression.node(), i);
+	}
+	return true;
+}
+#pragma endregion expr
+
+#pragma region fusedkernels
+bool FusedKernels::compile(const ExprNode &node, Program &program, uint32_t &slot) const {
+	if (node.op == FusedOp::eInput) {
+		for (uint32_t i = 0; i < program.inputs.size(); i++) {
+			const vk::DescriptorBufferInfo &input = program.inputs[i];
+			if (input.buffer == node.buffer.buffer && input.offset == node.buffer.offset) {
+				slot = i;
+				return true;
+			}
+		}
+		if (program.inputs.size() == MaxInputs) {
+			TRACE_FULL("fused expression reads too many buffers");
+			return false;
+		}
+		slot = static_cast<uint32_t>(program.inputs.size());
+		program.inputs.push_back(node.buffer);
+		program.inputCounts.push_back(node.count);
+		return true;
+	}
+	if (node.op == FusedOp::eConstant) {
+		for (uint32_t i = 0; i < program.constants.size(); i++) {
+			if (memcmp(&program.constants[i], &node.constant, sizeof(float)) == 0) {
+				slot = ConstantSlots + i;
+				return true;
+			}
+		}
+		if (program.constants.size() == MaxConstants) {
+			TRACE_FULL("fused expression uses too many constants");
+			return false;
+		}
+		slot = ConstantSlots + static_cast<uint32_t>(program.constants.size());
+		program.constants.push_back(node.constant);
+		return true;
+	}
+
+	uint32_t operands[3] = { 0, 0, 0 };
+	for (uint32_t i = 0; i < operandCount(node.op); i++) {
+		if (!compile(*node.args[i], program, operands[i])) return false;
+	}
+	const uint32_t instruction = static_cast<uint32_t>(node.op) | operands[0] << 8 | operands[1] << 16 | operands[2] << 24;
+	// the same operation on the same slots is the same subexpression
+	auto existing = std::find(program.ops.begin(), program.ops.end(), instruction);
+	if (existing != program.ops.end()) {
+		slot = OpSlots + static_cast<uint32_t>(existing - program.ops.begin());
+		return true;
+	}
+	if (program.ops.size() == MaxOps) {
+		TRACE_FULL("fused expression has too many operations");
+		return false;
+	}
+	slot = OpSlots + static_cast<uint32_t>(program.ops.size());
+	program.ops.push_back(instruction);
+	return true;
+}
+
+ComputeKernel* FusedKernels::kernel(const Program &program) {
+	// the shape of the program, buffers and constant values are bound per dispatch
+	std::vector<uint32_t> key;
+	key.push_back(static_cast<uint32_t>(program.inputs.size()));
+	key.push_back(static_cast<uint32_t>(program.ops.size()));
+	key.push_back(program.result);
+	key.insert(key.end(), program.ops.begin(), program.ops.end());
+	uint32_t index;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_kernels.find(key);
+		if (it != m_kernels.end()) return it->second;
+		index = m_nextKernel++;
+	}
+
+	KernelSpecialization specialization;
+	specialization[SpecInputCount] = key[0];
+	specialization[SpecOpCount] = key[1];
+	specialization[SpecResult] = key[2];
+	for (uint32_t i = 0; i < program.ops.size(); i++) {
+		specialization[SpecFirstOp + i] = program.ops[i];
+	}
+	// the hash tells programs apart in traces, the index keeps the name unique
+	char name[48];
+	snprintf(name, sizeof(name), "fused_%016llx_%u", static_cast<unsigned long long>(hashWords(key)), index);
+	vk::ResultValue<ComputeKernel*> loaded = m_context.loadKernel(name, "shaders/fused.spv", 0, specialization);
+	if (loaded.result != vk::Result::eSuccess) {
+		TRACE_FULL("unable to create fused kernel");
+		return nullptr;
+	}
+	std::lock_guard<std::mutex> lock(m_mutex);
+	// another thread may have loaded the same program meanwhile, both kernels stay valid
+	return m_kernels.insert(std::make_pair(key, loaded.value)).first->second;
+}
+
+std::future<vk::Result> FusedKernels::evaluate(vkExt::TypedBuffer<float> &out, const Expr &expression) {
+	Program program;
+	if (!compile(expression.node(), program, program.result)) {
+		return readyFuture(vk::Result::eErrorInitializationFailed);
+	}
+	for (size_t count : program.inputCounts) {
+		if (count < out.count) {
+			TRACE_FULL("fused expression input is shorter than the output");
+			return readyFuture(vk::Result::eErrorInitializationFailed);
+		}
+	}
+	if (out.count > std::numeric_limits<uint32_t>::max()) {
+		TRACE_FULL("fused expressions are limited to 2^32 - 1 elements");
+		return readyFuture(vk::Result::eErrorInitializationFailed);
+	}
+	if (out.count == 0) {
+		return readyFuture(vk::Result::eSuccess);
+	}
+	ComputeKernel* fused = kernel(program);
+	if (!fused) {
+		return readyFuture(vk::Result::eErrorInitializationFailed);
+	}
+
+	// a constant expression has no inputs, the output stands in for them
+	JobBuffers buffers(OutputBinding + 1, program.inputs.empty() ? out.descriptor() : program.inputs[0]);
+	std::copy(program.inputs.begin(), program.inputs.end(), buffers.begin());
+	buffers[OutputBinding] = out.descriptor();
+
+	FusedParams params = {};
+	params.count = static_cast<uint32_t>(out.count);
+	std::copy(program.constants.begin(), program.constants.end(), params.constants);
+	return m_context.submit(*fused, buffers, &params, sizeof(params),
+		computeGroupCount(m_context.limits(), params.count, fused->workGroupSize()));
+}
+
+size_t FusedKernels::cachedKernels() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_kernels.size();
+}
+#pragma endregion fusedkernels
@@ -0,0 +1,113 @@
+#ifndef FUSED_EXPRESSION_H
+#define FUSED_EXPRESSION_H
+
+#include "ComputeContext.h"
+
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+
+// values match the OP_ constants in shaders/fused.comp
+enum class FusedOp : uint32_t {
+	eInput = 0,		// leaf, a buffer
+	eConstant = 1,	// leaf, a float
+	eAdd = 2,
+	eSub = 3,
+	eMul = 4,
+	eDiv = 5,
+	eMin = 6,
+	eMax = 7,
+	eFma = 8,		// a * b + c
+	eNeg = 9,
+	eAbs = 10,
+	eSqrt = 11,
+	eExp = 12,
+	eLog = 13
+};
+
+struct ExprNode {
+	FusedOp op = FusedOp::eConstant;
+	vk::DescriptorBufferInfo buffer;	// eInput
+	size_t count = 0;					// elements of buffer
+	const float* host = nullptr;		// mapped memory of buffer, nullptr if it is not host visible
+	float constant = 0.0f;				// eConstant
+	std::shared_ptr<const ExprNode> args[3];
+};
+
+// An element-wise float expression over TypedBuffers, e.g. (a + b) * c - d or fma(a, 2.0f, b).
+// Building it only records the tree, FusedKernels::evaluate() runs it as one kernel
+class Expr {
+public:
+	Expr(const vkExt::TypedBuffer<float> &buffer);
+	Expr(float constant);
+
+	const ExprNode& node() const { return *m_node; }
+
+	static Expr apply(FusedOp op, const Expr &a, const Expr &b = Expr(0.0f), const Expr &c = Expr(0.0f));
+
+private:
+	explicit Expr(std::shared_ptr<const ExprNode> node) : m_node(node) {}
+	std::shared_ptr<const ExprNode> m_node;
+};
+
+inline Expr operator+(const Expr &a, const Expr &b) { return Expr::apply(FusedOp::eAdd, a, b); }
+inline Expr operator-(const Expr &a, const Expr &b) { return Expr::apply(FusedOp::eSub, a, b); }
+inline Expr operator*(const Expr &a, const Expr &b) { return Expr::apply(FusedOp::eMul, a, b); }
+inline Expr operator/(const Expr &a, const Expr &b) { return Expr::apply(FusedOp::eDiv, a, b); }
+inline Expr operator-(const Expr &a) { return Expr::apply(FusedOp::eNeg, a); }
+inline Expr min(const Expr &a, const Expr &b) { return Expr::apply(FusedOp::eMin, a, b); }
+inline Expr max(const Expr &a, const Expr &b) { return Expr::apply(FusedOp::eMax, a, b); }
+inline Expr fma(const Expr &a, const Expr &b, const Expr &c) { return Expr::apply(FusedOp::eFma, a, b, c); }
+inline Expr abs(const Expr &a) { return Expr::apply(FusedOp::eAbs, a); }
+inline Expr sqrt(const Expr &a) { return Expr::apply(FusedOp::eSqrt, a); }
+inline Expr exp(const Expr &a) { return Expr::apply(FusedOp::eExp, a); }
+inline Expr log(const Expr &a) { return Expr::apply(FusedOp::eLog, a); }
+
+// out[0, end - begin) = expression for elements [begin, end), computed on the host in float.
+// the reference for validating FusedKernels::evaluate(), false if an input is not host visible
+bool evaluateOnHost(const Expr &expression, size_t begin, size_t end, float* out);
+
+// Runs expressions as a single dispatch that loads every distinct buffer once per element and writes
+// the output once. An expression is flattened into a program of at most MaxOps operations over
+// MaxInputs buffers and MaxConstants constants, with common subexpressions merged. The program is
+// baked into shaders/fused.comp through specialization constants, so the driver compiles straight
+// line code for it. Pipelines are cached by a hash of the program: expressions of the same shape share
+// one no matter which buffers or constant values they use, and the pipeline cache keeps them across runs.
+class FusedKernels {
+public:
+	static const uint32_t MaxInputs = 8;
+	static const uint32_t MaxConstants = 8;
+	static const uint32_t MaxOps = 16;
+
+	explicit FusedKernels(ComputeContext &context) : m_context(context) {}
+
+	// out = expression for out.count elements, every input has to hold at least as many.
+	// buffers have to stay alive until the future is ready
+	std::future<vk::Result> evaluate(vkExt::TypedBuffer<float> &out, const Expr &expression);
+
+	// distinct programs built so far
+	size_t cachedKernels() const;
+
+private:
+	// expression flattened into slots: 0..7 inputs, 8..15 constants, 16.. results of the operations
+	struct Program {
+		std::vector<vk::DescriptorBufferInfo> inputs;
+		std::vector<size_t> inputCounts;
+		std::vector<float> constants;
+		std::vector<uint32_t> ops;		// op | a << 8 | b << 16 | c << 24
+		uint32_t result = 0;			// slot written to the output
+	};
+
+	ComputeContext &m_context;
+	mutable std::mutex m_mutex;
+	// keyed by the whole program shape, a hash could collide and run another program
+	std::map<std::vector<uint32_t>, ComputeKernel*> m_kernels;
+	uint32_t m_nextKernel = 0;		// keeps registry names unique when hashes collide
+
+	// returns the slot of node, false if the program exceeds one of the limits
+	bool compile(const ExprNode &node, Program &program, uint32_t &slot) const;
+	ComputeKernel* kernel(const Program &program);
+};
+
+#endif
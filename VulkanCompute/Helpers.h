@@ -9,6 +9,9 @@
 #	else
 #		define C_STR(x) x.c_str()
 #	endif
+#    ifndef NOMINMAX
+#      define NOMINMAX
+#    endif
 #    include <windows.h>
 #    define TRACE(x) OutputDebugString(C_STR(x));
 #    define TRACE_FULL(x)                           \
@@ -0,0 +1,236 @@
+#include "HostPrep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define HOST_PREP_SSE2
+#endif
+
+namespace {
+	// below this non-temporal stores lose against the cache
+	const size_t StreamingThreshold = 256 * 1024;
+	// parallel copies split on cache lines, at least this many bytes per chunk
+	const size_t CopyChunk = 1024 * 1024;
+	const size_t FillChunk = 64 * 1024;
+
+#ifdef HOST_PREP_SSE2
+	bool isAligned16(const void* p) {
+		return (reinterpret_cast<uintptr_t>(p) & 15) == 0;
+	}
+#endif
+
+	inline uint32_t mulhilo(uint32_t a, uint32_t b, uint32_t &hi) {
+		uint64_t product = static_cast<uint64_t>(a) * b;
+		hi = static_cast<uint32_t>(product >> 32);
+		return static_cast<uint32_t>(product);
+	}
+
+	inline float toUnitFloat(uint32_t x) {
+		// top 24 bits, exactly representable in [0, 1)
+		return (x >> 8) * (1.0f / 16777216.0f);
+	}
+}
+
+#pragma region threadpool
+ThreadPool::ThreadPool(uint32_t threadCount) {
+	if (threadCount == 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	// the thread calling parallelFor is the last worker
+	for (uint32_t i = 1; i < threadCount; i++) {
+		m_workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (auto &worker : m_workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::enqueue(const std::function<void()> &job) {
+	if (m_workers.empty()) {
+		job();
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(job);
+	}
+	m_wake.notify_one();
+}
+
+bool ThreadPool::runOne() {
+	std::function<void()> job;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_jobs.empty()) return false;
+		job = std::move(m_jobs.front());
+		m_jobs.pop_front();
+	}
+	job();
+	return true;
+}
+
+void ThreadPool::workerLoop() {
+	for (;;) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+			if (m_jobs.empty()) return;	// stopping
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+		job();
+	}
+}
+
+void ThreadPool::parallelFor(size_t count, size_t minChunk, const std::function<void(size_t, size_t)> &fn) {
+	if (count == 0) return;
+	minChunk = std::max<size_t>(minChunk, 1);
+	size_t chunks = std::min<size_t>(threadCount() * 4, (count + minChunk - 1) / minChunk);
+	if (chunks <= 1 || m_workers.empty()) {
+		fn(0, count);
+		return;
+	}
+	const size_t chunkSize = (count + chunks - 1) / chunks;
+	chunks = (count + chunkSize - 1) / chunkSize;
+
+	std::mutex doneMutex;
+	std::condition_variable done;
+	std::atomic<size_t> remaining(chunks);
+	for (size_t c = 0; c < chunks; c++) {
+		size_t begin = c * chunkSize;
+		size_t end = std::min(count, begin + chunkSize);
+		enqueue([&, begin, end] {
+			fn(begin, end);
+			std::lock_guard<std::mutex> lock(doneMutex);
+			if (--remaining == 0) done.notify_all();
+		});
+	}
+	// work on the queue instead of sleeping
+	while (remaining > 0 && runOne()) {}
+	std::unique_lock<std::mutex> lock(doneMutex);
+	done.wait(lock, [&] { return remaining == 0; });
+}
+#pragma endregion threadpool
+
+#pragma region philox
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]) {
+	const uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+	const uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+	uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+	uint32_t k0 = key[0], k1 = key[1];
+	for (int round = 0; round < 10; round++) {
+		uint32_t hi0, hi1;
+		uint32_t lo0 = mulhilo(M0, c0, hi0);
+		uint32_t lo1 = mulhilo(M1, c2, hi1);
+		c0 = hi1 ^ c1 ^ k0;
+		c1 = lo1;
+		c2 = hi0 ^ c3 ^ k1;
+		c3 = lo0;
+		k0 += W0;
+		k1 += W1;
+	}
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+void fillUniform(float* dst, size_t count, uint64_t seed, uint64_t offset, float min, float max, ThreadPool &pool) {
+	const uint32_t key[2] = { static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32) };
+	const float scale = max - min;
+	const bool streaming = count * sizeof(float) >= StreamingThreshold;
+	pool.parallelFor(count, FillChunk, [&](size_t begin, size_t end) {
+		size_t i = begin;
+		while (i < end) {
+			// one Philox call yields the four elements sharing a counter
+			uint64_t element = offset + i;
+			uint64_t block = element / 4;
+			uint32_t counter[4] = { static_cast<uint32_t>(block), static_cast<uint32_t>(block >> 32), 0, 0 };
+			uint32_t bits[4];
+			philox4x32(counter, key, bits);
+			size_t lane = static_cast<size_t>(element % 4);
+#ifdef HOST_PREP_SSE2
+			if (streaming && lane == 0 && i + 4 <= end && isAligned16(dst + i)) {
+				__m128 v = _mm_set_ps(toUnitFloat(bits[3]), toUnitFloat(bits[2]), toUnitFloat(bits[1]), toUnitFloat(bits[0]));
+				v = _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(scale)), _mm_set1_ps(min));
+				_mm_stream_ps(dst + i, v);
+				i += 4;
+				continue;
+			}
+#endif
+			for (; lane < 4 && i < end; lane++, i++) {
+				dst[i] = min + toUnitFloat(bits[lane]) * scale;
+			}
+		}
+#ifdef HOST_PREP_SSE2
+		if (streaming) _mm_sfence();
+#endif
+	});
+}
+#pragma endregion philox
+
+#pragma region copies
+void copyStreaming(void* dst, const void* src, size_t bytes) {
+#ifdef HOST_PREP_SSE2
+	if (bytes >= StreamingThreshold && isAligned16(dst)) {
+		__m128i* d = static_cast<__m128i*>(dst);
+		const __m128i* s = static_cast<const __m128i*>(src);
+		size_t blocks = bytes / 64;
+		for (size_t i = 0; i < blocks; i++) {
+			__m128i a = _mm_loadu_si128(s + 0);
+			__m128i b = _mm_loadu_si128(s + 1);
+			__m128i c = _mm_loadu_si128(s + 2);
+			__m128i e = _mm_loadu_si128(s + 3);
+			_mm_stream_si128(d + 0, a);
+			_mm_stream_si128(d + 1, b);
+			_mm_stream_si128(d + 2, c);
+			_mm_stream_si128(d + 3, e);
+			d += 4;
+			s += 4;
+		}
+		_mm_sfence();
+		memcpy(d, s, bytes - blocks * 64);
+		return;
+	}
+#endif
+	memcpy(dst, src, bytes);
+}
+
+void parallelCopy(void* dst, const void* src, size_t bytes, ThreadPool &pool) {
+	// split on 64 byte lines so every chunk keeps the alignment of dst
+	const size_t lines = (bytes + 63) / 64;
+	pool.parallelFor(lines, CopyChunk / 64, [&](size_t begin, size_t end) {
+		size_t offset = begin * 64;
+		size_t size = std::min(bytes, end * 64) - offset;
+		copyStreaming(static_cast<uint8_t*>(dst) + offset, static_cast<const uint8_t*>(src) + offset, size);
+	});
+}
+
+void convertToFloat(float* dst, const double* src, size_t count, ThreadPool &pool) {
+	pool.parallelFor(count, CopyChunk / sizeof(double), [&](size_t begin, size_t end) {
+		size_t i = begin;
+#ifdef HOST_PREP_SSE2
+		for (; i + 4 <= end; i += 4) {
+			__m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(src + i));
+			__m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(src + i + 2));
+			_mm_storeu_ps(dst + i, _mm_movelh_ps(lo, hi));
+		}
+#endif
+		for (; i < end; i++) {
+			dst[i] = static_cast<float>(src[i]);
+		}
+	});
+}
+#pragma endregion copies
\ No newline at end of file
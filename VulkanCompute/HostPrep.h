@@ -0,0 +1,56 @@
+#ifndef HOST_PREP_H
+#define HOST_PREP_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads. parallelFor splits a range into chunks and blocks until all of them ran,
+// the calling thread works on chunks as well.
+class ThreadPool {
+public:
+	// 0 uses std::thread::hardware_concurrency()
+	explicit ThreadPool(uint32_t threadCount = 0);
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	~ThreadPool();
+
+	uint32_t threadCount() const { return static_cast<uint32_t>(m_workers.size()) + 1; }
+
+	// fn(begin, end) for chunks of at least minChunk elements
+	void parallelFor(size_t count, size_t minChunk, const std::function<void(size_t, size_t)> &fn);
+	// runs job on a worker, without waiting for it
+	void enqueue(const std::function<void()> &job);
+
+private:
+	std::vector<std::thread> m_workers;
+	std::deque<std::function<void()>> m_jobs;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	bool m_stop = false;
+
+	bool runOne();
+	void workerLoop();
+};
+
+// Philox4x32-10 counter based generator. Element i of a stream only depends on (key, i),
+// so any split of the range over threads produces the same numbers.
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]);
+
+// uniform floats in [min, max) for elements [offset, offset + count) of the stream seeded with seed.
+// destination writes are non-temporal where possible, which suits write combined mapped memory
+void fillUniform(float* dst, size_t count, uint64_t seed, uint64_t offset, float min, float max, ThreadPool &pool);
+
+// memcpy with non-temporal stores for 16 byte aligned destinations
+void copyStreaming(void* dst, const void* src, size_t bytes);
+// copyStreaming split over the pool
+void parallelCopy(void* dst, const void* src, size_t bytes, ThreadPool &pool);
+// double -> float conversion for user supplied data, split over the pool
+void convertToFloat(float* dst, const double* src, size_t count, ThreadPool &pool);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,232 @@
+#include "JobBatcher.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+	// one entry of the job table, BatchJob in shaders/batched.comp
+	struct BatchJob {
+		uint32_t offset;
+		uint32_t count;
+		uint32_t op;		// ElementwiseOp
+		float alpha;
+	};
+	static_assert(sizeof(BatchJob) == 16, "BatchJob has to match the std430 layout of shaders/batched.comp");
+}
+
+#pragma region jobbatcher
+JobBatcher::~JobBatcher() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	if (m_timer.joinable()) m_timer.join();
+	flush();
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_idle.wait(lock, [this] { return m_inFlight == 0; });
+	for (auto &arena : m_freeArenas) {
+		destroyArena(*arena);
+	}
+	m_freeArenas.clear();
+}
+
+vk::Result JobBatcher::init() {
+	vk::ResultValue<ComputeKernel*> loaded = m_context.loadKernel("batched", "shaders/batched.spv");
+	if (loaded.result != vk::Result::eSuccess) {
+		TRACE_FULL("unable to load batched");
+		return loaded.result;
+	}
+	m_kernel = loaded.value;
+	m_settings.maxJobs = std::max(1u, std::min(m_settings.maxJobs, m_context.limits().maxComputeWorkGroupCount[1]));
+	m_settings.maxElements = std::max(1u, m_settings.maxElements);
+	if (m_settings.maxDelay.count() > 0) {
+		m_timer = std::thread(&JobBatcher::timerLoop, this);
+	}
+	return vk::Result::eSuccess;
+}
+
+std::future<vk::Result> JobBatcher::submit(ElementwiseOp op, const float* a, const float* b, float* out, size_t count,
+	const float* c, float alpha) {
+	if (!m_kernel) {
+		TRACE_FULL("job batcher is not initialized");
+		return readyFuture(vk::Result::eErrorInitializationFailed);
+	}
+	if (op == ElementwiseOp::eFma && !c) {
+		TRACE_FULL("fma needs a third operand");
+		return readyFuture(vk::Result::eErrorInitializationFailed);
+	}
+	if (count == 0) {
+		return readyFuture(vk::Result::eSuccess);
+	}
+	if (count > std::numeric_limits<uint32_t>::max()) {
+		TRACE_FULL("batched jobs are limited to 2^32 - 1 elements");
+		return readyFuture(vk::Result::eErrorInitializationFailed);
+	}
+
+	const uint32_t elements = static_cast<uint32_t>(count);
+	std::unique_ptr<Batch> full;
+	std::unique_ptr<Batch> ready;
+	std::future<vk::Result> future;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_open && elements > m_open->arena->capacity - m_open->elements) {
+			full = takeOpen();
+		}
+		if (!m_open) {
+			std::unique_ptr<Arena> arena = acquireArena(std::max(elements, m_settings.maxElements));
+			if (arena) {
+				m_open.reset(new Batch());
+				m_open->arena = std::move(arena);
+				m_open->opened = std::chrono::steady_clock::now();
+				m_wake.notify_all();
+			}
+		}
+		if (m_open) {
+			future = append(op, a, b, c, alpha, out, elements);
+			if (m_open->jobs.size() >= m_settings.maxJobs || m_open->elements >= m_settings.maxElements || m_settings.maxDelay.count() <= 0) {
+				ready = takeOpen();
+			}
+		}
+	}
+	// the full batch holds older jobs, it goes first
+	if (full) submitBatch(std::move(full));
+	if (ready) submitBatch(std::move(ready));
+	if (!future.valid()) {
+		TRACE_FULL("unable to create batch arena");
+		return readyFuture(vk::Result::eErrorOutOfDeviceMemory);
+	}
+	return future;
+}
+
+std::future<vk::Result> JobBatcher::append(ElementwiseOp op, const float* a, const float* b, const float* c, float alpha,
+	float* out, uint32_t count) {
+	Batch &batch = *m_open;
+	Arena &arena = *batch.arena;
+	const uint32_t offset = batch.elements;
+	const size_t bytes = static_cast<size_t>(count) * sizeof(float);
+	memcpy(static_cast<float*>(arena.a.mapped()) + offset, a, bytes);
+	memcpy(static_cast<float*>(arena.b.mapped()) + offset, b, bytes);
+	if (op == ElementwiseOp::eFma) {
+		memcpy(static_cast<float*>(arena.c.mapped()) + offset, c, bytes);
+	}
+	BatchJob &entry = static_cast<BatchJob*>(arena.table.mapped())[batch.jobs.size()];
+	entry.offset = offset;
+	entry.count = count;
+	entry.op = static_cast<uint32_t>(op);
+	entry.alpha = alpha;
+
+	batch.jobs.emplace_back();
+	PendingJob &job = batch.jobs.back();
+	job.out = out;
+	job.offset = offset;
+	job.count = count;
+	batch.elements += count;
+	batch.largestJob = std::max(batch.largestJob, count);
+	return job.done.get_future();
+}
+
+void JobBatcher::flush() {
+	std::unique_ptr<Batch> batch;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_open) batch = takeOpen();
+	}
+	if (batch) submitBatch(std::move(batch));
+}
+
+BatchStats JobBatcher::stats() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+std::unique_ptr<JobBatcher::Arena> JobBatcher::acquireArena(uint32_t capacity) {
+	if (capacity <= m_settings.maxElements && !m_freeArenas.empty()) {
+		std::unique_ptr<Arena> arena = std::move(m_freeArenas.back());
+		m_freeArenas.pop_back();
+		return arena;
+	}
+	std::unique_ptr<Arena> arena(new Arena());
+	arena->capacity = capacity;
+	const vk::DeviceSize bytes = static_cast<vk::DeviceSize>(capacity) * sizeof(float);
+	vkExt::Buffer* buffers[] = { &arena->a, &arena->b, &arena->c, &arena->out };
+	bool created = m_context.createBuffer(arena->table, m_settings.maxJobs * sizeof(BatchJob)) == vk::Result::eSuccess;
+	for (vkExt::Buffer* buffer : buffers) {
+		created = created && m_context.createBuffer(*buffer, bytes) == vk::Result::eSuccess;
+	}
+	if (!created) {
+		destroyArena(*arena);
+		return nullptr;
+	}
+	return arena;
+}
+
+void JobBatcher::destroyArena(Arena &arena) {
+	vkExt::Buffer* buffers[] = { &arena.table, &arena.a, &arena.b, &arena.c, &arena.out };
+	for (vkExt::Buffer* buffer : buffers) {
+		if (buffer->buffer) m_context.destroyBuffer(*buffer);
+	}
+}
+
+std::unique_ptr<JobBatcher::Batch> JobBatcher::takeOpen() {
+	m_inFlight++;
+	m_stats.batches++;
+	m_stats.jobs += m_open->jobs.size();
+	m_stats.elements += m_open->elements;
+	return std::move(m_open);
+}
+
+void JobBatcher::submitBatch(std::unique_ptr<Batch> batch) {
+	std::shared_ptr<Batch> submitted(std::move(batch));
+	const Arena &arena = *submitted->arena;
+	const uint32_t jobCount = static_cast<uint32_t>(submitted->jobs.size());
+
+	KernelDispatch dispatch;
+	dispatch.kernel = m_kernel;
+	dispatch.buffers = { arena.table.descriptor, arena.a.descriptor, arena.b.descriptor, arena.c.descriptor, arena.out.descriptor };
+	const uint8_t* pushBytes = reinterpret_cast<const uint8_t*>(&jobCount);
+	dispatch.pushConstants.assign(pushBytes, pushBytes + sizeof(jobCount));
+	// the row of the largest job decides the width, rows of smaller jobs leave their extra workgroups idle
+	dispatch.groupCountX = computeGroupCount(m_context.limits(), submitted->largestJob, m_kernel->workGroupSize());
+	dispatch.groupCountY = jobCount;
+
+	m_context.submit(std::vector<KernelDispatch>(1, dispatch), [this, submitted](vk::Result res) {
+		const float* results = static_cast<const float*>(submitted->arena->out.mapped());
+		for (PendingJob &job : submitted->jobs) {
+			if (res == vk::Result::eSuccess) {
+				memcpy(job.out, results + job.offset, job.count * sizeof(float));
+			}
+			job.done.set_value(res);
+		}
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (submitted->arena->capacity == m_settings.maxElements && m_freeArenas.size() < m_settings.keptArenas) {
+			m_freeArenas.push_back(std::move(submitted->arena));
+		}
+		else {
+			destroyArena(*submitted->arena);
+		}
+		m_inFlight--;
+		m_idle.notify_all();
+	});
+}
+
+void JobBatcher::timerLoop() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_stop) {
+		if (!m_open) {
+			m_wake.wait(lock);
+			continue;
+		}
+		const std::chrono::steady_clock::time_point deadline = m_open->opened + m_settings.maxDelay;
+		if (std::chrono::steady_clock::now() < deadline) {
+			m_wake.wait_until(lock, deadline);
+			continue;
+		}
+		std::unique_ptr<Batch> batch = takeOpen();
+		lock.unlock();
+		submitBatch(std::move(batch));
+		lock.lock();
+	}
+}
+#pragma endregion jobbatcher
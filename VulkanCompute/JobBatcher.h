@@ -0,0 +1,108 @@
+#ifndef JOB_BATCHER_H
+#define JOB_BATCHER_H
+
+#include "Elementwise.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// when JobBatcher submits the jobs collected so far
+struct BatchSettings {
+	// jobs per batch, also limited by maxComputeWorkGroupCount[1] as every job gets a row of workgroups
+	uint32_t maxJobs = 1024;
+	// elements per batch and size of the arenas, a larger job gets a batch and an arena of its own
+	uint32_t maxElements = 1 << 20;
+	// the first job of a batch waits at most this long for others, 0 submits every job on its own
+	std::chrono::microseconds maxDelay = std::chrono::microseconds(200);
+	// idle arenas kept for later batches, the others are destroyed once their batch completed
+	uint32_t keptArenas = 4;
+};
+
+struct BatchStats {
+	uint64_t jobs = 0;
+	uint64_t batches = 0;
+	uint64_t elements = 0;
+};
+
+// Coalesces small independent float element-wise jobs on host memory into one dispatch. Inputs are copied
+// into the shared arenas of the open batch at submit(), next to a table of offset, length and op of every job;
+// shaders/batched.comp runs a row of workgroups per table entry. Once the batch completed the results are
+// copied to each job's out and the futures become ready. A batch is submitted when it is full (maxJobs or
+// maxElements), when its first job waited maxDelay, or on flush(). submit() may be called from any thread
+class JobBatcher {
+public:
+	JobBatcher(ComputeContext &context, const BatchSettings &settings = BatchSettings()) : m_context(context), m_settings(settings) {}
+	JobBatcher(const JobBatcher&) = delete;
+	JobBatcher& operator=(const JobBatcher&) = delete;
+	// submits the open batch and waits for every batch
+	~JobBatcher();
+
+	vk::Result init();
+
+	// out = op(a, b) over count elements, c is only read by ElementwiseOp::eFma and alpha only by eSaxpy.
+	// a, b and c may be reused once submit() returned, out has to stay valid until the future is ready
+	std::future<vk::Result> submit(ElementwiseOp op, const float* a, const float* b, float* out, size_t count,
+		const float* c = nullptr, float alpha = 0.0f);
+	// submits the open batch without waiting for more jobs
+	void flush();
+
+	BatchStats stats() const;
+
+private:
+	// one host visible buffer per binding of shaders/batched.comp
+	struct Arena {
+		vkExt::Buffer table;
+		vkExt::Buffer a;
+		vkExt::Buffer b;
+		vkExt::Buffer c;
+		vkExt::Buffer out;
+		uint32_t capacity = 0;	// elements
+	};
+
+	struct PendingJob {
+		float* out = nullptr;
+		uint32_t offset = 0;
+		uint32_t count = 0;
+		std::promise<vk::Result> done;
+	};
+
+	struct Batch {
+		std::unique_ptr<Arena> arena;
+		std::vector<PendingJob> jobs;
+		uint32_t elements = 0;
+		uint32_t largestJob = 0;
+		std::chrono::steady_clock::time_point opened;
+	};
+
+	ComputeContext &m_context;
+	BatchSettings m_settings;
+	ComputeKernel* m_kernel = nullptr;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_wake;		// a batch was opened or the batcher stops
+	std::condition_variable m_idle;		// a batch completed
+	std::unique_ptr<Batch> m_open;
+	std::vector<std::unique_ptr<Arena>> m_freeArenas;
+	uint32_t m_inFlight = 0;
+	bool m_stop = false;
+	std::thread m_timer;
+	BatchStats m_stats;
+
+	// a free arena of maxElements or a new one of at least capacity elements, called with m_mutex held
+	std::unique_ptr<Arena> acquireArena(uint32_t capacity);
+	void destroyArena(Arena &arena);
+	// copies the operands into the open batch and adds its table entry, called with m_mutex held
+	std::future<vk::Result> append(ElementwiseOp op, const float* a, const float* b, const float* c, float alpha, float* out, uint32_t count);
+	// takes the open batch out for submitBatch(), called with m_mutex held
+	std::unique_ptr<Batch> takeOpen();
+	void submitBatch(std::unique_ptr<Batch> batch);
+	// submits batches whose first job waited maxDelay
+	void timerLoop();
+};
+
+#endif
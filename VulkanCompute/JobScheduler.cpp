@@ -0,0 +1,219 @@
+#include "JobScheduler.h"
+#include "Helpers.h"
+
+#include <algorithm>
+
+namespace {
+	// submissions a thread keeps in flight, one is recorded while the other runs
+	const uint32_t SubmissionsPerThread = 2;
+	// jobs recorded into one command buffer at most
+	const size_t MaxJobsPerSubmission = 16;
+
+	// lets submit() called from inside a job land on the calling thread's own queue
+	thread_local const void* t_scheduler = nullptr;
+	thread_local uint32_t t_worker = 0;
+}
+
+vk::Result JobScheduler::init(vk::Device device, const std::vector<ComputeQueue> &queues, uint32_t threadCount) {
+	if (queues.empty()) {
+		TRACE_FULL("job scheduler needs at least one queue");
+		return vk::Result::eErrorInitializationFailed;
+	}
+	m_device = device;
+	m_queues = queues;
+	m_stop = false;
+	if (threadCount == 0) {
+		threadCount = static_cast<uint32_t>(queues.size());
+	}
+
+	for (uint32_t i = 0; i < threadCount; i++) {
+		std::unique_ptr<Worker> worker(new Worker());
+		worker->queue = i % static_cast<uint32_t>(m_queues.size());
+		vk::CommandPoolCreateInfo commandPoolCI = vk::CommandPoolCreateInfo()
+			.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer)
+			.setQueueFamilyIndex(m_queues[worker->queue].family);
+		vk::Result res = m_device.createCommandPool(&commandPoolCI, nullptr, &worker->commandPool);
+		if (res != vk::Result::eSuccess) {
+			TRACE_FULL("unable to create job command pool");
+			destroy();
+			return res;
+		}
+		m_workers.push_back(std::move(worker));
+		Worker &w = *m_workers.back();
+
+		w.submissions.resize(SubmissionsPerThread);
+		for (auto &submission : w.submissions) {
+			vk::CommandBufferAllocateInfo allocInfo = vk::CommandBufferAllocateInfo()
+				.setCommandPool(w.commandPool)
+				.setLevel(vk::CommandBufferLevel::ePrimary)
+				.setCommandBufferCount(1);
+			res = m_device.allocateCommandBuffers(&allocInfo, &submission.commandBuffer);
+			if (res == vk::Result::eSuccess) {
+				vk::FenceCreateInfo fenceCI;
+				res = m_device.createFence(&fenceCI, nullptr, &submission.fence);
+			}
+			if (res != vk::Result::eSuccess) {
+				TRACE_FULL("unable to create job submission");
+				destroy();
+				return res;
+			}
+		}
+	}
+	// threads start once every worker exists, they steal from each other
+	for (uint32_t i = 0; i < static_cast<uint32_t>(m_workers.size()); i++) {
+		m_workers[i]->thread = std::thread(&JobScheduler::workerLoop, this, i);
+	}
+	return vk::Result::eSuccess;
+}
+
+void JobScheduler::destroy() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	// workers finish every queued job before they exit
+	for (auto &worker : m_workers) {
+		if (worker->thread.joinable()) worker->thread.join();
+	}
+	for (auto &worker : m_workers) {
+		for (auto &submission : worker->submissions) {
+			if (submission.fence) m_device.destroyFence(submission.fence);
+		}
+		if (worker->commandPool) m_device.destroyCommandPool(worker->commandPool);
+	}
+	m_workers.clear();
+	m_queues.clear();
+}
+
+std::future<vk::Result> JobScheduler::submit(const JobRecord &record, const JobComplete &complete) {
+	Job* job = new Job();
+	job->record = record;
+	job->complete = complete;
+	std::future<vk::Result> future = job->done.get_future();
+	if (m_workers.empty()) {
+		TRACE_FULL("job scheduler not initialized");
+		if (job->complete) job->complete(vk::Result::eErrorInitializationFailed);
+		job->done.set_value(vk::Result::eErrorInitializationFailed);
+		delete job;
+		return future;
+	}
+
+	// counted before it is visible, so a worker never sees more jobs than m_queued
+	m_unfinished++;
+	m_queued++;
+	const uint32_t workerCount = static_cast<uint32_t>(m_workers.size());
+	uint32_t index = t_scheduler == this ? t_worker : m_nextWorker++ % workerCount;
+	for (uint32_t attempt = 0; !m_workers[index]->jobs.push(job); attempt++) {
+		// full, try the next worker and back off once all of them were full
+		index = (index + 1) % workerCount;
+		if (attempt >= workerCount) std::this_thread::yield();
+	}
+	if (m_sleeping > 0) {
+		// the lock orders the notify after a worker that is about to sleep checked m_queued
+		{ std::lock_guard<std::mutex> lock(m_mutex); }
+		m_wake.notify_one();
+	}
+	return future;
+}
+
+void JobScheduler::waitIdle() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_idle.wait(lock, [this] { return m_unfinished == 0; });
+}
+
+size_t JobScheduler::takeJobs(uint32_t index, std::vector<std::unique_ptr<Job>> &jobs, size_t maxJobs) {
+	Job* job = nullptr;
+	Worker &own = *m_workers[index];
+	while (jobs.size() < maxJobs && own.jobs.pop(job)) {
+		jobs.push_back(std::unique_ptr<Job>(job));
+	}
+	for (size_t i = 1; i < m_workers.size() && jobs.empty(); i++) {
+		Worker &victim = *m_workers[(index + i) % m_workers.size()];
+		// take half of the victim's jobs, so both keep their queues busy
+		size_t count = std::min(maxJobs, (victim.jobs.sizeApprox() + 1) / 2);
+		while (jobs.size() < count && victim.jobs.pop(job)) {
+			jobs.push_back(std::unique_ptr<Job>(job));
+		}
+		m_stolen += jobs.size();
+	}
+	m_queued -= jobs.size();
+	return jobs.size();
+}
+
+void JobScheduler::workerLoop(uint32_t index) {
+	t_scheduler = this;
+	t_worker = index;
+	Worker &worker = *m_workers[index];
+	uint32_t next = 0;
+	std::vector<std::unique_ptr<Job>> jobs;
+	for (;;) {
+		Submission &submission = worker.submissions[next];
+		if (!submission.jobs.empty()) {
+			// the slot is reused, its previous submission has to be done
+			finish(submission, m_device.waitForFences(1, &submission.fence, VK_TRUE, UINT64_MAX));
+		}
+
+		jobs.clear();
+		if (takeJobs(index, jobs, MaxJobsPerSubmission) == 0) {
+			// nothing left to record, complete what is in flight before going to sleep
+			for (auto &pending : worker.submissions) {
+				if (!pending.jobs.empty()) {
+					finish(pending, m_device.waitForFences(1, &pending.fence, VK_TRUE, UINT64_MAX));
+				}
+			}
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_sleeping++;
+			m_wake.wait(lock, [this] { return m_stop || m_queued > 0; });
+			m_sleeping--;
+			if (m_stop && m_queued == 0) return;
+			continue;
+		}
+
+		submission.jobs = std::move(jobs);
+		vk::Result res = flush(worker, submission);
+		if (res != vk::Result::eSuccess) {
+			finish(submission, res);
+		}
+		next = (next + 1) % worker.submissions.size();
+	}
+}
+
+vk::Result JobScheduler::flush(Worker &worker, Submission &submission) {
+	vk::CommandBuffer commandBuffer = submission.commandBuffer;
+	commandBuffer.reset(vk::CommandBufferResetFlags());
+	commandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	// the jobs are independent, so they need no barriers between each other
+	for (auto &job : submission.jobs) {
+		job->record(commandBuffer);
+	}
+	commandBuffer.end();
+
+	vk::SubmitInfo submitInfo = vk::SubmitInfo()
+		.setCommandBufferCount(1)
+		.setPCommandBuffers(&commandBuffer);
+	ComputeQueue &queue = m_queues[worker.queue];
+	std::lock_guard<std::mutex> lock(*queue.mutex);
+	vk::Result res = queue.queue.submit(1, &submitInfo, submission.fence);
+	if (res != vk::Result::eSuccess) {
+		TRACE_FULL("unable to submit jobs");
+	}
+	return res;
+}
+
+void JobScheduler::finish(Submission &submission, vk::Result result) {
+	if (result == vk::Result::eSuccess) {
+		m_device.resetFences(1, &submission.fence);
+	}
+	const size_t count = submission.jobs.size();
+	for (auto &job : submission.jobs) {
+		if (job->complete) job->complete(result);
+		job->done.set_value(result);
+	}
+	submission.jobs.clear();
+
+	if ((m_unfinished -= count) == 0) {
+		{ std::lock_guard<std::mutex> lock(m_mutex); }
+		m_idle.notify_all();
+	}
+}
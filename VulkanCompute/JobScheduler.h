@@ -0,0 +1,102 @@
+#ifndef JOB_SCHEDULER_H
+#define JOB_SCHEDULER_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "LockFreeQueue.h"
+
+// one queue of the device. vkQueueSubmit needs external synchronization,
+// every submission to the queue holds its mutex
+struct ComputeQueue {
+	uint32_t family = 0;
+	uint32_t index = 0;
+	vk::Queue queue;
+	bool async = false;		// compute family without graphics
+	std::shared_ptr<std::mutex> mutex = std::make_shared<std::mutex>();
+};
+
+// records one job, called on the submission thread that picked the job up
+typedef std::function<void(vk::CommandBuffer)> JobRecord;
+// called on the submission thread once the job finished on the GPU, before its future becomes ready
+typedef std::function<void(vk::Result)> JobComplete;
+
+// Runs independent GPU jobs on all compute queues. Every submission thread owns a command pool
+// for the family of its home queue and a lock-free queue of jobs. Idle threads steal from the others,
+// jobs picked up together are recorded into one command buffer and submitted at once.
+// submit() may be called from any thread, it only blocks if every queue is full.
+class JobScheduler {
+public:
+	JobScheduler() {}
+	JobScheduler(const JobScheduler&) = delete;
+	JobScheduler& operator=(const JobScheduler&) = delete;
+	~JobScheduler() { destroy(); }
+
+	// threadCount 0 starts one submission thread per queue
+	vk::Result init(vk::Device device, const std::vector<ComputeQueue> &queues, uint32_t threadCount = 0);
+	void destroy();
+
+	// the future is ready once the job has finished on the GPU
+	std::future<vk::Result> submit(const JobRecord &record, const JobComplete &complete = JobComplete());
+	// blocks until every submitted job has finished
+	void waitIdle();
+
+	uint32_t threadCount() const { return static_cast<uint32_t>(m_workers.size()); }
+	uint32_t queueCount() const { return static_cast<uint32_t>(m_queues.size()); }
+	// jobs a thread took from another thread's deque
+	uint64_t stolenJobs() const { return m_stolen; }
+
+private:
+	struct Job {
+		JobRecord record;
+		JobComplete complete;
+		std::promise<vk::Result> done;
+	};
+
+	// one submission in flight: its command buffer, fence and the jobs recorded into it
+	struct Submission {
+		vk::CommandBuffer commandBuffer;
+		vk::Fence fence;
+		std::vector<std::unique_ptr<Job>> jobs;
+	};
+
+	struct Worker {
+		std::thread thread;
+		uint32_t queue = 0;
+		vk::CommandPool commandPool;
+		std::vector<Submission> submissions;	// used round robin
+		LockFreeQueue<Job*> jobs;
+	};
+
+	vk::Device m_device;
+	std::vector<ComputeQueue> m_queues;
+	std::vector<std::unique_ptr<Worker>> m_workers;
+	std::atomic<uint32_t> m_nextWorker{ 0 };
+	std::atomic<uint64_t> m_stolen{ 0 };
+
+	// jobs waiting in the queues and jobs that were submitted but have not finished yet.
+	// the mutex only guards sleeping, submit() takes it when a worker may be asleep
+	std::atomic<uint64_t> m_queued{ 0 };
+	std::atomic<uint64_t> m_unfinished{ 0 };
+	std::atomic<uint32_t> m_sleeping{ 0 };
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_idle;
+	bool m_stop = false;
+
+	void workerLoop(uint32_t index);
+	// up to maxJobs jobs from the own queue, or stolen from another one
+	size_t takeJobs(uint32_t index, std::vector<std::unique_ptr<Job>> &jobs, size_t maxJobs);
+	vk::Result flush(Worker &worker, Submission &submission);
+	void finish(Submission &submission, vk::Result result);
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef LOCK_FREE_QUEUE_H
+#define LOCK_FREE_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Bounded multi producer, multi consumer FIFO (Vyukov). Every cell carries a sequence number
+// that tells producers and consumers whose turn it is, so push and pop are one CAS each and never block.
+template<typename T>
+class LockFreeQueue {
+public:
+	// capacity is rounded up to a power of two
+	explicit LockFreeQueue(size_t capacity = 1024) {
+		size_t size = 2;
+		while (size < capacity) size *= 2;
+		m_cells.reset(new Cell[size]);
+		m_mask = size - 1;
+		for (size_t i = 0; i < size; i++) {
+			m_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+	LockFreeQueue(const LockFreeQueue&) = delete;
+	LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+	// false if the queue is full
+	bool push(const T &value) {
+		size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell &cell = m_cells[pos & m_mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+			if (diff == 0) {
+				if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					cell.value = value;
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0) {
+				return false;
+			}
+			else {
+				pos = m_enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// false if the queue is empty
+	bool pop(T &value) {
+		size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell &cell = m_cells[pos & m_mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+			if (diff == 0) {
+				if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					value = cell.value;
+					cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0) {
+				return false;
+			}
+			else {
+				pos = m_dequeuePos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// only a hint while other threads push or pop
+	size_t sizeApprox() const {
+		size_t enqueued = m_enqueuePos.load(std::memory_order_relaxed);
+		size_t dequeued = m_dequeuePos.load(std::memory_order_relaxed);
+		return enqueued > dequeued ? enqueued - dequeued : 0;
+	}
+
+private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	std::unique_ptr<Cell[]> m_cells;
+	size_t m_mask = 0;
+	// producers and consumers on separate cache lines
+	alignas(64) std::atomic<size_t> m_enqueuePos{ 0 };
+	alignas(64) std::atomic<size_t> m_dequeuePos{ 0 };
+};
+
+#endif
@@ -0,0 +1,129 @@
+#include "MappedFile.h"
+#include "Helpers.h"
+
+#ifdef _WIN32
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#ifdef _WIN32
+bool MappedFile::openRead(const std::string &path) {
+	close();
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		TRACE_FULL("unable to open " + path);
+		return false;
+	}
+	m_file = file;
+	m_open = true;
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+	m_size = static_cast<uint64_t>(size.QuadPart);
+	if (m_size == 0) return true;
+	m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	m_data = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!m_data) {
+		TRACE_FULL("unable to map " + path);
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool MappedFile::create(const std::string &path, uint64_t size) {
+	close();
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		TRACE_FULL("unable to create " + path);
+		return false;
+	}
+	m_file = file;
+	m_open = true;
+	m_size = size;
+	if (m_size == 0) return true;
+	// the mapping extends the file to its size
+	m_mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size & 0xffffffff), nullptr);
+	m_data = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, 0) : nullptr;
+	if (!m_data) {
+		TRACE_FULL("unable to map " + path);
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close() {
+	if (m_data) UnmapViewOfFile(m_data);
+	if (m_mapping) CloseHandle(m_mapping);
+	if (m_file) CloseHandle(m_file);
+	m_data = nullptr;
+	m_mapping = nullptr;
+	m_file = nullptr;
+	m_size = 0;
+	m_open = false;
+}
+#else
+bool MappedFile::openRead(const std::string &path) {
+	close();
+	m_fd = ::open(path.c_str(), O_RDONLY);
+	if (m_fd < 0) {
+		TRACE_FULL("unable to open " + path);
+		return false;
+	}
+	m_open = true;
+	struct stat st;
+	fstat(m_fd, &st);
+	m_size = static_cast<uint64_t>(st.st_size);
+	if (m_size == 0) return true;
+	void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+	if (data == MAP_FAILED) {
+		TRACE_FULL("unable to map " + path);
+		close();
+		return false;
+	}
+	madvise(data, m_size, MADV_SEQUENTIAL);
+	m_data = data;
+	return true;
+}
+
+bool MappedFile::create(const std::string &path, uint64_t size) {
+	close();
+	m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (m_fd < 0) {
+		TRACE_FULL("unable to create " + path);
+		return false;
+	}
+	m_open = true;
+	m_size = size;
+	if (m_size == 0) return true;
+	if (ftruncate(m_fd, static_cast<off_t>(size)) != 0) {
+		TRACE_FULL("unable to resize " + path);
+		close();
+		return false;
+	}
+	void* data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if (data == MAP_FAILED) {
+		TRACE_FULL("unable to map " + path);
+		close();
+		return false;
+	}
+	m_data = data;
+	return true;
+}
+
+void MappedFile::close() {
+	if (m_data) munmap(m_data, m_size);
+	if (m_fd >= 0) ::close(m_fd);
+	m_data = nullptr;
+	m_fd = -1;
+	m_size = 0;
+	m_open = false;
+}
+#endif
\ No newline at end of file
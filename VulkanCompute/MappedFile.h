@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstdint>
+#include <string>
+
+// A file mapped into the address space, either read only or created with a fixed size and writable.
+class MappedFile {
+public:
+	MappedFile() {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() { close(); }
+
+	// maps an existing file read only
+	bool openRead(const std::string &path);
+	// creates or truncates the file to size bytes and maps it writable
+	bool create(const std::string &path, uint64_t size);
+	// unmaps and closes, writable mappings are flushed by the OS
+	void close();
+
+	bool isOpen() const { return m_open; }
+	void* data() const { return m_data; }
+	uint64_t size() const { return m_size; }
+
+private:
+	void* m_data = nullptr;
+	uint64_t m_size = 0;
+	bool m_open = false;
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#else
+	int m_fd = -1;
+#endif
+};
+
+#endif
\ No newline at end of file
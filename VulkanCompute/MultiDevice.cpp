@@ -0,0 +1,145 @@
+#include "MultiDevice.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace {
+	// partitions start on 64 byte boundaries, which keeps the streaming copies aligned
+	const uint64_t PartitionAlignment = 64 / sizeof(float);
+	// weight of the latest measurement against the previous throughput
+	const double ThroughputSmoothing = 0.5;
+
+	double secondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+vk::Result MultiDeviceCompute::init() {
+	// the first device tells how many physical devices can run the kernel. it is shared with
+	// the application on device 0, so the probe costs nothing extra
+	std::shared_ptr<SharedDevice> probe;
+	vk::Result probeRes = SharedDevice::acquire(0, m_settings.compute.shareDevice, probe);
+	if (probeRes != vk::Result::eSuccess) return probeRes;
+	uint32_t physicalCount = probe->suitableDeviceCount();
+	uint32_t count = m_settings.deviceCount ? m_settings.deviceCount : physicalCount;
+
+	uint32_t hostThreads = m_settings.compute.hostThreads ? m_settings.compute.hostThreads : std::thread::hardware_concurrency();
+	m_devices.clear();
+	for (uint32_t i = 0; i < count; i++) {
+		ComputeSettings settings = m_settings.compute;
+		settings.deviceIndex = i % physicalCount;
+		// the partition is split by device throughput, a device must not hand its share to the host
+		settings.backend = ComputeBackend::eGpu;
+		settings.hostThreads = std::max(1u, hostThreads / count);
+		if (!settings.pipelineCachePath.empty()) {
+			// devices must not overwrite each other's cache on exit
+			settings.pipelineCachePath += "." + std::to_string(i);
+		}
+		m_devices.emplace_back(new VulkanComputeApplication(settings));
+		vk::Result res = m_devices.back()->init();
+		if (res != vk::Result::eSuccess) {
+			TRACE_FULL("unable to initialize device " + std::to_string(i));
+			m_devices.clear();
+			return res;
+		}
+	}
+	m_throughput.assign(count, 1.0);
+	m_partition.assign(count, 0);
+	return calibrate();
+}
+
+vk::Result MultiDeviceCompute::calibrate() {
+	if (m_settings.calibrationBatches == 0) return vk::Result::eSuccess;
+	// all devices run at once, as they will in run(), so shared host and bus bandwidth is accounted for
+	std::vector<vk::Result> results(m_devices.size(), vk::Result::eSuccess);
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < m_devices.size(); i++) {
+		threads.push_back(std::thread([this, i, &results] {
+			VulkanComputeApplication &app = *m_devices[i];
+			auto start = std::chrono::steady_clock::now();
+			results[i] = app.stream(m_settings.calibrationBatches, [&app](uint64_t batch, float* a, float* b) {
+				app.fillRandom(batch, a, b);
+			}, nullptr);
+			m_throughput[i] = static_cast<double>(m_settings.calibrationBatches) * app.batchSize() / std::max(secondsSince(start), 1e-9);
+		}));
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	for (vk::Result res : results) {
+		if (res != vk::Result::eSuccess) return res;
+	}
+	return vk::Result::eSuccess;
+}
+
+void MultiDeviceCompute::split(uint64_t count) {
+	double total = 0.0;
+	for (double t : m_throughput) {
+		total += t;
+	}
+	uint64_t assigned = 0;
+	for (size_t i = 0; i < m_devices.size(); i++) {
+		uint64_t share = static_cast<uint64_t>(count * (m_throughput[i] / total));
+		share = std::min(count - assigned, share / PartitionAlignment * PartitionAlignment);
+		m_partition[i] = share;
+		assigned += share;
+	}
+	// rounding leftovers go to the fastest device
+	size_t fastest = std::max_element(m_throughput.begin(), m_throughput.end()) - m_throughput.begin();
+	m_partition[fastest] += count - assigned;
+}
+
+vk::Result MultiDeviceCompute::run(const float* srcA, const float* srcB, float* dst, uint64_t count) {
+	if (m_devices.empty()) {
+		TRACE_FULL("MultiDeviceCompute not initialized. aborting.");
+		return vk::Result::eErrorInitializationFailed;
+	}
+	split(count);
+
+	std::vector<vk::Result> results(m_devices.size(), vk::Result::eSuccess);
+	std::vector<double> seconds(m_devices.size(), 0.0);
+	std::vector<std::thread> threads;
+	uint64_t offset = 0;
+	for (size_t i = 0; i < m_devices.size(); i++) {
+		if (m_partition[i] == 0) continue;
+		threads.push_back(std::thread([this, i, offset, srcA, srcB, dst, &results, &seconds] {
+			auto start = std::chrono::steady_clock::now();
+			results[i] = m_devices[i]->streamRange(srcA + offset, srcB + offset, dst + offset, m_partition[i]);
+			seconds[i] = secondsSince(start);
+		}));
+		offset += m_partition[i];
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+
+	for (size_t i = 0; i < m_devices.size(); i++) {
+		if (results[i] != vk::Result::eSuccess) {
+			TRACE_FULL("device " + std::to_string(i) + " failed");
+			return results[i];
+		}
+		// parts below one batch mostly measure latency, they do not say much about throughput
+		if (m_partition[i] >= m_devices[i]->batchSize() && seconds[i] > 0.0) {
+			double measured = m_partition[i] / seconds[i];
+			m_throughput[i] = ThroughputSmoothing * measured + (1.0 - ThroughputSmoothing) * m_throughput[i];
+		}
+	}
+	return vk::Result::eSuccess;
+}
+
+vk::Result MultiDeviceCompute::streamFiles(const std::string &inputA, const std::string &inputB, const std::string &outputPath) {
+	MappedFile fileA, fileB, output;
+	if (!fileA.openRead(inputA) || !fileB.openRead(inputB)) {
+		return vk::Result::eErrorInitializationFailed;
+	}
+	if (fileA.size() != fileB.size() || fileA.size() % sizeof(float) != 0) {
+		TRACE_FULL("input files must hold the same number of floats");
+		return vk::Result::eErrorInitializationFailed;
+	}
+	if (!output.create(outputPath, fileA.size())) {
+		return vk::Result::eErrorInitializationFailed;
+	}
+	return run(static_cast<const float*>(fileA.data()), static_cast<const float*>(fileB.data()),
+		static_cast<float*>(output.data()), fileA.size() / sizeof(float));
+}
@@ -0,0 +1,54 @@
+#ifndef MULTI_DEVICE_H
+#define MULTI_DEVICE_H
+
+#include "VulkanCompute.h"
+
+#include <memory>
+
+struct MultiDeviceSettings {
+	// settings of every device, deviceIndex is ignored.
+	// hostThreads are split between the devices, a pipelineCachePath gets the device number appended
+	ComputeSettings compute;
+	// number of devices to split across, 0 uses every suitable physical device.
+	// more than there are physical devices assigns them round robin, which allows testing the
+	// splitting with a single software ICD such as lavapipe
+	uint32_t deviceCount = 0;
+	// batches of random inputs timed on every device during init() to weight the first split
+	uint32_t calibrationBatches = 3;
+};
+
+// One VulkanComputeApplication (instance, logical device, queues, frames) per physical device.
+// A range is partitioned between them proportionally to their measured throughput, every device
+// streams its part on its own host thread and writes straight into the shared output.
+class MultiDeviceCompute {
+public:
+	MultiDeviceCompute(MultiDeviceSettings settings = MultiDeviceSettings()) : m_settings(settings) {}
+	MultiDeviceCompute(const MultiDeviceCompute&) = delete;
+	MultiDeviceCompute& operator=(const MultiDeviceCompute&) = delete;
+
+	vk::Result init();
+
+	// dst[i] = srcA[i] + srcB[i] for count elements, split over all devices.
+	// the measured throughput of this run weights the next one
+	vk::Result run(const float* srcA, const float* srcB, float* dst, uint64_t count);
+	// VulkanComputeApplication::streamFiles split over all devices
+	vk::Result streamFiles(const std::string &inputA, const std::string &inputB, const std::string &outputPath);
+
+	uint32_t deviceCount() const { return static_cast<uint32_t>(m_devices.size()); }
+	VulkanComputeApplication& device(uint32_t index) { return *m_devices[index]; }
+	// elements per second of every device, as used for the next split
+	const std::vector<double>& throughput() const { return m_throughput; }
+	// elements given to every device by the last run()
+	const std::vector<uint64_t>& partition() const { return m_partition; }
+
+private:
+	MultiDeviceSettings m_settings;
+	std::vector<std::unique_ptr<VulkanComputeApplication>> m_devices;
+	std::vector<double> m_throughput;
+	std::vector<uint64_t> m_partition;
+
+	vk::Result calibrate();
+	void split(uint64_t count);
+};
+
+#endif
@@ -0,0 +1,193 @@
+#include "ParallelPrimitives.h"
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+
+namespace {
+	// elements every invocation of the first reduction pass combines before the workgroup tree
+	const uint32_t ReduceItemsPerInvocation = 8;
+	// partials of a pass, small enough for the next pass to need a single workgroup
+	const uint32_t MaxReduceGroups = 1024;
+	// elements per invocation of a scan tile, ITEMS in shaders/scan.comp
+	const uint32_t ScanItemsPerInvocation = 4;
+
+	// ScanPass of shaders/scan.comp
+	const uint32_t ScanPassExclusive = 0;
+	const uint32_t ScanPassAddOffsets = 2;
+
+	// builds of shaders/reduce.comp and shaders/scan.comp, best first. the shuffle builds are for devices
+	// without subgroup arithmetic and need whole subgroups, as every lane reads its neighbours
+	const std::vector<KernelVariant> ReduceVariants = {
+		KernelVariant("_subgroup", KernelCapability::eSubgroupArithmetic),
+		KernelVariant("_shuffle", KernelCapability::eSubgroupShuffle, true),
+		KernelVariant("")
+	};
+	const std::vector<KernelVariant> ScanVariants = {
+		KernelVariant("_subgroup", KernelCapability::eSubgroupArithmetic, true),
+		KernelVariant("_shuffle", KernelCapability::eSubgroupShuffleRelative, true),
+		KernelVariant("")
+	};
+
+	// buffers of one job, destroyed once it completed. a deque keeps the returned pointers valid
+	struct JobScratch {
+		ComputeContext* context = nullptr;
+		std::deque<vkExt::Buffer> buffers;
+
+		~JobScratch() {
+			for (auto &buffer : buffers) {
+				context->destroyBuffer(buffer);
+			}
+		}
+
+		vkExt::Buffer* create(vk::DeviceSize size, vk::MemoryPropertyFlags flags) {
+			vkExt::Buffer buffer;
+			if (context->createBuffer(buffer, size, flags) != vk::Result::eSuccess) {
+				TRACE_FULL("unable to create scratch buffer");
+				return nullptr;
+			}
+			buffers.push_back(buffer);
+			return &buffers.back();
+		}
+	};
+
+	KernelDispatch makeDispatch(const ComputeKernel* kernel, const JobBuffers &buffers, const void* push, size_t pushSize, uint32_t groupCount) {
+		KernelDispatch dispatch;
+		dispatch.kernel = kernel;
+		dispatch.buffers = buffers;
+		const uint8_t* pushBytes = static_cast<const uint8_t*>(push);
+		dispatch.pushConstants.assign(pushBytes, pushBytes + pushSize);
+		dispatch.groupCountX = groupCount;
+		return dispatch;
+	}
+}
+
+ComputeKernel* ParallelPrimitives::variant(const std::string &shader, const std::string &name, const KernelSpecialization &specialization,
+	const std::vector<KernelVariant> &variants) {
+	return m_context.loadVariant(name, "shaders/" + shader, variants, specialization).value;
+}
+
+void ParallelPrimitives::submitReduce(const std::string &type, ReduceOp op, const vk::DescriptorBufferInfo &input, size_t count,
+	const ReduceComplete &complete) {
+	static const char* opNames[] = { "sum", "min", "max", "argmax" };
+	if (count > std::numeric_limits<uint32_t>::max()) {
+		TRACE_FULL("reductions are limited to 2^32 - 1 elements");
+		complete(vk::Result::eErrorInitializationFailed, nullptr);
+		return;
+	}
+	const std::string name = "reduce_" + type + "_" + opNames[static_cast<uint32_t>(op)];
+	KernelSpecialization specialization;
+	specialization[1] = static_cast<uint32_t>(op);
+	specialization[2] = 0;
+	ComputeKernel* first = variant("reduce_" + type, name, specialization, ReduceVariants);
+	specialization[2] = 1;
+	ComputeKernel* partials = variant("reduce_" + type, name + "_partials", specialization, ReduceVariants);
+	if (!first || !partials) {
+		complete(vk::Result::eErrorInitializationFailed, nullptr);
+		return;
+	}
+
+	// value and index, see Partial in shaders/reduce.comp
+	const vk::DeviceSize partialSize = 8;
+	std::shared_ptr<JobScratch> scratch = std::make_shared<JobScratch>();
+	scratch->context = &m_context;
+	vkExt::Buffer* result = scratch->create(partialSize,
+		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+	vkExt::Buffer* ping = scratch->create(partialSize * MaxReduceGroups, vk::MemoryPropertyFlagBits::eDeviceLocal);
+	vkExt::Buffer* pong = scratch->create(partialSize * MaxReduceGroups, vk::MemoryPropertyFlagBits::eDeviceLocal);
+	if (!result || !ping || !pong) {
+		complete(vk::Result::eErrorOutOfDeviceMemory, nullptr);
+		return;
+	}
+
+	// every pass leaves one partial per workgroup until a single workgroup is left
+	std::vector<KernelDispatch> dispatches;
+	const vk::PhysicalDeviceLimits &limits = m_context.limits();
+	uint32_t remaining = static_cast<uint32_t>(count);
+	const vkExt::Buffer* source = pong;
+	const vkExt::Buffer* target = ping;
+	for (bool firstPass = true; ; firstPass = false) {
+		const ComputeKernel* kernel = firstPass ? first : partials;
+		const uint32_t invocations = static_cast<uint32_t>((static_cast<uint64_t>(remaining) + ReduceItemsPerInvocation - 1) / ReduceItemsPerInvocation);
+		const uint32_t groups = std::min(computeGroupCount(limits, invocations, kernel->workGroupSize()), MaxReduceGroups);
+		if (groups == 1) target = result;
+		dispatches.push_back(makeDispatch(kernel, { input, source->descriptor, target->descriptor }, &remaining, sizeof(remaining), groups));
+		if (groups == 1) break;
+		remaining = groups;
+		std::swap(source, target);
+	}
+
+	m_context.submit(dispatches, [scratch, result, complete](vk::Result res) {
+		const uint8_t* partial = res == vk::Result::eSuccess ? static_cast<const uint8_t*>(result->mapped()) : nullptr;
+		complete(res, partial);
+	});
+}
+
+std::future<vk::Result> ParallelPrimitives::submitScan(const std::string &type, ScanMode mode, const vk::DescriptorBufferInfo &input,
+	const vk::DescriptorBufferInfo &output, size_t count, size_t elementSize) {
+	if (count == 0) {
+		return readyFuture(vk::Result::eSuccess);
+	}
+	if (count > std::numeric_limits<uint32_t>::max()) {
+		TRACE_FULL("scans are limited to 2^32 - 1 elements");
+		return readyFuture(vk::Result::eErrorInitializationFailed);
+	}
+	static const char* passNames[] = { "exclusive", "inclusive", "offsets" };
+	ComputeKernel* kernels[3];
+	for (uint32_t pass = 0; pass < 3; pass++) {
+		KernelSpecialization specialization;
+		specialization[1] = pass;
+		kernels[pass] = variant("scan_" + type, "scan_" + type + "_" + passNames[pass], specialization, ScanVariants);
+		if (!kernels[pass]) {
+			return readyFuture(vk::Result::eErrorInitializationFailed);
+		}
+	}
+	const ComputeKernel* leafScan = kernels[static_cast<uint32_t>(mode)];
+	const ComputeKernel* sumScan = kernels[ScanPassExclusive];
+	const ComputeKernel* addOffsets = kernels[ScanPassAddOffsets];
+	// all passes are loaded with the default workgroup size, the offset pass gets the tile size as a push constant
+	const uint32_t tileSize = leafScan->workGroupSize() * ScanItemsPerInvocation;
+
+	// level 0 scans the elements, level l + 1 the tile sums of level l, until a single tile is left
+	struct Level {
+		vk::DescriptorBufferInfo data;
+		vkExt::Buffer* sums;
+		uint32_t count;
+		uint32_t tiles;
+	};
+	std::shared_ptr<JobScratch> scratch = std::make_shared<JobScratch>();
+	scratch->context = &m_context;
+	std::vector<Level> levels;
+	uint32_t remaining = static_cast<uint32_t>(count);
+	for (;;) {
+		Level level;
+		level.data = levels.empty() ? output : levels.back().sums->descriptor;
+		level.count = remaining;
+		level.tiles = static_cast<uint32_t>((static_cast<uint64_t>(remaining) + tileSize - 1) / tileSize);
+		level.sums = scratch->create(level.tiles * elementSize, vk::MemoryPropertyFlagBits::eDeviceLocal);
+		if (!level.sums) {
+			return readyFuture(vk::Result::eErrorOutOfDeviceMemory);
+		}
+		levels.push_back(level);
+		if (level.tiles == 1) break;
+		remaining = level.tiles;
+	}
+
+	const vk::PhysicalDeviceLimits &limits = m_context.limits();
+	std::vector<KernelDispatch> dispatches;
+	for (size_t l = 0; l < levels.size(); l++) {
+		const Level &level = levels[l];
+		const uint32_t push[2] = { level.count, tileSize };
+		const uint32_t groups = std::min(level.tiles, limits.maxComputeWorkGroupCount[0]);
+		dispatches.push_back(makeDispatch(l == 0 ? leafScan : sumScan, { l == 0 ? input : level.data, level.data, level.sums->descriptor },
+			push, sizeof(push), groups));
+	}
+	for (size_t l = levels.size() - 1; l-- > 0; ) {
+		// the tile sums of level l are scanned by now, every element gets the sum of the tiles before its own
+		const Level &level = levels[l];
+		const uint32_t push[2] = { level.count, tileSize };
+		dispatches.push_back(makeDispatch(addOffsets, { level.data, level.data, level.sums->descriptor },
+			push, sizeof(push), computeGroupCount(limits, level.count, addOffsets->workGroupSize())));
+	}
+	return m_context.submit(dispatches, [scratch](vk::Result) {});
+}
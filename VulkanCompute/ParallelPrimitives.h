@@ -0,0 +1,98 @@
+#ifndef PARALLEL_PRIMITIVES_H
+#define PARALLEL_PRIMITIVES_H
+
+#include "Elementwise.h"
+
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <type_traits>
+
+// values match the OP_ constants in shaders/reduce.comp
+enum class ReduceOp : uint32_t {
+	eSum = 0,
+	eMin = 1,
+	eMax = 2,
+	eArgMax = 3		// largest value and the lowest index holding it
+};
+
+enum class ScanMode : uint32_t {
+	eExclusive = 0,	// out[i] = in[0] + ... + in[i - 1]
+	eInclusive = 1	// out[i] = in[0] + ... + in[i]
+};
+
+template<typename T>
+struct ReduceResult {
+	vk::Result result = vk::Result::eSuccess;
+	T value = T();
+	uint32_t index = 0;		// ReduceOp::eArgMax only
+};
+
+// Reductions and prefix sums over TypedBuffers of float or int32_t, for any element count.
+// Each call is one job: workgroups combine their share in shared memory (within subgroups first, through
+// subgroup arithmetic or shuffles where the device supports them) and write one partial each, further passes reduce the partials.
+// Only the final value reaches host memory. Scans write per tile sums that are scanned recursively and
+// added back, in and out may be the same buffer. Buffers have to stay alive until the future is ready.
+class ParallelPrimitives {
+public:
+	explicit ParallelPrimitives(ComputeContext &context) : m_context(context) {}
+
+	template<typename T>
+	std::future<ReduceResult<T>> reduce(ReduceOp op, const vkExt::TypedBuffer<T> &input) {
+		static_assert(std::is_same<T, float>::value || std::is_same<T, int32_t>::value, "reductions are built for float and int32_t");
+		std::shared_ptr<std::promise<ReduceResult<T>>> promise = std::make_shared<std::promise<ReduceResult<T>>>();
+		std::future<ReduceResult<T>> future = promise->get_future();
+		submitReduce(ElementTraits<T>::name(), op, input.descriptor(), input.count, [promise](vk::Result result, const uint8_t* partial) {
+			ReduceResult<T> reduced;
+			reduced.result = result;
+			if (partial) {
+				memcpy(&reduced.value, partial, sizeof(T));
+				memcpy(&reduced.index, partial + sizeof(T), sizeof(uint32_t));
+			}
+			promise->set_value(reduced);
+		});
+		return future;
+	}
+	template<typename T>
+	std::future<ReduceResult<T>> sum(const vkExt::TypedBuffer<T> &input) { return reduce(ReduceOp::eSum, input); }
+	template<typename T>
+	std::future<ReduceResult<T>> min(const vkExt::TypedBuffer<T> &input) { return reduce(ReduceOp::eMin, input); }
+	template<typename T>
+	std::future<ReduceResult<T>> max(const vkExt::TypedBuffer<T> &input) { return reduce(ReduceOp::eMax, input); }
+	template<typename T>
+	std::future<ReduceResult<T>> argmax(const vkExt::TypedBuffer<T> &input) { return reduce(ReduceOp::eArgMax, input); }
+
+	template<typename T>
+	std::future<vk::Result> scan(ScanMode mode, const vkExt::TypedBuffer<T> &input, vkExt::TypedBuffer<T> &output) {
+		static_assert(std::is_same<T, float>::value || std::is_same<T, int32_t>::value, "scans are built for float and int32_t");
+		if (output.count < input.count) {
+			TRACE_FULL("scan output is too small");
+			return readyFuture(vk::Result::eErrorInitializationFailed);
+		}
+		return submitScan(ElementTraits<T>::name(), mode, input.descriptor(), output.descriptor(), input.count, sizeof(T));
+	}
+	template<typename T>
+	std::future<vk::Result> exclusiveScan(const vkExt::TypedBuffer<T> &input, vkExt::TypedBuffer<T> &output) {
+		return scan(ScanMode::eExclusive, input, output);
+	}
+	template<typename T>
+	std::future<vk::Result> inclusiveScan(const vkExt::TypedBuffer<T> &input, vkExt::TypedBuffer<T> &output) {
+		return scan(ScanMode::eInclusive, input, output);
+	}
+
+private:
+	// partial is the Partial of shaders/reduce.comp in host memory, nullptr on failure
+	typedef std::function<void(vk::Result, const uint8_t* partial)> ReduceComplete;
+
+	ComputeContext &m_context;
+
+	void submitReduce(const std::string &type, ReduceOp op, const vk::DescriptorBufferInfo &input, size_t count, const ReduceComplete &complete);
+	std::future<vk::Result> submitScan(const std::string &type, ScanMode mode, const vk::DescriptorBufferInfo &input,
+		const vk::DescriptorBufferInfo &output, size_t count, size_t elementSize);
+
+	// the best build of shader the device runs, see ComputeContext::loadVariant()
+	ComputeKernel* variant(const std::string &shader, const std::string &name, const KernelSpecialization &specialization,
+		const std::vector<KernelVariant> &variants);
+};
+
+#endif
@@ -0,0 +1,214 @@
+#include "Profiler.h"
+#include "Helpers.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+namespace {
+	std::string escapeJson(const std::string &s) {
+		std::string out;
+		for (char c : s) {
+			if (c == '"' || c == '\\') out += '\\';
+			out += c;
+		}
+		return out;
+	}
+
+	const char* trackName(ProfileTrack track) {
+		switch (track) {
+		case ProfileTrack::eCompute: return "gpu";
+		case ProfileTrack::eTransfer: return "gpu-transfer";
+		default: return "host";
+		}
+	}
+}
+
+vk::Result Profiler::init(vk::PhysicalDevice physicalDevice, vk::Device device, uint32_t maxTimestamps) {
+	m_device = device;
+	if (!m_enabled) return vk::Result::eSuccess;
+
+	vk::PhysicalDeviceProperties props = physicalDevice.getProperties();
+	m_deviceName = props.deviceName;
+	m_timestampPeriod = props.limits.timestampPeriod;
+	for (const auto &family : physicalDevice.getQueueFamilyProperties()) {
+		// begin() resets the queries with vkCmdResetQueryPool, which transfer only families cannot record
+		const bool canReset = static_cast<bool>(family.queueFlags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute));
+		m_timestampValidBits.push_back(canReset ? family.timestampValidBits : 0);
+	}
+	if (props.limits.timestampPeriod == 0.0f || maxTimestamps == 0) {
+		TRACE_FULL("device does not support timestamp queries, only host timings are recorded");
+		return vk::Result::eSuccess;
+	}
+
+	vk::QueryPoolCreateInfo queryPoolCI = vk::QueryPoolCreateInfo()
+		.setQueryType(vk::QueryType::eTimestamp)
+		.setQueryCount(maxTimestamps);
+	vk::Result res = m_device.createQueryPool(&queryPoolCI, nullptr, &m_queryPool);
+	if (res != vk::Result::eSuccess) {
+		TRACE_FULL("unable to create timestamp query pool");
+		m_queryPool = nullptr;
+		return res;
+	}
+	m_queryCount = maxTimestamps;
+	return vk::Result::eSuccess;
+}
+
+void Profiler::destroy() {
+	if (m_queryPool) {
+		m_device.destroyQueryPool(m_queryPool);
+		m_queryPool = nullptr;
+	}
+	m_scopes.clear();
+	m_nextQuery = 0;
+}
+
+uint32_t Profiler::createScope(uint32_t queueFamilyIndex, uint32_t maxMarks, ProfileTrack track) {
+	Scope scope;
+	scope.track = track;
+	uint32_t validBits = queueFamilyIndex < m_timestampValidBits.size() ? m_timestampValidBits[queueFamilyIndex] : 0;
+	if (gpuEnabled() && validBits > 0 && m_nextQuery + maxMarks + 1 <= m_queryCount) {
+		scope.firstQuery = m_nextQuery;
+		scope.queryCount = maxMarks + 1;
+		scope.validMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+		scope.labels.resize(scope.queryCount);
+		m_nextQuery += scope.queryCount;
+	}
+	m_scopes.push_back(scope);
+	return static_cast<uint32_t>(m_scopes.size() - 1);
+}
+
+void Profiler::begin(vk::CommandBuffer commandBuffer, uint32_t scope) {
+	Scope &s = m_scopes[scope];
+	if (s.queryCount == 0) return;
+	commandBuffer.resetQueryPool(m_queryPool, s.firstQuery, s.queryCount);
+	commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_queryPool, s.firstQuery);
+	s.used = 1;
+}
+
+void Profiler::mark(vk::CommandBuffer commandBuffer, uint32_t scope, const std::string &label, vk::PipelineStageFlagBits stage) {
+	Scope &s = m_scopes[scope];
+	if (s.used == 0 || s.used >= s.queryCount) return;
+	commandBuffer.writeTimestamp(stage, m_queryPool, s.firstQuery + s.used);
+	s.labels[s.used] = label;
+	s.used++;
+}
+
+void Profiler::collect(uint32_t scope, uint64_t batch, double submitMs) {
+	const Scope &s = m_scopes[scope];
+	if (s.used < 2) return;
+	std::vector<uint64_t> ticks(s.used);
+	vk::Result res = m_device.getQueryPoolResults(m_queryPool, s.firstQuery, s.used, ticks.size() * sizeof(uint64_t), ticks.data(),
+		sizeof(uint64_t), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+	if (res != vk::Result::eSuccess) {
+		TRACE_FULL("unable to read timestamp queries");
+		return;
+	}
+	const double msPerTick = m_timestampPeriod / 1.0e6;
+	for (uint32_t i = 1; i < s.used; i++) {
+		uint64_t start = ticks[i - 1] & s.validMask;
+		uint64_t end = ticks[i] & s.validMask;
+		ProfileEvent event;
+		event.name = s.labels[i];
+		event.track = s.track;
+		event.startMs = submitMs + ((start - (ticks[0] & s.validMask)) & s.validMask) * msPerTick;
+		event.durationMs = ((end - start) & s.validMask) * msPerTick;
+		event.batch = batch;
+		m_events.push_back(event);
+	}
+}
+
+double Profiler::now() const {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_origin).count();
+}
+
+void Profiler::hostEvent(const std::string &name, double startMs, double endMs, uint64_t batch) {
+	if (!enabled()) return;
+	ProfileEvent event;
+	event.name = name;
+	event.track = ProfileTrack::eHost;
+	event.startMs = startMs;
+	event.durationMs = endMs - startMs;
+	event.batch = batch;
+	m_events.push_back(event);
+}
+
+bool Profiler::writeJson(const std::string &path) const {
+	struct Stats {
+		uint64_t count = 0;
+		double total = 0.0;
+		double min = 0.0;
+		double max = 0.0;
+	};
+	std::map<std::string, Stats> stages;
+	for (const auto &event : m_events) {
+		Stats &stats = stages[std::string(trackName(event.track)) + "/" + event.name];
+		stats.min = stats.count ? std::min(stats.min, event.durationMs) : event.durationMs;
+		stats.max = stats.count ? std::max(stats.max, event.durationMs) : event.durationMs;
+		stats.total += event.durationMs;
+		stats.count++;
+	}
+
+	std::ofstream file(path, std::ios::trunc);
+	if (!file.is_open()) {
+		TRACE_FULL("unable to write profile " + path);
+		return false;
+	}
+	file << "{\n";
+	file << "  \"device\": \"" << escapeJson(m_deviceName) << "\",\n";
+	file << "  \"timestampPeriodNs\": " << m_timestampPeriod << ",\n";
+	file << "  \"gpuTimestamps\": " << (gpuEnabled() ? "true" : "false") << ",\n";
+	file << "  \"stages\": [";
+	bool first = true;
+	for (const auto &stage : stages) {
+		file << (first ? "\n" : ",\n");
+		file << "    { \"name\": \"" << escapeJson(stage.first) << "\", \"count\": " << stage.second.count
+			<< ", \"totalMs\": " << stage.second.total
+			<< ", \"meanMs\": " << stage.second.total / stage.second.count
+			<< ", \"minMs\": " << stage.second.min
+			<< ", \"maxMs\": " << stage.second.max << " }";
+		first = false;
+	}
+	file << "\n  ],\n";
+	file << "  \"events\": [";
+	first = true;
+	for (const auto &event : m_events) {
+		file << (first ? "\n" : ",\n");
+		file << "    { \"track\": \"" << trackName(event.track) << "\", \"name\": \"" << escapeJson(event.name)
+			<< "\", \"batch\": " << event.batch
+			<< ", \"startMs\": " << event.startMs
+			<< ", \"durationMs\": " << event.durationMs << " }";
+		first = false;
+	}
+	file << "\n  ]\n}\n";
+	return true;
+}
+
+bool Profiler::writeChromeTrace(const std::string &path) const {
+	std::ofstream file(path, std::ios::trunc);
+	if (!file.is_open()) {
+		TRACE_FULL("unable to write trace " + path);
+		return false;
+	}
+	file << "{\"traceEvents\":[\n";
+	const ProfileTrack tracks[] = { ProfileTrack::eHost, ProfileTrack::eCompute, ProfileTrack::eTransfer };
+	for (ProfileTrack track : tracks) {
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << static_cast<uint32_t>(track)
+			<< ",\"args\":{\"name\":\"" << trackName(track) << "\"}}"
+			<< (track != ProfileTrack::eTransfer || !m_events.empty() ? ",\n" : "\n");
+	}
+	file.precision(3);
+	file << std::fixed;
+	for (size_t i = 0; i < m_events.size(); i++) {
+		const ProfileEvent &event = m_events[i];
+		// trace timestamps are in microseconds
+		file << "{\"name\":\"" << escapeJson(event.name) << "\",\"cat\":\"" << trackName(event.track)
+			<< "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << static_cast<uint32_t>(event.track)
+			<< ",\"ts\":" << event.startMs * 1000.0
+			<< ",\"dur\":" << event.durationMs * 1000.0
+			<< ",\"args\":{\"batch\":" << event.batch << "}}"
+			<< (i + 1 < m_events.size() ? ",\n" : "\n");
+	}
+	file << "]}\n";
+	return true;
+}
\ No newline at end of file
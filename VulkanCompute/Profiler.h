@@ -0,0 +1,105 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// trace tracks, one row per track in the Chrome trace viewer
+enum class ProfileTrack : uint32_t {
+	eHost = 1,
+	eCompute = 2,
+	eTransfer = 3
+};
+
+struct ProfileEvent {
+	std::string name;
+	ProfileTrack track = ProfileTrack::eHost;
+	double startMs = 0.0;	// relative to the creation of the profiler
+	double durationMs = 0.0;
+	uint64_t batch = 0;
+};
+
+// Collects host timings and GPU timestamp queries.
+// GPU work is measured through scopes: a scope owns consecutive timestamp queries, begin() resets
+// them and writes the first one, every mark() closes the stage that ran since the previous timestamp.
+// Scopes are recorded once and read back after every submission that used them, so they work with
+// persistent command buffers.
+class Profiler {
+public:
+	Profiler(bool enabled = false) : m_enabled(enabled), m_origin(std::chrono::steady_clock::now()) {}
+
+	// creates the query pool. GPU timing stays off if the device has no timestamp support
+	vk::Result init(vk::PhysicalDevice physicalDevice, vk::Device device, uint32_t maxTimestamps);
+	void destroy();
+
+	bool enabled() const { return m_enabled && !m_paused; }
+	bool gpuEnabled() const { return m_enabled && m_queryPool; }
+	// no host events are recorded while paused. command buffers that were recorded with timestamps still write them
+	void pause(bool paused) { m_paused = paused; }
+
+	// returns a scope id, scopes on queue families without timestamp support or on transfer only families record nothing
+	uint32_t createScope(uint32_t queueFamilyIndex, uint32_t maxMarks, ProfileTrack track);
+	void begin(vk::CommandBuffer commandBuffer, uint32_t scope);
+	void mark(vk::CommandBuffer commandBuffer, uint32_t scope, const std::string &label,
+		vk::PipelineStageFlagBits stage = vk::PipelineStageFlagBits::eBottomOfPipe);
+	// reads the timestamps of a completed submission. GPU times are anchored at the host time of the submit
+	void collect(uint32_t scope, uint64_t batch, double submitMs);
+
+	// milliseconds since the profiler was created
+	double now() const;
+	void hostEvent(const std::string &name, double startMs, double endMs, uint64_t batch = 0);
+
+	const std::vector<ProfileEvent>& events() const { return m_events; }
+	void clear() { m_events.clear(); }
+
+	// per stage statistics plus all events
+	bool writeJson(const std::string &path) const;
+	// chrome://tracing / Perfetto compatible event list
+	bool writeChromeTrace(const std::string &path) const;
+
+private:
+	struct Scope {
+		uint32_t firstQuery = 0;
+		uint32_t queryCount = 0;	// 1 + maxMarks
+		uint32_t used = 0;			// queries written by the last recording
+		uint64_t validMask = 0;
+		ProfileTrack track = ProfileTrack::eCompute;
+		std::vector<std::string> labels;	// labels[i] names the stage ending at query i
+	};
+
+	bool m_enabled = false;
+	bool m_paused = false;
+	std::chrono::steady_clock::time_point m_origin;
+	vk::Device m_device;
+	vk::QueryPool m_queryPool;
+	uint32_t m_queryCount = 0;
+	uint32_t m_nextQuery = 0;
+	double m_timestampPeriod = 1.0;	// nanoseconds per tick
+	std::vector<uint32_t> m_timestampValidBits;	// per queue family
+	std::string m_deviceName;
+	std::vector<Scope> m_scopes;
+	std::vector<ProfileEvent> m_events;
+};
+
+// times the enclosing block on the host track
+class ProfileScope {
+public:
+	ProfileScope(Profiler &profiler, const char* name, uint64_t batch = 0)
+		: m_profiler(profiler), m_name(name), m_batch(batch), m_start(profiler.enabled() ? profiler.now() : 0.0) {}
+	~ProfileScope() {
+		if (m_profiler.enabled()) {
+			m_profiler.hostEvent(m_name, m_start, m_profiler.now(), m_batch);
+		}
+	}
+
+private:
+	Profiler &m_profiler;
+	const char* m_name;
+	uint64_t m_batch;
+	double m_start;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,279 @@
+#include "SharedDevice.h"
+#include "VulkanCompute.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+namespace {
+	std::mutex g_sharedMutex;
+	std::weak_ptr<SharedInstance> g_sharedInstance;
+	std::map<uint32_t, std::weak_ptr<SharedDevice>> g_sharedDevices;
+
+	const std::vector<const char*> ValidationLayers = {
+		"VK_LAYER_LUNARG_standard_validation"
+	};
+	const std::vector<std::string> RequiredDeviceExtensions;
+}
+
+#pragma region devicefeatures
+bool DeviceFeatures::supports(KernelCapability required) const {
+	const uint32_t bits = static_cast<uint32_t>(required);
+	auto needs = [bits](KernelCapability capability) { return (bits & static_cast<uint32_t>(capability)) != 0; };
+	auto hasSubgroup = [this](vk::SubgroupFeatureFlagBits operation) {
+		const vk::SubgroupFeatureFlags flags = vk::SubgroupFeatureFlagBits::eBasic | operation;
+		return (subgroupOperations & flags) == flags;
+	};
+	if (needs(KernelCapability::eFloat64) && !float64) return false;
+	if (needs(KernelCapability::eStorage16) && !storage16) return false;
+	if (needs(KernelCapability::eStorage8) && !storage8) return false;
+	if (needs(KernelCapability::eFloat16) && !float16) return false;
+	if (needs(KernelCapability::eInt8) && !int8) return false;
+	if (needs(KernelCapability::eSubgroupArithmetic) && !hasSubgroup(vk::SubgroupFeatureFlagBits::eArithmetic)) return false;
+	if (needs(KernelCapability::eSubgroupShuffle) && !hasSubgroup(vk::SubgroupFeatureFlagBits::eShuffle)) return false;
+	if (needs(KernelCapability::eSubgroupShuffleRelative) && !hasSubgroup(vk::SubgroupFeatureFlagBits::eShuffleRelative)) return false;
+	return true;
+}
+#pragma endregion devicefeatures
+
+#pragma region sharedinstance
+vk::Result SharedInstance::acquire(bool shared, std::shared_ptr<SharedInstance> &instance) {
+	std::unique_lock<std::mutex> lock(g_sharedMutex, std::defer_lock);
+	if (shared) {
+		lock.lock();
+		instance = g_sharedInstance.lock();
+		if (instance) return vk::Result::eSuccess;
+	}
+
+	// Use validation layers if this is a debug build
+	std::vector<const char*> layers;
+#if defined(_DEBUG)
+	if (!checkValidationLayerSupport(ValidationLayers)) {
+		TRACE_FULL("validation layers requested, but not present!");
+		return vk::Result::eErrorInitializationFailed;
+	}
+	layers = ValidationLayers;
+#endif
+	auto extensions = getRequiredExtensions();
+
+	// 1.1 gives vkGetPhysicalDeviceFeatures2 for the optional storage features. the entry point
+	// is looked up instead of linked, 1.0 loaders don't export it
+	std::shared_ptr<SharedInstance> created(new SharedInstance());
+	PFN_vkEnumerateInstanceVersion enumerateInstanceVersion =
+		reinterpret_cast<PFN_vkEnumerateInstanceVersion>(vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+	uint32_t loaderVersion = VK_API_VERSION_1_0;
+	if (enumerateInstanceVersion && enumerateInstanceVersion(&loaderVersion) == VK_SUCCESS && loaderVersion >= VK_API_VERSION_1_1) {
+		created->m_apiVersion = VK_API_VERSION_1_1;
+	}
+
+	// VkApplicationInfo allows the programmer to specifiy some basic information about the
+	// program, which can be useful for layers and tools to provide more debug information.
+	vk::ApplicationInfo appInfo = vk::ApplicationInfo()
+		.setPApplicationName("Vulkan C++ Program Template")
+		.setApplicationVersion(1)
+		.setPEngineName("LunarG SDK")
+		.setEngineVersion(1)
+		.setApiVersion(created->m_apiVersion);
+
+	// VkInstanceCreateInfo is where the programmer specifies the layers and/or extensions that
+	// are needed. For now, none are enabled.
+	vk::InstanceCreateInfo instInfo = vk::InstanceCreateInfo()
+		.setFlags(vk::InstanceCreateFlags())
+		.setPApplicationInfo(&appInfo)
+		.setEnabledExtensionCount(static_cast<uint32_t>(extensions.size()))
+		.setPpEnabledExtensionNames(extensions.data())
+		.setEnabledLayerCount(static_cast<uint32_t>(layers.size()))
+		.setPpEnabledLayerNames(layers.data());
+
+	// Create the Vulkan instance.
+	try {
+		created->m_instance = vk::createInstance(instInfo);
+	}
+	catch (const std::exception& e) {
+		TRACE_FULL(e.what());
+		return vk::Result::eErrorInitializationFailed;
+	}
+	if (shared) g_sharedInstance = created;
+	instance = created;
+	return vk::Result::eSuccess;
+}
+#pragma endregion sharedinstance
+
+#pragma region shareddevice
+vk::Result SharedDevice::acquire(uint32_t deviceIndex, bool shared, std::shared_ptr<SharedDevice> &device) {
+	std::shared_ptr<SharedDevice> created(new SharedDevice());
+	vk::Result res = SharedInstance::acquire(shared, created->m_instance);
+	if (res != vk::Result::eSuccess) return res;
+	if (!shared) {
+		res = created->create(deviceIndex);
+		if (res == vk::Result::eSuccess) device = created;
+		return res;
+	}
+
+	// creation happens under the lock, so concurrent callers end up with the same device
+	std::lock_guard<std::mutex> lock(g_sharedMutex);
+	device = g_sharedDevices[deviceIndex].lock();
+	if (device) return vk::Result::eSuccess;
+	res = created->create(deviceIndex);
+	if (res != vk::Result::eSuccess) return res;
+	g_sharedDevices[deviceIndex] = created;
+	device = created;
+	return vk::Result::eSuccess;
+}
+
+SharedDevice::~SharedDevice() {
+	if (m_device) {
+		m_device.waitIdle();
+		m_device.destroy();
+	}
+}
+
+vk::Result SharedDevice::create(uint32_t deviceIndex) {
+	std::vector<vk::PhysicalDevice> devices = instance().enumeratePhysicalDevices();
+	std::vector<vk::PhysicalDevice> suitable;
+	for (const auto& device : devices) {
+		if (isDeviceSuitable(device, RequiredDeviceExtensions)) {
+			suitable.push_back(device);
+		}
+	}
+	m_suitableDeviceCount = static_cast<uint32_t>(suitable.size());
+	if (suitable.empty()) {
+		TRACE_FULL("unable to find suitable device");
+		return vk::Result::eErrorInitializationFailed;
+	}
+	if (deviceIndex >= m_suitableDeviceCount) {
+		TRACE_FULL("device index out of range");
+		return vk::Result::eErrorInitializationFailed;
+	}
+	m_physicalDevice = suitable[deviceIndex];
+	m_apiVersion = std::min(m_instance->apiVersion(), m_physicalDevice.getProperties().apiVersion);
+	std::vector<const char*> extensions;
+	queryFeatures(extensions);
+
+	// every queue of every compute family, the scheduler spreads independent jobs over them.
+	// the transfer queue is created whenever there is one, applications in device local mode use it
+	const std::vector<vk::QueueFamilyProperties> familyProps = m_physicalDevice.getQueueFamilyProperties();
+	const std::vector<uint32_t> computeFamilies = findComputeQueueFamilies(m_physicalDevice);
+	auto transferFam = findTransferQueueFamilyIndex(m_physicalDevice);
+	uint32_t maxQueueCount = 1;
+	for (uint32_t family : computeFamilies) {
+		maxQueueCount = std::max(maxQueueCount, familyProps[family].queueCount);
+	}
+	const float defaultQueuePriority = 1.0f;
+	const std::vector<float> queuePriorities(maxQueueCount, defaultQueuePriority);
+	std::vector<vk::DeviceQueueCreateInfo> deviceQueueCreateInfos;
+	for (uint32_t family : computeFamilies) {
+		deviceQueueCreateInfos.push_back(vk::DeviceQueueCreateInfo()
+			.setQueueFamilyIndex(family)
+			.setQueueCount(familyProps[family].queueCount)
+			.setPQueuePriorities(queuePriorities.data()));
+	}
+	if (transferFam.result == vk::Result::eSuccess) {
+		deviceQueueCreateInfos.push_back(vk::DeviceQueueCreateInfo()
+			.setQueueFamilyIndex(transferFam.value)
+			.setQueueCount(1)
+			.setPQueuePriorities(&defaultQueuePriority));
+	}
+
+	vk::DeviceCreateInfo deviceCreateInfo = vk::DeviceCreateInfo()
+		.setQueueCreateInfoCount(static_cast<uint32_t>(deviceQueueCreateInfos.size()))
+		.setPQueueCreateInfos(deviceQueueCreateInfos.data())
+		.setEnabledExtensionCount(static_cast<uint32_t>(extensions.size()))
+		.setPpEnabledExtensionNames(extensions.data());
+	if (m_apiVersion >= VK_API_VERSION_1_1) {
+		deviceCreateInfo.setPNext(&m_enabledFeatures);
+	}
+	else {
+		deviceCreateInfo.setPEnabledFeatures(&m_enabledFeatures.features);
+	}
+
+	m_device = m_physicalDevice.createDevice(deviceCreateInfo);
+	if (!m_device) {
+		TRACE_FULL("unable to create logical device");
+		return vk::Result::eErrorInitializationFailed;
+	}
+	if (m_features.maxPushDescriptors > 0) {
+		m_cmdPushDescriptorSet = reinterpret_cast<PFN_vkCmdPushDescriptorSetKHR>(m_device.getProcAddr("vkCmdPushDescriptorSetKHR"));
+		if (!m_cmdPushDescriptorSet) m_features.maxPushDescriptors = 0;
+	}
+	for (uint32_t family : computeFamilies) {
+		for (uint32_t i = 0; i < familyProps[family].queueCount; i++) {
+			ComputeQueue queue;
+			queue.family = family;
+			queue.index = i;
+			queue.queue = m_device.getQueue(family, i);
+			queue.async = !(familyProps[family].queueFlags & vk::QueueFlagBits::eGraphics);
+			if (!queue.queue) {
+				TRACE_FULL("unable to create device queue");
+				return vk::Result::eErrorInitializationFailed;
+			}
+			m_computeQueues.push_back(queue);
+		}
+	}
+	if (transferFam.result == vk::Result::eSuccess) {
+		m_transferQueue.family = transferFam.value;
+		m_transferQueue.queue = m_device.getQueue(transferFam.value, 0);
+		if (!m_transferQueue.queue) {
+			TRACE_FULL("unable to create transfer queue");
+			return vk::Result::eErrorInitializationFailed;
+		}
+	}
+	return vk::Result::eSuccess;
+}
+void SharedDevice::queryFeatures(std::vector<const char*> &extensions) {
+	vk::PhysicalDeviceFeatures supported = m_physicalDevice.getFeatures();
+	m_features.float64 = supported.shaderFloat64 == VK_TRUE;
+	m_enabledFeatures.features.shaderFloat64 = supported.shaderFloat64;
+	if (m_apiVersion < VK_API_VERSION_1_1) return;
+
+	// 16 bit storage is core in 1.1, 8 bit storage and 16 / 8 bit arithmetic need their extensions
+	bool has8BitExtension = checkDeviceExtensionSupport(m_physicalDevice, { VK_KHR_8BIT_STORAGE_EXTENSION_NAME });
+	bool hasFloat16Int8Extension = checkDeviceExtensionSupport(m_physicalDevice, { VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME });
+	vk::PhysicalDeviceFeatures2 features2;
+	vk::PhysicalDevice16BitStorageFeatures storage16;
+	vk::PhysicalDevice8BitStorageFeaturesKHR storage8;
+	vk::PhysicalDeviceShaderFloat16Int8FeaturesKHR float16Int8;
+	features2.setPNext(&storage16);
+	if (has8BitExtension) storage16.setPNext(&storage8);
+	if (hasFloat16Int8Extension) {
+		float16Int8.setPNext(features2.pNext);
+		features2.setPNext(&float16Int8);
+	}
+	m_physicalDevice.getFeatures2(&features2);
+
+	bool hasPushDescriptorExtension = checkDeviceExtensionSupport(m_physicalDevice, { VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME });
+	vk::PhysicalDeviceProperties2 properties2;
+	vk::PhysicalDeviceSubgroupProperties subgroup;
+	vk::PhysicalDevicePushDescriptorPropertiesKHR pushDescriptor;
+	properties2.setPNext(&subgroup);
+	if (hasPushDescriptorExtension) subgroup.setPNext(&pushDescriptor);
+	m_physicalDevice.getProperties2(&properties2);
+	m_features.subgroupSize = subgroup.subgroupSize;
+	if (hasPushDescriptorExtension) {
+		m_features.maxPushDescriptors = pushDescriptor.maxPushDescriptors;
+		extensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+	}
+	if (subgroup.supportedStages & vk::ShaderStageFlagBits::eCompute) {
+		m_features.subgroupOperations = subgroup.supportedOperations;
+	}
+
+	m_features.storage16 = storage16.storageBuffer16BitAccess == VK_TRUE;
+	m_features.storage8 = has8BitExtension && storage8.storageBuffer8BitAccess == VK_TRUE;
+	m_enabledStorage16.storageBuffer16BitAccess = storage16.storageBuffer16BitAccess;
+	m_enabledFeatures.setPNext(&m_enabledStorage16);
+	if (m_features.storage8) {
+		m_enabledStorage8.storageBuffer8BitAccess = VK_TRUE;
+		m_enabledStorage16.setPNext(&m_enabledStorage8);
+		extensions.push_back(VK_KHR_8BIT_STORAGE_EXTENSION_NAME);
+	}
+	m_features.float16 = hasFloat16Int8Extension && float16Int8.shaderFloat16 == VK_TRUE;
+	m_features.int8 = hasFloat16Int8Extension && float16Int8.shaderInt8 == VK_TRUE;
+	if (m_features.float16 || m_features.int8) {
+		m_enabledFloat16Int8.shaderFloat16 = float16Int8.shaderFloat16;
+		m_enabledFloat16Int8.shaderInt8 = float16Int8.shaderInt8;
+		m_enabledFloat16Int8.setPNext(m_enabledStorage16.pNext);
+		m_enabledStorage16.setPNext(&m_enabledFloat16Int8);
+		extensions.push_back(VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME);
+	}
+}
+#pragma endregion shareddevice
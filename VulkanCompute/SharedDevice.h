@@ -0,0 +1,122 @@
+#ifndef SHARED_DEVICE_H
+#define SHARED_DEVICE_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <memory>
+#include <string>
+
+#include "JobScheduler.h"
+
+// The process wide Vulkan instance, created on first use and destroyed with the last SharedDevice.
+class SharedInstance {
+public:
+	// shared false creates an instance of its own
+	static vk::Result acquire(bool shared, std::shared_ptr<SharedInstance> &instance);
+	SharedInstance(const SharedInstance&) = delete;
+	SharedInstance& operator=(const SharedInstance&) = delete;
+	~SharedInstance() { m_instance.destroy(); }
+
+	vk::Instance instance() const { return m_instance; }
+	// Vulkan 1.1 where the loader supports it, 1.0 otherwise
+	uint32_t apiVersion() const { return m_apiVersion; }
+
+private:
+	SharedInstance() {}
+	vk::Instance m_instance;
+	uint32_t m_apiVersion = VK_API_VERSION_1_0;
+};
+
+// capabilities a shader build uses beyond Vulkan 1.0 compute, combined with |
+enum class KernelCapability : uint32_t {
+	eNone = 0,
+	eFloat64 = 1 << 0,
+	eStorage16 = 1 << 1,
+	eStorage8 = 1 << 2,
+	eFloat16 = 1 << 3,		// float16_t arithmetic
+	eInt8 = 1 << 4,		// int8_t / uint8_t arithmetic
+	eSubgroupArithmetic = 1 << 5,	// subgroupAdd, subgroupInclusiveAdd, ...
+	eSubgroupShuffle = 1 << 6,		// subgroupShuffle, subgroupShuffleXor
+	eSubgroupShuffleRelative = 1 << 7	// subgroupShuffleUp, subgroupShuffleDown
+};
+
+inline KernelCapability operator|(KernelCapability a, KernelCapability b) {
+	return static_cast<KernelCapability>(static_cast<uint32_t>(a) | static_cast<uint32_t>(b));
+}
+
+// optional device features, each is enabled when the device supports it
+struct DeviceFeatures {
+	bool float64 = false;		// shaderFloat64, f64 kernels
+	bool storage16 = false;		// storageBuffer16BitAccess (VK_KHR_16bit_storage), f16 buffers
+	bool storage8 = false;		// storageBuffer8BitAccess (VK_KHR_8bit_storage), u8 buffers
+	bool float16 = false;		// shaderFloat16 (VK_KHR_shader_float16_int8)
+	bool int8 = false;		// shaderInt8 (VK_KHR_shader_float16_int8)
+	uint32_t maxPushDescriptors = 0;	// VK_KHR_push_descriptor, 0 without it
+	uint32_t subgroupSize = 0;		// 0 before Vulkan 1.1
+	// subgroup operations of compute shaders, empty if the compute stage has none
+	vk::SubgroupFeatureFlags subgroupOperations;
+
+	// true if every capability in required is enabled
+	bool supports(KernelCapability required) const;
+};
+
+// One SPIR-V build of a kernel. Kernels list their builds best first and end with the one that needs the least,
+// ComputeContext::loadVariant() takes the first one the device supports and fails if there is none.
+struct KernelVariant {
+	std::string suffix;		// appended to the kernel name and the SPIR-V file name
+	KernelCapability required = KernelCapability::eNone;
+	bool fullSubgroups = false;		// the workgroup size has to be a multiple of the subgroup size
+
+	KernelVariant(const std::string &suffix, KernelCapability required = KernelCapability::eNone, bool fullSubgroups = false)
+		: suffix(suffix), required(required), fullSubgroups(fullSubgroups) {}
+};
+
+// Logical device of one physical device with all of its compute queues and the dedicated transfer queue,
+// shared by every application in the process that runs on the same device. Startup only pays for
+// instance and device creation once; submissions to a shared queue hold its mutex.
+class SharedDevice {
+public:
+	// deviceIndex counts the suitable physical devices in enumeration order.
+	// shared false creates an instance and device of its own
+	static vk::Result acquire(uint32_t deviceIndex, bool shared, std::shared_ptr<SharedDevice> &device);
+	SharedDevice(const SharedDevice&) = delete;
+	SharedDevice& operator=(const SharedDevice&) = delete;
+	~SharedDevice();
+
+	vk::Instance instance() const { return m_instance->instance(); }
+	vk::PhysicalDevice physicalDevice() const { return m_physicalDevice; }
+	vk::Device device() const { return m_device; }
+	uint32_t suitableDeviceCount() const { return m_suitableDeviceCount; }
+	// lower of instance and device version
+	uint32_t apiVersion() const { return m_apiVersion; }
+	const DeviceFeatures& features() const { return m_features; }
+	// vkCmdPushDescriptorSetKHR, nullptr unless features().maxPushDescriptors > 0
+	PFN_vkCmdPushDescriptorSetKHR cmdPushDescriptorSet() const { return m_cmdPushDescriptorSet; }
+	// all queues of all compute capable families, the first one belongs to findQueueFamilyIndex()
+	const std::vector<ComputeQueue>& computeQueues() const { return m_computeQueues; }
+	// queue of a transfer only family, only valid if hasTransferQueue()
+	const ComputeQueue& transferQueue() const { return m_transferQueue; }
+	bool hasTransferQueue() const { return static_cast<bool>(m_transferQueue.queue); }
+
+private:
+	SharedDevice() {}
+	vk::Result create(uint32_t deviceIndex);
+	// fills m_features and the structures that enable them
+	void queryFeatures(std::vector<const char*> &extensions);
+
+	std::shared_ptr<SharedInstance> m_instance;
+	vk::PhysicalDevice m_physicalDevice;
+	vk::Device m_device;
+	uint32_t m_suitableDeviceCount = 0;
+	uint32_t m_apiVersion = VK_API_VERSION_1_0;
+	DeviceFeatures m_features;
+	PFN_vkCmdPushDescriptorSetKHR m_cmdPushDescriptorSet = nullptr;
+	vk::PhysicalDeviceFeatures2 m_enabledFeatures;
+	vk::PhysicalDevice16BitStorageFeatures m_enabledStorage16;
+	vk::PhysicalDevice8BitStorageFeaturesKHR m_enabledStorage8;
+	vk::PhysicalDeviceShaderFloat16Int8FeaturesKHR m_enabledFloat16Int8;
+	std::vector<ComputeQueue> m_computeQueues;
+	ComputeQueue m_transferQueue;
+};
+
+#endif
@@ -0,0 +1,406 @@
+#include "TaskGraph.h"
+#include "Helpers.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+namespace {
+	struct StageAccess {
+		vk::PipelineStageFlags stage;
+		vk::AccessFlags read;
+		vk::AccessFlags write;
+	};
+
+	const StageAccess DispatchAccess = {
+		vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead, vk::AccessFlagBits::eShaderWrite
+	};
+	const StageAccess CopyAccess = {
+		vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead, vk::AccessFlagBits::eTransferWrite
+	};
+
+	bool reads(GraphAccess access) {
+		return access != GraphAccess::eWrite;
+	}
+
+	bool writes(GraphAccess access) {
+		return access != GraphAccess::eRead;
+	}
+}
+
+GraphBuffer TaskGraph::importBuffer(vkExt::Buffer &buffer) {
+	Resource resource;
+	resource.imported = &buffer;
+	resource.size = buffer.descriptor.range;
+	m_resources.push_back(resource);
+	return static_cast<GraphBuffer>(m_resources.size() - 1);
+}
+
+GraphBuffer TaskGraph::createTransient(vk::DeviceSize size) {
+	Resource resource;
+	resource.size = size;
+	m_resources.push_back(resource);
+	GraphBuffer handle = static_cast<GraphBuffer>(m_resources.size() - 1);
+	m_transients.push_back(handle);
+	return handle;
+}
+
+void TaskGraph::addDispatch(ComputeKernel* kernel, const std::vector<GraphBinding> &bindings, const void* pushConstants, uint32_t pushConstantSize,
+	uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+	Node node;
+	node.type = NodeType::eDispatch;
+	node.kernel = kernel;
+	node.bindings = bindings;
+	if (pushConstants && pushConstantSize) {
+		const uint8_t* bytes = static_cast<const uint8_t*>(pushConstants);
+		node.pushConstants.assign(bytes, bytes + pushConstantSize);
+	}
+	node.groupCount[0] = groupCountX;
+	node.groupCount[1] = groupCountY;
+	node.groupCount[2] = groupCountZ;
+	m_nodes.push_back(node);
+}
+
+void TaskGraph::addCopy(GraphBuffer src, GraphBuffer dst, vk::DeviceSize size, vk::DeviceSize srcOffset, vk::DeviceSize dstOffset) {
+	Node node;
+	node.type = NodeType::eCopy;
+	node.bindings.push_back(GraphBinding(0, src, GraphAccess::eRead, srcOffset, size));
+	node.bindings.push_back(GraphBinding(1, dst, GraphAccess::eWrite, dstOffset, size));
+	node.copy = vk::BufferCopy(srcOffset, dstOffset, size);
+	m_nodes.push_back(node);
+}
+
+void TaskGraph::accesses(const Node &node, std::vector<std::pair<GraphBuffer, GraphAccess>> &out) const {
+	out.clear();
+	for (const auto &binding : node.bindings) {
+		out.push_back(std::make_pair(binding.buffer, binding.access));
+	}
+}
+
+vk::Buffer TaskGraph::bufferOf(GraphBuffer buffer) {
+	const Resource &resource = m_resources[buffer];
+	return resource.imported ? resource.imported->buffer : m_physical[resource.physical].buffer;
+}
+
+vk::Result TaskGraph::compile(vk::Device device, vkExt::MemoryAllocator &allocator, const std::vector<uint32_t> &queueFamilies,
+	std::mutex* allocatorMutex) {
+	release();
+	m_device = device;
+	m_allocator = &allocator;
+	m_allocatorMutex = allocatorMutex;
+
+	// every node runs one level after the last node it depends on. nodes on the same level
+	// have no hazards between them and share the barrier in front of the level
+	std::vector<int64_t> lastWrite(m_resources.size(), -1);
+	std::vector<int64_t> lastRead(m_resources.size(), -1);
+	std::vector<std::pair<GraphBuffer, GraphAccess>> used;
+	for (auto &node : m_nodes) {
+		if (node.type == NodeType::eDispatch) {
+			if (!node.kernel || node.kernel->reflection().setCount() > 1) {
+				TRACE_FULL("task graph dispatches need a kernel with a single descriptor set");
+				return vk::Result::eErrorInitializationFailed;
+			}
+		}
+		accesses(node, used);
+		int64_t level = 0;
+		for (const auto &access : used) {
+			if (access.first >= m_resources.size()) {
+				TRACE_FULL("task graph node references an unknown buffer");
+				return vk::Result::eErrorInitializationFailed;
+			}
+			if (reads(access.second)) level = std::max(level, lastWrite[access.first] + 1);
+			if (writes(access.second)) level = std::max(level, std::max(lastWrite[access.first], lastRead[access.first]) + 1);
+		}
+		node.level = static_cast<uint32_t>(level);
+		for (const auto &access : used) {
+			Resource &resource = m_resources[access.first];
+			resource.firstLevel = std::min(resource.firstLevel, node.level);
+			resource.lastLevel = std::max(resource.lastLevel, node.level);
+			if (writes(access.second)) {
+				lastWrite[access.first] = level;
+				lastRead[access.first] = -1;
+			}
+			if (reads(access.second)) {
+				lastRead[access.first] = std::max(lastRead[access.first], level);
+			}
+		}
+	}
+
+	m_order.resize(m_nodes.size());
+	for (uint32_t i = 0; i < m_order.size(); i++) m_order[i] = i;
+	std::stable_sort(m_order.begin(), m_order.end(), [&](uint32_t a, uint32_t b) {
+		return m_nodes[a].level < m_nodes[b].level;
+	});
+
+	// transients whose level ranges don't overlap share a physical buffer.
+	// slots are handed out greedily by first use, preferring the smallest free one that fits
+	std::vector<GraphBuffer> transients = m_transients;
+	std::stable_sort(transients.begin(), transients.end(), [&](GraphBuffer a, GraphBuffer b) {
+		return m_resources[a].firstLevel < m_resources[b].firstLevel;
+	});
+	std::vector<vk::DeviceSize> slotSize;
+	std::vector<uint32_t> slotLastLevel;
+	for (GraphBuffer handle : transients) {
+		Resource &resource = m_resources[handle];
+		if (resource.firstLevel == UINT32_MAX) continue;	// never used
+		int32_t best = -1;
+		for (int32_t slot = 0; slot < static_cast<int32_t>(slotSize.size()); slot++) {
+			if (slotLastLevel[slot] >= resource.firstLevel) continue;
+			if (best < 0) {
+				best = slot;
+				continue;
+			}
+			bool fits = slotSize[slot] >= resource.size;
+			bool bestFits = slotSize[best] >= resource.size;
+			if ((fits && !bestFits) || (fits == bestFits && (fits ? slotSize[slot] < slotSize[best] : slotSize[slot] > slotSize[best]))) {
+				best = slot;
+			}
+		}
+		if (best < 0) {
+			best = static_cast<int32_t>(slotSize.size());
+			slotSize.push_back(0);
+			slotLastLevel.push_back(0);
+		}
+		slotSize[best] = std::max(slotSize[best], resource.size);
+		slotLastLevel[best] = resource.lastLevel;
+		resource.physical = best;
+	}
+
+	m_physical.resize(slotSize.size());
+	{
+		std::unique_lock<std::mutex> lock;
+		if (m_allocatorMutex) lock = std::unique_lock<std::mutex>(*m_allocatorMutex);
+		for (size_t i = 0; i < m_physical.size(); i++) {
+			vk::Result res = allocator.createBuffer(m_physical[i], slotSize[i],
+				vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+				vk::MemoryPropertyFlagBits::eDeviceLocal, queueFamilies);
+			if (res != vk::Result::eSuccess) {
+				TRACE_FULL("unable to allocate transient buffer");
+				return res;
+			}
+		}
+	}
+
+	// one descriptor set per dispatch whose kernel has bindings and does not push its descriptors
+	std::map<vk::DescriptorType, uint32_t> typeCounts;
+	uint32_t setCount = 0;
+	for (const auto &node : m_nodes) {
+		if (node.type != NodeType::eDispatch || node.kernel->usesPushDescriptors() || node.kernel->setLayouts().empty()) continue;
+		for (const auto &binding : node.kernel->reflection().bindings) {
+			typeCounts[binding.type] += binding.count;
+		}
+		setCount++;
+	}
+	vk::Result res = vk::Result::eSuccess;
+	if (setCount > 0) {
+		std::vector<vk::DescriptorPoolSize> poolSizes;
+		for (const auto &count : typeCounts) {
+			poolSizes.push_back(vk::DescriptorPoolSize(count.first, count.second));
+		}
+		vk::DescriptorPoolCreateInfo descriptorPoolCI = vk::DescriptorPoolCreateInfo()
+			.setPoolSizeCount(static_cast<uint32_t>(poolSizes.size()))
+			.setPPoolSizes(poolSizes.data())
+			.setMaxSets(setCount);
+		res = m_device.createDescriptorPool(&descriptorPoolCI, nullptr, &m_descriptorPool);
+		if (res != vk::Result::eSuccess) {
+			TRACE_FULL("unable to create task graph descriptor pool");
+			return res;
+		}
+	}
+
+	for (auto &node : m_nodes) {
+		if (node.type != NodeType::eDispatch) continue;
+		const bool push = node.kernel->usesPushDescriptors();
+		const bool pooled = !push && !node.kernel->setLayouts().empty();
+		if (pooled) {
+			vk::DescriptorSetLayout setLayout = node.kernel->setLayout(0);
+			vk::DescriptorSetAllocateInfo descriptorSetAllocInfo = vk::DescriptorSetAllocateInfo()
+				.setDescriptorPool(m_descriptorPool)
+				.setDescriptorSetCount(1)
+				.setPSetLayouts(&setLayout);
+			res = m_device.allocateDescriptorSets(&descriptorSetAllocInfo, &node.descriptorSet);
+			if (res != vk::Result::eSuccess) {
+				TRACE_FULL("unable to allocate task graph descriptor set");
+				return res;
+			}
+		}
+
+		const auto &kernelBindings = node.kernel->reflection().bindings;
+		std::vector<vk::DescriptorBufferInfo> &bufferInfos = node.bufferInfos;
+		std::vector<vk::WriteDescriptorSet> &writes = node.writes;
+		bufferInfos.assign(node.bindings.size(), vk::DescriptorBufferInfo());
+		writes.clear();
+		for (size_t i = 0; i < node.bindings.size(); i++) {
+			const GraphBinding &binding = node.bindings[i];
+			auto kernelBinding = std::find_if(kernelBindings.begin(), kernelBindings.end(), [&](const KernelBinding &b) {
+				return b.binding == binding.binding;
+			});
+			if (kernelBinding == kernelBindings.end()) {
+				TRACE_FULL("kernel has no binding " + std::to_string(binding.binding));
+				return vk::Result::eErrorInitializationFailed;
+			}
+			bufferInfos[i] = vk::DescriptorBufferInfo(bufferOf(binding.buffer), binding.offset, binding.range);
+			writes.push_back(vk::WriteDescriptorSet(node.descriptorSet, binding.binding, 0, 1, kernelBinding->type, nullptr, &bufferInfos[i], nullptr));
+		}
+		if (pooled && !writes.empty()) {
+			m_device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		}
+	}
+	return vk::Result::eSuccess;
+}
+
+void TaskGraph::record(vk::CommandBuffer commandBuffer, Profiler* profiler, uint32_t profileScope) {
+	m_barrierCount = 0;
+	if (profiler) profiler->begin(commandBuffer, profileScope);
+	std::map<VkBuffer, BufferState> states;
+	std::vector<std::pair<GraphBuffer, GraphAccess>> used;
+
+	size_t first = 0;
+	while (first < m_order.size()) {
+		size_t last = first;
+		while (last < m_order.size() && m_nodes[m_order[last]].level == m_nodes[m_order[first]].level) last++;
+
+		// collect the hazards of this level against everything recorded before it
+		vk::PipelineStageFlags srcStages;
+		vk::PipelineStageFlags dstStages;
+		std::map<VkBuffer, vk::BufferMemoryBarrier> barriers;
+		for (size_t i = first; i < last; i++) {
+			const Node &node = m_nodes[m_order[i]];
+			const StageAccess &sa = node.type == NodeType::eDispatch ? DispatchAccess : CopyAccess;
+			accesses(node, used);
+			for (const auto &access : used) {
+				VkBuffer buffer = static_cast<VkBuffer>(bufferOf(access.first));
+				BufferState &state = states[buffer];
+				vk::PipelineStageFlags src;
+				vk::AccessFlags srcAccess;
+				vk::AccessFlags dstAccess;
+				if (reads(access.second) && state.hasWrite && !(state.visibleStages & sa.stage)) {
+					// read after write
+					src |= state.writeStage;
+					srcAccess |= state.writeAccess;
+					dstAccess |= sa.read;
+				}
+				if (writes(access.second)) {
+					if (state.hasWrite) {
+						// write after write, also covers aliased transients taking over a buffer
+						src |= state.writeStage;
+						srcAccess |= state.writeAccess;
+						dstAccess |= sa.write;
+					}
+					// write after read only needs an execution dependency
+					src |= state.readStages;
+				}
+				if (!src) continue;
+				srcStages |= src;
+				dstStages |= sa.stage;
+				auto it = barriers.find(buffer);
+				if (it == barriers.end()) {
+					barriers[buffer] = vk::BufferMemoryBarrier(srcAccess, dstAccess, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, vk::Buffer(buffer), 0, VK_WHOLE_SIZE);
+				} else {
+					it->second.srcAccessMask |= srcAccess;
+					it->second.dstAccessMask |= dstAccess;
+				}
+			}
+		}
+		if (!barriers.empty()) {
+			std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+			for (const auto &barrier : barriers) bufferBarriers.push_back(barrier.second);
+			commandBuffer.pipelineBarrier(srcStages, dstStages, vk::DependencyFlags(),
+				0, nullptr, static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), 0, nullptr);
+			m_barrierCount++;
+			for (const auto &barrier : barriers) {
+				BufferState &state = states[barrier.first];
+				if (barrier.second.srcAccessMask) state.visibleStages |= dstStages;
+			}
+		}
+
+		for (size_t i = first; i < last; i++) {
+			const Node &node = m_nodes[m_order[i]];
+			if (node.type == NodeType::eDispatch) {
+				commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, node.kernel->pipeline());
+				if (node.descriptorSet) {
+					commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, node.kernel->pipelineLayout(), 0, 1, &node.descriptorSet, 0, nullptr);
+				}
+				else if (!node.writes.empty()) {
+					node.kernel->pushDescriptors(commandBuffer, node.writes);
+				}
+				if (!node.pushConstants.empty()) {
+					commandBuffer.pushConstants(node.kernel->pipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0,
+						static_cast<uint32_t>(node.pushConstants.size()), node.pushConstants.data());
+				}
+				commandBuffer.dispatch(node.groupCount[0], node.groupCount[1], node.groupCount[2]);
+			} else {
+				commandBuffer.copyBuffer(bufferOf(node.bindings[0].buffer), bufferOf(node.bindings[1].buffer), 1, &node.copy);
+			}
+		}
+		if (profiler) profiler->mark(commandBuffer, profileScope, "graph level " + std::to_string(m_nodes[m_order[first]].level));
+
+		// the level's own accesses become the state the next level is checked against
+		for (size_t i = first; i < last; i++) {
+			const Node &node = m_nodes[m_order[i]];
+			const StageAccess &sa = node.type == NodeType::eDispatch ? DispatchAccess : CopyAccess;
+			accesses(node, used);
+			for (const auto &access : used) {
+				BufferState &state = states[static_cast<VkBuffer>(bufferOf(access.first))];
+				if (writes(access.second)) {
+					state.hasWrite = true;
+					state.writeStage = sa.stage;
+					state.writeAccess = sa.write;
+					state.visibleStages = vk::PipelineStageFlags();
+					state.readStages = vk::PipelineStageFlags();
+				}
+			}
+			for (const auto &access : used) {
+				BufferState &state = states[static_cast<VkBuffer>(bufferOf(access.first))];
+				if (reads(access.second)) state.readStages |= sa.stage;
+			}
+		}
+		first = last;
+	}
+
+	// results in imported buffers are made visible to the host and to whatever runs after the graph
+	vk::PipelineStageFlags srcStages;
+	vk::AccessFlags srcAccess;
+	for (const auto &resource : m_resources) {
+		if (!resource.imported) continue;
+		auto it = states.find(static_cast<VkBuffer>(resource.imported->buffer));
+		if (it == states.end() || !it->second.hasWrite) continue;
+		srcStages |= it->second.writeStage;
+		srcAccess |= it->second.writeAccess;
+	}
+	if (srcStages) {
+		vk::MemoryBarrier memoryBarrier = vk::MemoryBarrier()
+			.setSrcAccessMask(srcAccess)
+			.setDstAccessMask(vk::AccessFlagBits::eHostRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead);
+		commandBuffer.pipelineBarrier(srcStages,
+			vk::PipelineStageFlagBits::eHost | vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
+			vk::DependencyFlags(), 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		m_barrierCount++;
+	}
+}
+
+void TaskGraph::release() {
+	if (m_descriptorPool) {
+		m_device.destroyDescriptorPool(m_descriptorPool);
+		m_descriptorPool = nullptr;
+	}
+	for (auto &node : m_nodes) {
+		node.descriptorSet = nullptr;
+		node.writes.clear();
+		node.bufferInfos.clear();
+	}
+	if (m_allocator && !m_physical.empty()) {
+		std::unique_lock<std::mutex> lock;
+		if (m_allocatorMutex) lock = std::unique_lock<std::mutex>(*m_allocatorMutex);
+		for (auto &buffer : m_physical) {
+			m_allocator->destroyBuffer(buffer);
+		}
+	}
+	m_physical.clear();
+	for (auto &resource : m_resources) {
+		resource.physical = -1;
+		resource.firstLevel = UINT32_MAX;
+		resource.lastLevel = 0;
+	}
+	m_order.clear();
+}
\ No newline at end of file
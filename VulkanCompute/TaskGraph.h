@@ -0,0 +1,120 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <mutex>
+#include <vector>
+
+#include "BufferExtension.h"
+#include "ComputeKernel.h"
+#include "Profiler.h"
+
+// index into the resource table of a TaskGraph
+typedef uint32_t GraphBuffer;
+
+enum class GraphAccess {
+	eRead,
+	eWrite,
+	eReadWrite
+};
+
+struct GraphBinding {
+	uint32_t binding;
+	GraphBuffer buffer;
+	GraphAccess access;
+	vk::DeviceSize offset = 0;
+	vk::DeviceSize range = VK_WHOLE_SIZE;
+
+	GraphBinding(uint32_t binding, GraphBuffer buffer, GraphAccess access, vk::DeviceSize offset = 0, vk::DeviceSize range = VK_WHOLE_SIZE)
+		: binding(binding), buffer(buffer), access(access), offset(offset), range(range) {}
+};
+
+// Records a chain of kernel dispatches and buffer copies into a single command buffer.
+// Dependencies follow from the buffers the nodes touch (read after write, write after read/write),
+// independent nodes are recorded between the same pair of barriers, and transient buffers
+// whose lifetimes don't overlap share one physical buffer.
+class TaskGraph {
+public:
+	TaskGraph() {}
+	TaskGraph(const TaskGraph&) = delete;
+	TaskGraph& operator=(const TaskGraph&) = delete;
+	// releases the transients, so the graph has to go before the allocator it was compiled with
+	~TaskGraph() { release(); }
+
+	// buffer owned by the caller, its contents are visible to the host and later submissions after the graph ran
+	GraphBuffer importBuffer(vkExt::Buffer &buffer);
+	// intermediate buffer allocated by compile(), its contents are undefined outside of the graph
+	GraphBuffer createTransient(vk::DeviceSize size);
+
+	// bindings refer to set 0 of the kernel, pushConstants is copied
+	void addDispatch(ComputeKernel* kernel, const std::vector<GraphBinding> &bindings, const void* pushConstants, uint32_t pushConstantSize,
+		uint32_t groupCountX, uint32_t groupCountY = 1, uint32_t groupCountZ = 1);
+	void addCopy(GraphBuffer src, GraphBuffer dst, vk::DeviceSize size, vk::DeviceSize srcOffset = 0, vk::DeviceSize dstOffset = 0);
+
+	// schedules the nodes, allocates transient buffers and writes the descriptor sets.
+	// allocatorMutex guards allocator if other threads use it too, compile() and release() take it themselves
+	vk::Result compile(vk::Device device, vkExt::MemoryAllocator &allocator, const std::vector<uint32_t> &queueFamilies,
+		std::mutex* allocatorMutex = nullptr);
+	// with a profiler every level is timed as one stage of the given scope
+	void record(vk::CommandBuffer commandBuffer, Profiler* profiler = nullptr, uint32_t profileScope = 0);
+	// frees transient buffers and descriptor sets, the graph can be compiled again afterwards
+	void release();
+
+	uint32_t barrierCount() const { return m_barrierCount; }
+	size_t transientCount() const { return m_transients.size(); }
+	// physical buffers backing the transients after aliasing
+	size_t physicalTransientCount() const { return m_physical.size(); }
+
+private:
+	enum class NodeType {
+		eDispatch,
+		eCopy
+	};
+
+	struct Node {
+		NodeType type;
+		ComputeKernel* kernel = nullptr;
+		std::vector<GraphBinding> bindings;
+		std::vector<uint8_t> pushConstants;
+		uint32_t groupCount[3] = { 1, 1, 1 };
+		vk::BufferCopy copy;
+		vk::DescriptorSet descriptorSet;		// not used if the kernel pushes its descriptors
+		std::vector<vk::DescriptorBufferInfo> bufferInfos;
+		std::vector<vk::WriteDescriptorSet> writes;		// pushed with the dispatch, point into bufferInfos
+		uint32_t level = 0;
+	};
+
+	struct Resource {
+		vkExt::Buffer* imported = nullptr;
+		vk::DeviceSize size = 0;
+		int32_t physical = -1;	// index into m_physical for transients
+		uint32_t firstLevel = UINT32_MAX;
+		uint32_t lastLevel = 0;
+	};
+
+	// hazard tracking per VkBuffer while recording
+	struct BufferState {
+		vk::PipelineStageFlags writeStage;
+		vk::AccessFlags writeAccess;
+		vk::PipelineStageFlags visibleStages;
+		vk::PipelineStageFlags readStages;
+		bool hasWrite = false;
+	};
+
+	vk::Device m_device;
+	vkExt::MemoryAllocator* m_allocator = nullptr;
+	std::mutex* m_allocatorMutex = nullptr;
+	std::vector<Node> m_nodes;
+	std::vector<Resource> m_resources;
+	std::vector<GraphBuffer> m_transients;
+	std::vector<vkExt::Buffer> m_physical;
+	std::vector<uint32_t> m_order;		// node indices sorted by level
+	vk::DescriptorPool m_descriptorPool;
+	uint32_t m_barrierCount = 0;
+
+	vk::Buffer bufferOf(GraphBuffer buffer);
+	void accesses(const Node &node, std::vector<std::pair<GraphBuffer, GraphAccess>> &out) const;
+};
+
+#endif
\ No newline at end of file
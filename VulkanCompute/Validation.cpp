@@ -0,0 +1,106 @@
+#include "Validation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+
+namespace {
+	// floats ordered as integers, negative values mirrored below zero so -0 and +0 meet
+	int64_t orderedBits(float value) {
+		int32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits < 0 ? static_cast<int64_t>(INT32_MIN) - bits : bits;
+	}
+
+	uint64_t splitmix64(uint64_t x) {
+		x += 0x9E3779B97F4A7C15ull;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+}
+
+uint64_t ulpDistance(float a, float b) {
+	const bool nanA = std::isnan(a);
+	const bool nanB = std::isnan(b);
+	if (nanA || nanB) return nanA && nanB ? 0 : ~0ull;
+	const int64_t d = orderedBits(a) - orderedBits(b);
+	return static_cast<uint64_t>(d < 0 ? -d : d);
+}
+
+void ValidationReport::merge(const ValidationReport &other, uint32_t maxReported) {
+	checked += other.checked;
+	mismatches += other.mismatches;
+	maxUlps = std::max(maxUlps, other.maxUlps);
+	maxRelativeError = std::max(maxRelativeError, other.maxRelativeError);
+	first.insert(first.end(), other.first.begin(), other.first.end());
+	std::sort(first.begin(), first.end(), [](const ValidationMismatch &a, const ValidationMismatch &b) { return a.index < b.index; });
+	if (first.size() > maxReported) first.resize(maxReported);
+}
+
+std::string ValidationReport::summary() const {
+	std::ostringstream ss;
+	ss << (passed() ? "validation passed: " : "validation FAILED: ") << checked << " elements checked, " << mismatches << " mismatches"
+		<< ", max " << maxUlps << " ulps, max relative error " << maxRelativeError;
+	for (const ValidationMismatch &mismatch : first) {
+		ss.precision(9);
+		ss << "\n  [" << mismatch.index << "] expected " << mismatch.expected << ", got " << mismatch.actual << " (" << mismatch.ulps << " ulps)";
+	}
+	return ss.str();
+}
+
+bool Validator::sampled(uint64_t block) const {
+	if (m_settings.sampleRate >= 1.0) return true;
+	// top 53 bits as a uniform double in [0, 1)
+	return (splitmix64(m_settings.seed ^ block) >> 11) * (1.0 / 9007199254740992.0) < m_settings.sampleRate;
+}
+
+bool Validator::matches(float expected, float actual, uint64_t &ulps) const {
+	ulps = ulpDistance(expected, actual);
+	if (ulps <= m_settings.maxUlps) return true;
+	if (std::isnan(expected) || std::isnan(actual)) return false;
+	const double error = std::fabs(static_cast<double>(actual) - expected);
+	return error <= m_settings.absoluteTolerance || error <= m_settings.relativeTolerance * std::fabs(static_cast<double>(expected));
+}
+
+ValidationReport Validator::check(const float* actual, size_t count, uint64_t firstIndex, const ValidationReference &reference) const {
+	ValidationReport report;
+	if (!enabled() || count == 0) return report;
+	std::mutex mutex;
+	const size_t blocks = (count + BlockSize - 1) / BlockSize;
+	m_pool.parallelFor(blocks, 16, [&](size_t firstBlock, size_t lastBlock) {
+		ValidationReport local;
+		float expected[BlockSize];
+		for (size_t block = firstBlock; block < lastBlock; block++) {
+			const size_t begin = block * BlockSize;
+			const size_t end = std::min(count, begin + BlockSize);
+			if (!sampled((firstIndex + begin) / BlockSize)) continue;
+			reference(begin, end, expected);
+			for (size_t i = begin; i < end; i++) {
+				const float e = expected[i - begin];
+				uint64_t ulps;
+				const bool match = matches(e, actual[i], ulps);
+				local.maxUlps = std::max(local.maxUlps, ulps);
+				if (e != 0.0f && !std::isnan(e) && !std::isnan(actual[i])) {
+					local.maxRelativeError = std::max(local.maxRelativeError, std::fabs((static_cast<double>(actual[i]) - e) / e));
+				}
+				if (match) continue;
+				local.mismatches++;
+				if (local.first.size() < m_settings.maxReported) {
+					ValidationMismatch mismatch;
+					mismatch.index = firstIndex + i;
+					mismatch.expected = e;
+					mismatch.actual = actual[i];
+					mismatch.ulps = ulps;
+					local.first.push_back(mismatch);
+				}
+			}
+			local.checked += end - begin;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		report.merge(local, m_settings.maxReported);
+	});
+	return report;
+}
@@ -0,0 +1,76 @@
+#ifndef VALIDATION_H
+#define VALIDATION_H
+
+#include "HostPrep.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct ValidationSettings {
+	// fraction of elements checked, picked in blocks of Validator::BlockSize. 0 disables validation, 1 checks every element
+	double sampleRate = 0.0;
+	// an element matches if it is within any of the tolerances. 0 ulps only accepts the exact result
+	uint32_t maxUlps = 2;
+	float relativeTolerance = 0.0f;		// |actual - expected| <= relativeTolerance * |expected|
+	float absoluteTolerance = 0.0f;		// |actual - expected| <= absoluteTolerance, for results near 0
+	// mismatches kept with their values, the lowest indices win
+	uint32_t maxReported = 8;
+	// selects the sampled blocks, the same seed checks the same blocks
+	uint64_t seed = 0x5EEDull;
+};
+
+struct ValidationMismatch {
+	uint64_t index = 0;
+	float expected = 0.0f;
+	float actual = 0.0f;
+	uint64_t ulps = 0;
+};
+
+struct ValidationReport {
+	uint64_t checked = 0;
+	uint64_t mismatches = 0;
+	uint64_t maxUlps = 0;		// largest distance of any checked element, matching or not
+	double maxRelativeError = 0.0;
+	std::vector<ValidationMismatch> first;
+
+	bool passed() const { return mismatches == 0; }
+	// adds the counts of other and keeps the maxReported mismatches with the lowest indices
+	void merge(const ValidationReport &other, uint32_t maxReported);
+	// one line with the counts, then one per reported mismatch
+	std::string summary() const;
+};
+
+// distance in representable floats, 0 for equal values (and +0 / -0), 0 for two NaNs, ~0 for one NaN
+uint64_t ulpDistance(float a, float b);
+
+// reference(begin, end, expected) writes the host result of elements [begin, end) to expected[0, end - begin)
+typedef std::function<void(size_t begin, size_t end, float* expected)> ValidationReference;
+
+// Compares device results with a host reference. Only the sampled blocks are computed on the host, so
+// a small sample rate keeps validation cheap enough for production runs. Blocks are spread over the pool;
+// the reference runs on one thread per block, CpuKernels::apply() and evaluateOnHost() fit it.
+class Validator {
+public:
+	static const size_t BlockSize = 1024;
+
+	Validator(const ValidationSettings &settings, ThreadPool &pool) : m_settings(settings), m_pool(pool) {}
+
+	bool enabled() const { return m_settings.sampleRate > 0.0; }
+	const ValidationSettings& settings() const { return m_settings; }
+
+	// checks actual[0, count). firstIndex is the global index of actual[0], it picks the sampled blocks and
+	// is added to reported indices, so the batches of a stream sample different blocks
+	ValidationReport check(const float* actual, size_t count, uint64_t firstIndex, const ValidationReference &reference) const;
+	// true if actual is within the tolerances of expected, ulps receives their distance
+	bool matches(float expected, float actual, uint64_t &ulps) const;
+
+private:
+	ValidationSettings m_settings;
+	ThreadPool &m_pool;
+
+	bool sampled(uint64_t block) const;
+};
+
+#endif
@@ -1,461 +1,1188 @@
-#include "VulkanCompute.h"
-
-#include <set>
-#include <fstream>
-
-#include <random>
-
-vk::Result VulkanComputeApplication::initInstance() {
-	// Use validation layers if this is a debug build
-	std::vector<const char*> layers;
-#if defined(_DEBUG)
-	if (!checkValidationLayerSupport(m_validationLayers)) {
-		TRACE_FULL("validation layers requested, but not present!");
-		return vk::Result::eErrorInitializationFailed;
-	}
-	layers = m_validationLayers;
-#endif
-	auto extensions = getRequiredExtensions();
-
-	// VkApplicationInfo allows the programmer to specifiy some basic information about the
-	// program, which can be useful for layers and tools to provide more debug information.
-	vk::ApplicationInfo appInfo = vk::ApplicationInfo()
-		.setPApplicationName("Vulkan C++ Program Template")
-		.setApplicationVersion(1)
-		.setPEngineName("LunarG SDK")
-		.setEngineVersion(1)
-		.setApiVersion(VK_API_VERSION_1_0);
-
-	// VkInstanceCreateInfo is where the programmer specifies the layers and/or extensions that
-	// are needed. For now, none are enabled.
-	vk::InstanceCreateInfo instInfo = vk::InstanceCreateInfo()
-		.setFlags(vk::InstanceCreateFlags())
-		.setPApplicationInfo(&appInfo)
-		.setEnabledExtensionCount(static_cast<uint32_t>(extensions.size()))
-		.setPpEnabledExtensionNames(extensions.data())
-		.setEnabledLayerCount(static_cast<uint32_t>(layers.size()))
-		.setPpEnabledLayerNames(layers.data());
-
-	// Create the Vulkan instance.
-	vk::Instance instance;
-	try {
-		m_instance = vk::createInstance(instInfo);
-	}
-	catch (const std::exception& e) {
-		TRACE_FULL(e.what());
-		return vk::Result::eErrorInitializationFailed;
-	}
-	return vk::Result::eSuccess;
-}
-
-void VulkanComputeApplication::cleanup() {
-	if (!m_initialized) return; // todo: maybe check each component if it is initialized
-	m_device.freeCommandBuffers(m_commandPool, 1, &m_commandBuffer);
-	m_device.destroyCommandPool(m_commandPool);
-	m_device.destroyDescriptorPool(m_descriptorPool);
-	m_device.destroyPipeline(m_pipeline);
-	m_device.destroyPipelineLayout(m_pipelineLayout);
-	m_device.destroyDescriptorSetLayout(m_descriptorSetLayout);
-	m_inputBufferA.destroy(false);
-	m_inputBufferB.destroy(false);
-	m_outputBuffer.destroy(true);
-	m_queue = nullptr;
-	m_device.destroy();
-	m_instance.destroy();
-}
-
-vk::Result VulkanComputeApplication::createDevice() {
-	std::vector<vk::PhysicalDevice> devices = m_instance.enumeratePhysicalDevices();
-	for (const auto& device : devices) {
-		if (isDeviceSuitable(device, m_requiredExtensions)) {
-			m_physicalDevice = device;
-			break;
-		}
-	}
-	if (!m_physicalDevice) {
-		TRACE_FULL("unable to find suitable device");
-		return vk::Result::eErrorInitializationFailed;
-	}
-	m_queueFamIndex = findQueueFamilyIndex(m_physicalDevice).value; // we can be sure that the function reports a correct value as we already check this in isDeviceSuitable
-
-	const float defaultQueuePriority = 1.0f;
-	vk::DeviceQueueCreateInfo deviceQueueCreateInfo = vk::DeviceQueueCreateInfo()
-		.setQueueFamilyIndex(m_queueFamIndex)
-		.setQueueCount(1)
-		.setPQueuePriorities(&defaultQueuePriority);
-
-	vk::DeviceCreateInfo deviceCreateInfo = vk::DeviceCreateInfo()
-		.setQueueCreateInfoCount(1)
-		.setPQueueCreateInfos(&deviceQueueCreateInfo);
-
-	m_device = m_physicalDevice.createDevice(deviceCreateInfo);
-	if (!m_device) {
-		TRACE_FULL("unable to create logical device");
-		return vk::Result::eErrorInitializationFailed;
-	}
-	m_queue = m_device.getQueue(m_queueFamIndex, 0);
-	if (!m_device) {
-		TRACE_FULL("unable to create device queue");
-		return vk::Result::eErrorInitializationFailed;
-	}
-	return vk::Result::eSuccess;
-}
-
-vk::Result VulkanComputeApplication::createBuffers() {
-	auto res = findMemoryTypeIndex(m_physicalDevice, m_memorySize);
-	if (res.result != vk::Result::eSuccess) {
-		TRACE_FULL("unable to find memory type for values buffers");
-		return vk::Result::eErrorInitializationFailed;
-	}
-	vk::MemoryAllocateInfo memAllocInfo = vk::MemoryAllocateInfo()
-		.setAllocationSize(m_memorySize)
-		.setMemoryTypeIndex(res.value);
-
-	m_valuesBufferMemory = m_device.allocateMemory(memAllocInfo);
-	if (!m_valuesBufferMemory) {
-		TRACE_FULL("unable to allocate memory for buffers");
-		return vk::Result::eErrorInitializationFailed;
-	}
-	
-	m_sharedBufferMemory.memory = m_valuesBufferMemory;
-	m_sharedBufferMemory.size = m_memorySize;
-
-	vk::BufferCreateInfo bufferCreateInfo = vk::BufferCreateInfo()
-		.setSize(m_bufferSize)
-		.setUsage(vk::BufferUsageFlagBits::eStorageBuffer)
-		.setSharingMode(vk::SharingMode::eExclusive)
-		.setQueueFamilyIndexCount(1)
-		.setPQueueFamilyIndices(&m_queueFamIndex);
-
-	m_inputBufferA.buffer = m_device.createBuffer(bufferCreateInfo);
-	if (!m_inputBufferA.buffer) {
-		TRACE_FULL("unable to create input buffer A");
-		return vk::Result::eErrorInitializationFailed;
-	}
-	m_device.bindBufferMemory(m_inputBufferA.buffer, m_valuesBufferMemory, 0);
-	m_inputBufferA.device = m_device;
-	m_inputBufferA.memory = &m_sharedBufferMemory;
-	m_inputBufferA.usageFlags = bufferCreateInfo.usage;
-	m_inputBufferA.setupDescriptor(m_bufferSize);
-	m_inputBufferA.memoryOffset = 0;
-
-	m_inputBufferB.buffer = m_device.createBuffer(bufferCreateInfo);
-	if (!m_inputBufferB.buffer) {
-		TRACE_FULL("unable to create input buffer B");
-		return vk::Result::eErrorInitializationFailed;
-	}
-	m_device.bindBufferMemory(m_inputBufferB.buffer, m_valuesBufferMemory, m_bufferSize);
-	m_inputBufferB.device = m_device;
-	m_inputBufferB.memory = &m_sharedBufferMemory;
-	m_inputBufferB.usageFlags = bufferCreateInfo.usage;
-	m_inputBufferB.setupDescriptor(m_bufferSize);
-	m_inputBufferB.memoryOffset = m_numElements;
-
-	m_outputBuffer.buffer = m_device.createBuffer(bufferCreateInfo);
-	if (!m_outputBuffer.buffer) {
-		TRACE_FULL("unable to create output buffer");
-		return vk::Result::eErrorInitializationFailed;
-	}
-	m_device.bindBufferMemory(m_outputBuffer.buffer, m_valuesBufferMemory, m_outputOffset);
-	m_outputBuffer.device = m_device;
-	m_outputBuffer.memory = &m_sharedBufferMemory;
-	m_outputBuffer.usageFlags = bufferCreateInfo.usage;
-	m_outputBuffer.setupDescriptor(m_bufferSize);
-	m_outputBuffer.memoryOffset = m_numElements * 2;
-
-	return vk::Result::eSuccess;
-}
-
-vk::Result VulkanComputeApplication::createPipeline() {
-	vk::ShaderModule shader_module;
-	auto result = createShaderModuleFromFile(m_device, "shaders/glsl_shader.spv");
-	if (result.result != vk::Result::eSuccess) {
-		TRACE_FULL("Unable to load specified shader.");
-		return result.result;
-	}
-	shader_module = result.value;
-	
-	vk::DescriptorSetLayoutBinding layoutBindings[3] = {
-		vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute),
-		vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute),
-		vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute)
-	};
-
-	vk::DescriptorSetLayoutCreateInfo descLayoutCI = vk::DescriptorSetLayoutCreateInfo()
-		.setBindingCount(3)
-		.setPBindings(layoutBindings);
-
-	m_descriptorSetLayout = m_device.createDescriptorSetLayout(descLayoutCI);
-	if (!m_descriptorSetLayout) {
-		TRACE_FULL("unable to create compute descriptor set layout");
-		return vk::Result::eErrorInitializationFailed;
-	}
-
-	vk::PushConstantRange pushConstantRange = vk::PushConstantRange()
-		.setStageFlags(vk::ShaderStageFlagBits::eCompute)
-		.setSize(m_numElemsPushConstantSize)
-		.setOffset(0);
-
-	vk::PipelineLayoutCreateInfo pipeLayoutCI = vk::PipelineLayoutCreateInfo()
-		.setSetLayoutCount(1)
-		.setPSetLayouts(&m_descriptorSetLayout)
-		.setPushConstantRangeCount(1)
-		.setPPushConstantRanges(&pushConstantRange);
-
-	m_pipelineLayout = m_device.createPipelineLayout(pipeLayoutCI);
-	if (!m_pipelineLayout) {
-		TRACE_FULL("unable to create compute pipeline layout");
-		return vk::Result::eErrorInitializationFailed;
-	}
-
-	vk::ComputePipelineCreateInfo computePipeCI = vk::ComputePipelineCreateInfo()
-		.setStage(vk::PipelineShaderStageCreateInfo(
-			vk::PipelineShaderStageCreateFlags(),
-			vk::ShaderStageFlagBits::eCompute,
-			shader_module,
-			"main",
-			nullptr
-		))
-		.setLayout(m_pipelineLayout);
-	m_pipeline = m_device.createComputePipeline(nullptr, computePipeCI);
-	if (!m_pipeline) {
-		TRACE_FULL("unable to create compute pipeline");
-		return vk::Result::eErrorInitializationFailed;
-	}
-
-	m_device.destroyShaderModule(shader_module);
-
-	return vk::Result::eSuccess;
-}
-
-vk::Result VulkanComputeApplication::createCommandBuffer() {
-	vk::CommandPoolCreateInfo comandPoolCI = vk::CommandPoolCreateInfo()
-		.setQueueFamilyIndex(m_queueFamIndex);
-	vk::DescriptorPoolSize descriptorPoolSizeStoreBuffs = vk::DescriptorPoolSize()
-		.setDescriptorCount(3)
-		.setType(vk::DescriptorType::eStorageBuffer);
-
-
-	vk::DescriptorPoolCreateInfo descriptorPoolCI = vk::DescriptorPoolCreateInfo()
-		.setPoolSizeCount(1)
-		.setPPoolSizes(&descriptorPoolSizeStoreBuffs)
-		.setMaxSets(1);
-
-	m_descriptorPool = m_device.createDescriptorPool(descriptorPoolCI);
-	if (!m_descriptorPool) {
-		TRACE_FULL("unable to create descriptor pool");
-		return vk::Result::eErrorInitializationFailed;
-	}
-
-	vk::DescriptorSetAllocateInfo descriptorSetAllocInfo = vk::DescriptorSetAllocateInfo()
-		.setDescriptorPool(m_descriptorPool)
-		.setDescriptorSetCount(1)
-		.setPSetLayouts(&m_descriptorSetLayout);
-
-	m_descriptorSet = m_device.allocateDescriptorSets(descriptorSetAllocInfo).front();
-	if (!m_descriptorSet) {
-		TRACE_FULL("unable to create descriptor sets");
-		return vk::Result::eErrorInitializationFailed;
-	}
-
-	vk::WriteDescriptorSet writeDescriptorSets[3] = {
-		vk::WriteDescriptorSet(m_descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &m_inputBufferA.descriptor, nullptr),
-		vk::WriteDescriptorSet(m_descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &m_inputBufferB.descriptor, nullptr),
-		vk::WriteDescriptorSet(m_descriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &m_outputBuffer.descriptor, nullptr)
-	};
-
-	m_device.updateDescriptorSets(3, writeDescriptorSets, 0, nullptr);
-
-	m_commandPool = m_device.createCommandPool(comandPoolCI);
-	if (!m_commandPool) {
-		TRACE_FULL("unable to create command pool");
-		return vk::Result::eErrorInitializationFailed;
-	}
-
-	vk::CommandBufferAllocateInfo commandBufferAllocInfo = vk::CommandBufferAllocateInfo()
-		.setCommandPool(m_commandPool)
-		.setLevel(vk::CommandBufferLevel::ePrimary)
-		.setCommandBufferCount(1);
-
-	m_commandBuffer = m_device.allocateCommandBuffers(commandBufferAllocInfo).front();
-	if (!m_commandBuffer) {
-		TRACE_FULL("unable to allocate command buffer");
-		return vk::Result::eErrorInitializationFailed;
-	}
-
-	vk::CommandBufferBeginInfo commandBufferBeginInfo = vk::CommandBufferBeginInfo()
-		.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-
-	glm::vec4 numElems(m_numElements, 0, 0, 0);
-	
-	m_commandBuffer.begin(commandBufferBeginInfo);
-	m_commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_pipeline);
-	m_commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
-	m_commandBuffer.pushConstants(m_pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, m_numElemsPushConstantSize, &numElems);
-	m_commandBuffer.dispatch(m_bufferSize / sizeof(int32_t), 1, 1);
-	m_commandBuffer.end();
-
-	return vk::Result::eSuccess;
-}
-
-void VulkanComputeApplication::fillInputBuffersRandom() {
-	auto res = m_inputBufferA.map();
-	if (res != vk::Result::eSuccess) {
-		TRACE_FULL("unable to map buffer");
-		return;
-	}
-	res = m_inputBufferB.map();
-	if (res != vk::Result::eSuccess) {
-		TRACE_FULL("unable to map buffer");
-		return;
-	}
-	float* mappedA = (float *)m_inputBufferA.mapped();
-	float* mappedB = (float *)m_inputBufferB.mapped();
-	
-	std::random_device rand;
-	std::mt19937 gen(rand());
-	std::uniform_real_distribution<float> distribution(1.0f, 10.0f); //random floats from 1.0 to 10.0)
-	for (uint32_t i = 0; i < m_numElements; i++) {
-		mappedA[i] = distribution(gen);
-		mappedB[i] = distribution(gen);
-	}
-	m_inputBufferA.unmap();
-	m_inputBufferB.unmap();
-}
-
-std::vector<float> VulkanComputeApplication::getResult() {
-	if (!m_initialized) {
-		TRACE_FULL("VulkanComputeApplication not fully initialized. aborting.");
-		return std::vector<float>();
-	}
-	auto res = m_outputBuffer.map();
-	if (res != vk::Result::eSuccess) {
-		TRACE_FULL("unable to map buffer");
-		return std::vector<float>();
-	}
-	float* mappedOut = (float *)m_outputBuffer.mapped();
-	std::vector<float> result(m_numElements);
-	for (uint32_t i = 0; i < m_numElements; i++) {
-		result[i] = mappedOut[i];
-	}
-	m_outputBuffer.unmap();
-	return result;
-}
-
-#pragma region helperfunctions
-static std::vector<char> readFile(const std::string& filename) {
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-	if (!file.is_open()) {
-		throw std::runtime_error(ERRORSTRING("failed to open file!"));
-	}
-
-	size_t fileSize = (size_t)file.tellg();
-	std::vector<char> buffer(fileSize);
-
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
-
-	file.close();
-
-	return buffer;
-}
-
-vk::ResultValue<vk::ShaderModule> createShaderModuleFromFile(const vk::Device &device, const std::string &file) {
-	try {
-		return createShaderModule(device, readFile(file));
-	}
-	catch (const std::runtime_error& e) {
-		TRACE_FULL(e.what());
-		return vk::ResultValue<vk::ShaderModule>(vk::Result::eIncomplete, vk::ShaderModule());
-	}
-}
-
-vk::ResultValue<vk::ShaderModule> createShaderModule(const vk::Device &device, const std::vector<char>& code) {
-	vk::ShaderModuleCreateInfo createInfo = vk::ShaderModuleCreateInfo()
-		.setCodeSize(code.size())
-		.setPCode(reinterpret_cast<const uint32_t*>(code.data()));
-	vk::ShaderModule module;
-	vk::Result result = device.createShaderModule(&createInfo, nullptr, &module);
-	return vk::ResultValue<vk::ShaderModule>(result, module);
-}
-
-vk::ResultValue<uint32_t> findMemoryTypeIndex(vk::PhysicalDevice device, vk::DeviceSize size, vk::MemoryPropertyFlags flags) {
-	vk::PhysicalDeviceMemoryProperties props = device.getMemoryProperties();
-	for (uint32_t i = 0; i < props.memoryTypeCount; i++) {
-		const vk::MemoryType memType = props.memoryTypes[i];
-		if (memType.propertyFlags & flags && props.memoryHeaps[memType.heapIndex].size > size) {
-			return vk::ResultValue<uint32_t>(vk::Result::eSuccess, i);
-		}
-	}
-	uint32_t ret = 0;
-	return vk::ResultValue<uint32_t>(vk::Result::eIncomplete, ret);
-}
-
-bool checkDeviceExtensionSupport(vk::PhysicalDevice device, std::vector<std::string> requiredExtensions) {
-	std::vector<vk::ExtensionProperties> availableExtensions = device.enumerateDeviceExtensionProperties();
-
-	std::set<std::string> setRequiredExtensions(requiredExtensions.begin(), requiredExtensions.end());
-	for (const auto& ext : availableExtensions) {
-		setRequiredExtensions.erase(ext.extensionName);
-	}
-	return setRequiredExtensions.empty();
-}
-
-vk::ResultValue<uint32_t> findQueueFamilyIndex(vk::PhysicalDevice device) {
-	uint32_t index = 0;
-	vk::Result res = vk::Result::eIncomplete;
-	std::vector<vk::QueueFamilyProperties> props = device.getQueueFamilyProperties();
-
-	uint32_t i = 0;
-	for (const auto& queueFamily : props) {
-		if (queueFamily.queueCount > 0 && 
-			queueFamily.queueFlags & vk::QueueFlagBits::eCompute /*&& 
-			!((queueFamily.queueFlags & vk::QueueFlagBits::eTransfer) || (queueFamily.queueFlags & vk::QueueFlagBits::eSparseBinding))*/) {
-			res = vk::Result::eSuccess;
-			index = i;
-			break;
-		}
-		i++;
-	}
-	
-	return vk::ResultValue<uint32_t>(res, index);
-}
-
-bool isDeviceSuitable(vk::PhysicalDevice device, std::vector<std::string> requiredExtensions) {
-	auto res = findQueueFamilyIndex(device);
-	if (res.result != vk::Result::eSuccess) {
-		return false;
-	}
-	return checkDeviceExtensionSupport(device, requiredExtensions);
-}
-
-std::vector<const char*> getRequiredExtensions() {
-	std::vector<const char*> extensions;
-#ifdef _DEBUG
-	extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
-#endif
-	return extensions;
-}
-
-bool checkValidationLayerSupport(const std::vector<const char*> &validationLayers) {
-	std::vector<vk::LayerProperties> availableLayers = vk::enumerateInstanceLayerProperties();
-
-	for (const char* layerName : validationLayers) {
-		bool layerFound = false;
-
-		for (const auto& layerProperties : availableLayers) {
-			if (strcmp(layerName, layerProperties.layerName) == 0) {
-				layerFound = true;
-				break;
-			}
-		}
-
-		if (!layerFound) {
-			return false;
-		}
-	}
-
-	return true;
-}
+#include "VulkanCompute.h"
+#include "CpuBackend.h"
+
+#include <set>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <limits>
+
+#include <random>
+
+namespace {
+	// batches timed per backend by chooseBackend(), the first one warms up caches and clocks
+	const uint32_t CalibrationRuns = 3;
+
+	double millisecondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+void VulkanComputeApplication::cleanup() {
+	if (!m_initialized) return; // todo: maybe check each component if it is initialized
+	// the host backend holds no Vulkan objects
+	if (!m_hasDevice) return;
+	// the device may be shared, only wait for the work of this application
+	m_scheduler.destroy();
+	for (auto &frame : m_frames) {
+		if (frame.pending && m_backend == ComputeBackend::eGpu) m_device.waitForFences(1, &frame.fence, VK_TRUE, UINT64_MAX);
+	}
+	destroyFrames();
+	m_device.destroyCommandPool(m_commandPool);
+	m_kernels.destroy();
+	savePipelineCache();
+	m_device.destroyPipelineCache(m_pipelineCache);
+	m_profiler.destroy();
+	m_allocator.destroy();
+	m_transferQueue = nullptr;
+	m_queue = nullptr;
+	m_device = nullptr;
+	m_shared.reset();
+}
+
+vk::Result VulkanComputeApplication::initHost() {
+	m_backend = ComputeBackend::eCpu;
+	vk::Result res = configureBatches();
+	if (res != vk::Result::eSuccess) return res;
+	m_initialized = true;
+	return vk::Result::eSuccess;
+}
+
+vk::Result VulkanComputeApplication::chooseBackend() {
+	ProfileScope profile(m_profiler, "calibrate");
+	// only the round trips count, not the validation or profiling of the batches
+	m_calibrating = true;
+	m_profiler.pause(true);
+	// the same inputs through submitBatch() and waitBatch() on both, so copies and readback count as well
+	std::vector<float> a(m_numElements), b(m_numElements), result(m_numElements);
+	fillRandom(0, a.data(), b.data());
+	m_backendCosts.gpuMs = std::numeric_limits<double>::max();
+	m_backendCosts.cpuMs = std::numeric_limits<double>::max();
+	const ComputeBackend backends[] = { ComputeBackend::eGpu, ComputeBackend::eCpu };
+	for (ComputeBackend backend : backends) {
+		m_backend = backend;
+		double &cost = backend == ComputeBackend::eGpu ? m_backendCosts.gpuMs : m_backendCosts.cpuMs;
+		for (uint32_t i = 0; i < CalibrationRuns; i++) {
+			auto start = std::chrono::steady_clock::now();
+			vk::ResultValue<uint64_t> batch = submitBatch(a.data(), b.data());
+			vk::Result res = batch.result == vk::Result::eSuccess ? waitBatch(batch.value, result.data()) : batch.result;
+			if (res != vk::Result::eSuccess) {
+				m_backend = ComputeBackend::eGpu;
+				m_calibrating = false;
+				m_profiler.pause(false);
+				return res;
+			}
+			cost = std::min(cost, millisecondsSince(start));
+		}
+	}
+
+	m_calibrating = false;
+	m_profiler.pause(false);
+
+	// calibration batches do not count, the first real batch is batch 0 again
+	m_nextBatch = 0;
+	m_lastCompletedBatch = 0;
+	m_hasResult = false;
+	m_validationReport = ValidationReport();
+	for (auto &frame : m_frames) {
+		frame.batch = 0;
+	}
+	m_backend = m_backendCosts.cpuMs < m_backendCosts.gpuMs ? ComputeBackend::eCpu : ComputeBackend::eGpu;
+	if (m_backend == ComputeBackend::eGpu) {
+		std::vector<float>().swap(m_hostInputA);
+		std::vector<float>().swap(m_hostInputB);
+		std::vector<float>().swap(m_hostOutput);
+	}
+	else {
+		destroyFrames();
+	}
+	return vk::Result::eSuccess;
+}
+
+vk::Result VulkanComputeApplication::createDevice() {
+	vk::Result res = SharedDevice::acquire(m_settings.deviceIndex, m_settings.shareDevice, m_shared);
+	if (res != vk::Result::eSuccess) return res;
+	m_instance = m_shared->instance();
+	m_physicalDevice = m_shared->physicalDevice();
+	m_device = m_shared->device();
+	m_suitableDeviceCount = m_shared->suitableDeviceCount();
+	m_computeQueues = m_shared->computeQueues();
+	// the first compute queue is the one of findQueueFamilyIndex(), batches and task graphs run on it
+	m_queueFamIndex = m_computeQueues[0].family;
+	m_queue = m_computeQueues[0].queue;
+
+	m_memoryMode = resolveMemoryMode(m_physicalDevice, m_settings.memoryMode);
+	m_transferFamIndex = m_queueFamIndex;
+	if (m_memoryMode == MemoryMode::eDeviceLocal && m_shared->hasTransferQueue()) {
+		m_transferFamIndex = m_shared->transferQueue().family;
+		m_transferQueue = m_shared->transferQueue().queue;
+		m_useTransferQueue = true;
+	}
+	return vk::Result::eSuccess;
+}
+
+vk::Result VulkanComputeApplication::createPipelineCache() {
+	std::vector<char> initialData;
+	if (!m_settings.pipelineCachePath.empty()) {
+		std::ifstream file(m_settings.pipelineCachePath, std::ios::ate | std::ios::binary);
+		if (file.is_open()) {
+			initialData.resize((size_t)file.tellg());
+			file.seekg(0);
+			file.read(initialData.data(), initialData.size());
+		}
+		// a cache written by another driver or device is dropped, the pipelines are rebuilt from scratch
+		if (!initialData.empty() && !isPipelineCacheCompatible(initialData, m_physicalDevice.getProperties())) {
+			TRACE_FULL("ignoring stale pipeline cache");
+			initialData.clear();
+		}
+	}
+
+	vk::PipelineCacheCreateInfo pipelineCacheCI = vk::PipelineCacheCreateInfo()
+		.setInitialDataSize(initialData.size())
+		.setPInitialData(initialData.empty() ? nullptr : initialData.data());
+	vk::Result res = m_device.createPipelineCache(&pipelineCacheCI, nullptr, &m_pipelineCache);
+	if (res != vk::Result::eSuccess && !initialData.empty()) {
+		// the driver rejected the data despite a matching header, start empty
+		pipelineCacheCI.setInitialDataSize(0).setPInitialData(nullptr);
+		res = m_device.createPipelineCache(&pipelineCacheCI, nullptr, &m_pipelineCache);
+	}
+	if (res != vk::Result::eSuccess) {
+		TRACE_FULL("unable to create pipeline cache");
+	}
+	return res;
+}
+
+void VulkanComputeApplication::savePipelineCache() {
+	if (m_settings.pipelineCachePath.empty() || !m_pipelineCache) return;
+	size_t dataSize = 0;
+	if (m_device.getPipelineCacheData(m_pipelineCache, &dataSize, nullptr) != vk::Result::eSuccess || dataSize == 0) return;
+	std::vector<char> data(dataSize);
+	if (m_device.getPipelineCacheData(m_pipelineCache, &dataSize, data.data()) != vk::Result::eSuccess) return;
+
+	// write next to the target and swap it in, so a crash never leaves a truncated cache behind
+	const std::string tmpPath = m_settings.pipelineCachePath + ".tmp";
+	std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		TRACE_FULL("unable to write pipeline cache");
+		return;
+	}
+	file.write(data.data(), dataSize);
+	file.close();
+	std::remove(m_settings.pipelineCachePath.c_str());
+	if (std::rename(tmpPath.c_str(), m_settings.pipelineCachePath.c_str()) != 0) {
+		TRACE_FULL("unable to replace pipeline cache");
+		std::remove(tmpPath.c_str());
+	}
+}
+
+vk::Result VulkanComputeApplication::configureBatches() {
+	vk::PhysicalDeviceLimits limits;
+	if (m_hasDevice) {
+		limits = m_physicalDevice.getProperties().limits;
+	}
+	m_numElements = std::max(m_settings.numElements, 1u);
+	if (m_settings.seed) {
+		m_seed = m_settings.seed;
+	}
+	else {
+		std::random_device rand;
+		m_seed = (static_cast<uint64_t>(rand()) << 32) | rand();
+	}
+	m_bufferSize = sizeof(float) * static_cast<vk::DeviceSize>(m_numElements);
+	if (m_hasDevice && m_bufferSize > limits.maxStorageBufferRange) {
+		TRACE_FULL("batch size exceeds maxStorageBufferRange");
+		return vk::Result::eErrorInitializationFailed;
+	}
+
+	// every frame in flight gets its own slice of A, B and the output
+	m_frames.resize(std::max(m_settings.framesInFlight, 1u));
+	// host slices start on cache lines
+	m_sliceAlignment = std::max<vk::DeviceSize>(m_hasDevice ? limits.minStorageBufferOffsetAlignment : 64, 16);
+	m_sliceSize = (m_bufferSize + m_sliceAlignment - 1) / m_sliceAlignment * m_sliceAlignment;
+	for (vk::DeviceSize i = 0; i < m_frames.size(); i++) {
+		m_frames[i].sliceOffset = i * m_sliceSize;
+	}
+
+	if (m_hasDevice) {
+		m_allocator.init(m_physicalDevice, m_device);
+	}
+	return vk::Result::eSuccess;
+}
+
+vk::Result VulkanComputeApplication::createBuffers() {
+	vk::MemoryPropertyFlags valuesMemoryFlags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+	vk::BufferUsageFlags valuesUsage = vk::BufferUsageFlagBits::eStorageBuffer;
+	if (m_memoryMode == MemoryMode::eDeviceLocal) {
+		valuesMemoryFlags = vk::MemoryPropertyFlagBits::eDeviceLocal;
+		valuesUsage |= vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst;
+	}
+	const vk::DeviceSize frameCount = m_frames.size();
+	const vk::DeviceSize valuesSize = m_sliceSize * frameCount;
+	std::lock_guard<std::mutex> lock(m_allocatorMutex);
+
+	// the inputs are written by the transfer queue and read by the compute queues
+	std::vector<uint32_t> queueFamilies = bufferQueueFamilies();
+
+	if (m_allocator.createBuffer(m_inputBufferA, valuesSize, valuesUsage, valuesMemoryFlags, queueFamilies) != vk::Result::eSuccess) {
+		TRACE_FULL("unable to create input buffer A");
+		return vk::Result::eErrorInitializationFailed;
+	}
+	if (m_allocator.createBuffer(m_inputBufferB, valuesSize, valuesUsage, valuesMemoryFlags, queueFamilies) != vk::Result::eSuccess) {
+		TRACE_FULL("unable to create input buffer B");
+		return vk::Result::eErrorInitializationFailed;
+	}
+	if (m_allocator.createBuffer(m_outputBuffer, valuesSize, valuesUsage, valuesMemoryFlags, queueFamilies) != vk::Result::eSuccess) {
+		TRACE_FULL("unable to create output buffer");
+		return vk::Result::eErrorInitializationFailed;
+	}
+
+	if (m_memoryMode != MemoryMode::eDeviceLocal) {
+		return vk::Result::eSuccess;
+	}
+
+	// uploads go through a host visible staging ring, each frame owns a slice for A and B
+	const vk::DeviceSize stagingSize = m_sliceSize * 2 * frameCount;
+	vk::Result result = m_allocator.createBuffer(m_stagingBuffer, stagingSize, vk::BufferUsageFlagBits::eTransferSrc,
+		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, queueFamilies);
+	if (result != vk::Result::eSuccess) {
+		TRACE_FULL("unable to create staging buffer");
+		return result;
+	}
+	m_stagingRing.buffer = &m_stagingBuffer;
+	m_stagingRing.size = stagingSize;
+	for (auto &frame : m_frames) {
+		frame.stagingOffsetA = m_stagingRing.allocate(m_bufferSize);
+		frame.stagingOffsetB = m_stagingRing.allocate(m_bufferSize);
+	}
+
+	// readback prefers host cached memory, reading write-combined memory from the CPU is slow
+	result = m_allocator.createBuffer(m_readbackBuffer, valuesSize, vk::BufferUsageFlagBits::eTransferDst,
+		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCached, queueFamilies);
+	if (result != vk::Result::eSuccess) {
+		result = m_allocator.createBuffer(m_readbackBuffer, valuesSize, vk::BufferUsageFlagBits::eTransferDst,
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, queueFamilies);
+	}
+	if (result != vk::Result::eSuccess) {
+		TRACE_FULL("unable to create readback buffer");
+		return result;
+	}
+
+	return vk::Result::eSuccess;
+}
+
+vk::Result VulkanComputeApplication::createPipeline() {
+	// the kernel declares local_size_x_id = 0, so the workgroup size is fixed here
+	vk::PhysicalDeviceLimits limits = m_physicalDevice.getProperties().limits;
+	PushDescriptorSupport push;
+	if (m_settings.pushDescriptors) {
+		push.cmdPushDescriptorSet = m_shared->cmdPushDescriptorSet();
+		push.maxPushDescriptors = m_shared->features().maxPushDescriptors;
+	}
+	m_kernels.init(m_device, m_pipelineCache, limits, push);
+
+	// the variant is a specialization constant of the same module
+	const uint32_t workGroupSize = chooseWorkGroupSize(limits, m_settings.workGroupSize);
+	m_vectorsPerInvocation = m_settings.vectorize ? chooseVectorsPerInvocation(m_numElements, m_sliceAlignment, workGroupSize) : 0;
+	KernelSpecialization specialization;
+	specialization[1] = m_vectorsPerInvocation;
+	const std::string name = m_vectorsPerInvocation ? "add_vec4x" + std::to_string(m_vectorsPerInvocation) : "add";
+	auto result = m_kernels.load(name, "shaders/glsl_shader.spv", m_settings.workGroupSize, specialization);
+	if (result.result != vk::Result::eSuccess) {
+		TRACE_FULL("Unable to load specified shader.");
+		return result.result;
+	}
+	ComputeKernel* kernel = result.value;
+	if (kernel->setLayouts().empty() || kernel->reflection().pushConstantSize < sizeof(m_numElements)) {
+		TRACE_FULL("kernel interface does not match a + b = result");
+		return vk::Result::eErrorInitializationFailed;
+	}
+
+	m_kernel = kernel;
+	m_pipeline = kernel->pipeline();
+	m_pipelineLayout = kernel->pipelineLayout();
+	m_descriptorSetLayout = kernel->setLayout(0);
+	m_workGroupSize = kernel->workGroupSize();
+	// vectorized variants need one invocation per vectorsPerInvocation vec4s, the tail loops like the vectors
+	const uint32_t elementsPerInvocation = m_vectorsPerInvocation ? 4 * m_vectorsPerInvocation : 1;
+	m_groupCount = computeGroupCount(limits, static_cast<uint32_t>((static_cast<uint64_t>(m_numElements) + elementsPerInvocation - 1) / elementsPerInvocation),
+		m_workGroupSize);
+
+	return vk::Result::eSuccess;
+}
+
+vk::Result VulkanComputeApplication::createCommandPool() {
+	const uint32_t frameCount = static_cast<uint32_t>(m_frames.size());
+	vk::CommandPoolCreateInfo comandPoolCI = vk::CommandPoolCreateInfo()
+		.setQueueFamilyIndex(m_queueFamIndex);
+	m_commandPool = m_device.createCommandPool(comandPoolCI);
+	if (!m_commandPool) {
+		TRACE_FULL("unable to create command pool");
+		return vk::Result::eErrorInitializationFailed;
+	}
+
+	// timestamps: begin, upload, dispatch, readback per frame, begin and upload on the transfer queue,
+	// plus one per level for task graphs
+	const uint32_t graphProfileMarks = 32;
+	vk::Result res = m_profiler.init(m_physicalDevice, m_device, frameCount * (4 + 2) + graphProfileMarks + 1);
+	if (res != vk::Result::eSuccess) return res;
+	m_graphProfileScope = m_profiler.createScope(m_queueFamIndex, graphProfileMarks, ProfileTrack::eCompute);
+	return vk::Result::eSuccess;
+}
+
+vk::Result VulkanComputeApplication::ensureFrames() {
+	if (m_calibrate) {
+		// creates the frames of both backends through submitBatch() and keeps the ones of the faster
+		m_calibrate = false;
+		return chooseBackend();
+	}
+	if (m_backend == ComputeBackend::eCpu) {
+		// plain host memory, sliced like the device buffers
+		if (m_hostOutput.empty()) {
+			const size_t elements = static_cast<size_t>(m_sliceSize / sizeof(float) * m_frames.size());
+			m_hostInputA.resize(elements);
+			m_hostInputB.resize(elements);
+			m_hostOutput.resize(elements);
+		}
+		return vk::Result::eSuccess;
+	}
+	if (m_framesCreated) return vk::Result::eSuccess;
+	ProfileScope profile(m_profiler, "allocate");
+	vk::Result res = createBuffers();
+	if (res != vk::Result::eSuccess) return res;
+	res = createCommandBuffers();
+	if (res == vk::Result::eSuccess) m_framesCreated = true;
+	return res;
+}
+
+void VulkanComputeApplication::destroyFrames() {
+	if (!m_framesCreated) return;
+	for (auto &frame : m_frames) {
+		m_device.destroyFence(frame.fence);
+		m_device.freeCommandBuffers(m_commandPool, 1, &frame.commandBuffer);
+		if (m_useTransferQueue) {
+			m_device.destroySemaphore(frame.uploadSemaphore);
+			m_device.freeCommandBuffers(m_transferCommandPool, 1, &frame.transferCommandBuffer);
+		}
+		frame.fence = nullptr;
+		frame.commandBuffer = nullptr;
+		frame.transferCommandBuffer = nullptr;
+		frame.uploadSemaphore = nullptr;
+		frame.descriptorSet = nullptr;
+	}
+	m_device.destroyDescriptorPool(m_descriptorPool);
+	m_descriptorPool = nullptr;
+	std::lock_guard<std::mutex> lock(m_allocatorMutex);
+	m_allocator.destroyBuffer(m_inputBufferA);
+	m_allocator.destroyBuffer(m_inputBufferB);
+	m_allocator.destroyBuffer(m_outputBuffer);
+	if (m_memoryMode == MemoryMode::eDeviceLocal) {
+		m_allocator.destroyBuffer(m_stagingBuffer);
+		m_allocator.destroyBuffer(m_readbackBuffer);
+	}
+	if (m_useTransferQueue) {
+		m_device.destroyCommandPool(m_transferCommandPool);
+		m_transferCommandPool = nullptr;
+	}
+	m_framesCreated = false;
+}
+
+vk::Result VulkanComputeApplication::createCommandBuffers() {
+	const uint32_t frameCount = static_cast<uint32_t>(m_frames.size());
+	// push descriptors are recorded with the dispatch, there are no sets to allocate
+	std::vector<vk::DescriptorSet> descriptorSets;
+	if (!m_kernel->usesPushDescriptors()) {
+		vk::DescriptorPoolSize descriptorPoolSizeStoreBuffs = vk::DescriptorPoolSize()
+			.setDescriptorCount(3 * frameCount)
+			.setType(vk::DescriptorType::eStorageBuffer);
+
+		vk::DescriptorPoolCreateInfo descriptorPoolCI = vk::DescriptorPoolCreateInfo()
+			.setPoolSizeCount(1)
+			.setPPoolSizes(&descriptorPoolSizeStoreBuffs)
+			.setMaxSets(frameCount);
+
+		m_descriptorPool = m_device.createDescriptorPool(descriptorPoolCI);
+		if (!m_descriptorPool) {
+			TRACE_FULL("unable to create descriptor pool");
+			return vk::Result::eErrorInitializationFailed;
+		}
+
+		std::vector<vk::DescriptorSetLayout> setLayouts(frameCount, m_descriptorSetLayout);
+		vk::DescriptorSetAllocateInfo descriptorSetAllocInfo = vk::DescriptorSetAllocateInfo()
+			.setDescriptorPool(m_descriptorPool)
+			.setDescriptorSetCount(frameCount)
+			.setPSetLayouts(setLayouts.data());
+
+		descriptorSets = m_device.allocateDescriptorSets(descriptorSetAllocInfo);
+		if (descriptorSets.size() != frameCount) {
+			TRACE_FULL("unable to create descriptor sets");
+			return vk::Result::eErrorInitializationFailed;
+		}
+	}
+
+	vk::CommandBufferAllocateInfo commandBufferAllocInfo = vk::CommandBufferAllocateInfo()
+		.setCommandPool(m_commandPool)
+		.setLevel(vk::CommandBufferLevel::ePrimary)
+		.setCommandBufferCount(frameCount);
+
+	std::vector<vk::CommandBuffer> commandBuffers = m_device.allocateCommandBuffers(commandBufferAllocInfo);
+	if (commandBuffers.size() != frameCount) {
+		TRACE_FULL("unable to allocate command buffers");
+		return vk::Result::eErrorInitializationFailed;
+	}
+
+	std::vector<vk::CommandBuffer> transferCommandBuffers;
+	if (m_useTransferQueue) {
+		vk::CommandPoolCreateInfo transferPoolCI = vk::CommandPoolCreateInfo()
+			.setQueueFamilyIndex(m_transferFamIndex);
+		m_transferCommandPool = m_device.createCommandPool(transferPoolCI);
+		if (!m_transferCommandPool) {
+			TRACE_FULL("unable to create transfer command pool");
+			return vk::Result::eErrorInitializationFailed;
+		}
+		commandBufferAllocInfo.setCommandPool(m_transferCommandPool);
+		transferCommandBuffers = m_device.allocateCommandBuffers(commandBufferAllocInfo);
+		if (transferCommandBuffers.size() != frameCount) {
+			TRACE_FULL("unable to allocate transfer command buffers");
+			return vk::Result::eErrorInitializationFailed;
+		}
+	}
+
+	// the command buffers are recorded once and resubmitted for every batch
+	vk::CommandBufferBeginInfo commandBufferBeginInfo = vk::CommandBufferBeginInfo();
+
+	for (uint32_t i = 0; i < frameCount; i++) {
+		ComputeFrame &frame = m_frames[i];
+		frame.commandBuffer = commandBuffers[i];
+
+		vk::DescriptorBufferInfo bufferInfos[3] = {
+			vk::DescriptorBufferInfo(m_inputBufferA.buffer, frame.sliceOffset, m_bufferSize),
+			vk::DescriptorBufferInfo(m_inputBufferB.buffer, frame.sliceOffset, m_bufferSize),
+			vk::DescriptorBufferInfo(m_outputBuffer.buffer, frame.sliceOffset, m_bufferSize)
+		};
+		if (!descriptorSets.empty()) {
+			frame.descriptorSet = descriptorSets[i];
+			vk::WriteDescriptorSet writeDescriptorSets[3] = {
+				vk::WriteDescriptorSet(frame.descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bufferInfos[0], nullptr),
+				vk::WriteDescriptorSet(frame.descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bufferInfos[1], nullptr),
+				vk::WriteDescriptorSet(frame.descriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bufferInfos[2], nullptr)
+			};
+			m_device.updateDescriptorSets(3, writeDescriptorSets, 0, nullptr);
+		}
+
+		frame.fence = m_device.createFence(vk::FenceCreateInfo());
+		if (!frame.fence) {
+			TRACE_FULL("unable to create frame fence");
+			return vk::Result::eErrorInitializationFailed;
+		}
+
+		frame.profileScope = m_profiler.createScope(m_queueFamIndex, 3, ProfileTrack::eCompute);
+		frame.commandBuffer.begin(commandBufferBeginInfo);
+		m_profiler.begin(frame.commandBuffer, frame.profileScope);
+		if (m_memoryMode == MemoryMode::eDeviceLocal && !m_useTransferQueue) {
+			recordUploads(frame.commandBuffer, frame);
+			m_profiler.mark(frame.commandBuffer, frame.profileScope, "upload");
+		}
+		frame.commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_pipeline);
+		if (m_kernel->usesPushDescriptors()) {
+			m_kernel->pushDescriptors(frame.commandBuffer, bufferInfos);
+		}
+		else {
+			frame.commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_pipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+		}
+		frame.commandBuffer.pushConstants(m_pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(m_numElements), &m_numElements);
+		frame.commandBuffer.dispatch(m_groupCount, 1, 1);
+		m_profiler.mark(frame.commandBuffer, frame.profileScope, "dispatch");
+		recordReadback(frame.commandBuffer, frame);
+		m_profiler.mark(frame.commandBuffer, frame.profileScope, "readback");
+		frame.commandBuffer.end();
+
+		if (!m_useTransferQueue) continue;
+
+		frame.transferCommandBuffer = transferCommandBuffers[i];
+		frame.uploadSemaphore = m_device.createSemaphore(vk::SemaphoreCreateInfo());
+		if (!frame.uploadSemaphore) {
+			TRACE_FULL("unable to create upload semaphore");
+			return vk::Result::eErrorInitializationFailed;
+		}
+		frame.transferProfileScope = m_profiler.createScope(m_transferFamIndex, 1, ProfileTrack::eTransfer);
+		frame.transferCommandBuffer.begin(commandBufferBeginInfo);
+		m_profiler.begin(frame.transferCommandBuffer, frame.transferProfileScope);
+		recordUploads(frame.transferCommandBuffer, frame);
+		m_profiler.mark(frame.transferCommandBuffer, frame.transferProfileScope, "upload");
+		frame.transferCommandBuffer.end();
+	}
+
+	return vk::Result::eSuccess;
+}
+
+void VulkanComputeApplication::recordUploads(vk::CommandBuffer commandBuffer, const ComputeFrame &frame) {
+	vk::BufferCopy copyA = vk::BufferCopy(frame.stagingOffsetA, frame.sliceOffset, m_bufferSize);
+	vk::BufferCopy copyB = vk::BufferCopy(frame.stagingOffsetB, frame.sliceOffset, m_bufferSize);
+	commandBuffer.copyBuffer(m_stagingBuffer.buffer, m_inputBufferA.buffer, 1, &copyA);
+	commandBuffer.copyBuffer(m_stagingBuffer.buffer, m_inputBufferB.buffer, 1, &copyB);
+	if (m_useTransferQueue) {
+		return; // the semaphore wait on the compute queue orders the copies before the dispatch
+	}
+	vk::MemoryBarrier uploadBarrier = vk::MemoryBarrier()
+		.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+		vk::DependencyFlags(), 1, &uploadBarrier, 0, nullptr, 0, nullptr);
+}
+
+void VulkanComputeApplication::recordReadback(vk::CommandBuffer commandBuffer, const ComputeFrame &frame) {
+	if (m_memoryMode != MemoryMode::eDeviceLocal) {
+		// the host reads the output straight from the mapped values memory
+		vk::MemoryBarrier hostBarrier = vk::MemoryBarrier()
+			.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eHostRead);
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost,
+			vk::DependencyFlags(), 1, &hostBarrier, 0, nullptr, 0, nullptr);
+		return;
+	}
+
+	vk::MemoryBarrier computeBarrier = vk::MemoryBarrier()
+		.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eTransferRead);
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer,
+		vk::DependencyFlags(), 1, &computeBarrier, 0, nullptr, 0, nullptr);
+
+	vk::BufferCopy copy = vk::BufferCopy(frame.sliceOffset, frame.sliceOffset, m_bufferSize);
+	commandBuffer.copyBuffer(m_outputBuffer.buffer, m_readbackBuffer.buffer, 1, &copy);
+
+	vk::MemoryBarrier hostBarrier = vk::MemoryBarrier()
+		.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eHostRead);
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost,
+		vk::DependencyFlags(), 1, &hostBarrier, 0, nullptr, 0, nullptr);
+}
+
+float* VulkanComputeApplication::frameInputA(const ComputeFrame &frame) {
+	if (m_backend == ComputeBackend::eCpu) {
+		return m_hostInputA.data() + frame.sliceOffset / sizeof(float);
+	}
+	if (m_memoryMode == MemoryMode::eDeviceLocal) {
+		return (float *)m_stagingRing.at(frame.stagingOffsetA);
+	}
+	return (float *)((uint8_t *)m_inputBufferA.mapped() + frame.sliceOffset);
+}
+
+float* VulkanComputeApplication::frameInputB(const ComputeFrame &frame) {
+	if (m_backend == ComputeBackend::eCpu) {
+		return m_hostInputB.data() + frame.sliceOffset / sizeof(float);
+	}
+	if (m_memoryMode == MemoryMode::eDeviceLocal) {
+		return (float *)m_stagingRing.at(frame.stagingOffsetB);
+	}
+	return (float *)((uint8_t *)m_inputBufferB.mapped() + frame.sliceOffset);
+}
+
+const float* VulkanComputeApplication::frameOutput(const ComputeFrame &frame) {
+	if (m_backend == ComputeBackend::eCpu) {
+		return m_hostOutput.data() + frame.sliceOffset / sizeof(float);
+	}
+	vkExt::Buffer &source = m_memoryMode == MemoryMode::eDeviceLocal ? m_readbackBuffer : m_outputBuffer;
+	return (const float *)((uint8_t *)source.mapped() + frame.sliceOffset);
+}
+
+vk::Result VulkanComputeApplication::submitFrame(ComputeFrame &frame) {
+	if (m_backend == ComputeBackend::eCpu) {
+		// runs right away, waitBatch() only hands out the result
+		ProfileScope profile(m_profiler, "compute", m_nextBatch);
+		const size_t offset = static_cast<size_t>(frame.sliceOffset / sizeof(float));
+		CpuKernels(m_hostPool).add(m_hostInputA.data() + offset, m_hostInputB.data() + offset, m_hostOutput.data() + offset, m_numElements);
+		frame.batch = m_nextBatch++;
+		frame.pending = true;
+		return vk::Result::eSuccess;
+	}
+	ProfileScope profile(m_profiler, "submit", m_nextBatch);
+	frame.submitMs = m_profiler.enabled() ? m_profiler.now() : 0.0;
+	vk::SubmitInfo submitInfo = vk::SubmitInfo()
+		.setCommandBufferCount(1)
+		.setPCommandBuffers(&frame.commandBuffer);
+	vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eComputeShader;
+	if (m_useTransferQueue) {
+		// uploads run on the dedicated transfer queue, the dispatch waits for them on the GPU
+		vk::SubmitInfo uploadInfo = vk::SubmitInfo()
+			.setCommandBufferCount(1)
+			.setPCommandBuffers(&frame.transferCommandBuffer)
+			.setSignalSemaphoreCount(1)
+			.setPSignalSemaphores(&frame.uploadSemaphore);
+		vk::Result res;
+		{
+			std::lock_guard<std::mutex> lock(*m_shared->transferQueue().mutex);
+			res = m_transferQueue.submit(1, &uploadInfo, nullptr);
+		}
+		if (res != vk::Result::eSuccess) {
+			TRACE_FULL("unable to submit uploads");
+			return res;
+		}
+		submitInfo
+			.setWaitSemaphoreCount(1)
+			.setPWaitSemaphores(&frame.uploadSemaphore)
+			.setPWaitDstStageMask(&waitStage);
+	}
+	vk::Result res;
+	{
+		// the scheduler may submit to the same queue
+		std::lock_guard<std::mutex> lock(*m_computeQueues[0].mutex);
+		res = m_queue.submit(1, &submitInfo, frame.fence);
+	}
+	if (res != vk::Result::eSuccess) {
+		TRACE_FULL("unable to submit batch");
+		return res;
+	}
+	frame.batch = m_nextBatch++;
+	frame.pending = true;
+	return vk::Result::eSuccess;
+}
+
+std::vector<uint32_t> VulkanComputeApplication::bufferQueueFamilies() const {
+	std::vector<uint32_t> queueFamilies = findComputeQueueFamilies(m_physicalDevice);
+	if (m_useTransferQueue) {
+		queueFamilies.push_back(m_transferFamIndex);
+	}
+	return queueFamilies;
+}
+
+vk::Result VulkanComputeApplication::createBuffer(vkExt::Buffer &buffer, vk::DeviceSize size, vk::MemoryPropertyFlags flags) {
+	if (!m_hasDevice) {
+		TRACE_FULL("buffers need a device");
+		return vk::Result::eErrorFeatureNotPresent;
+	}
+	vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst;
+	std::lock_guard<std::mutex> lock(m_allocatorMutex);
+	vk::Result res = m_allocator.createBuffer(buffer, size, usage, flags, bufferQueueFamilies());
+	if (res != vk::Result::eSuccess) {
+		TRACE_FULL("unable to create buffer");
+	}
+	return res;
+}
+
+void VulkanComputeApplication::destroyBuffer(vkExt::Buffer &buffer) {
+	if (!m_hasDevice) return;
+	std::lock_guard<std::mutex> lock(m_allocatorMutex);
+	m_allocator.destroyBuffer(buffer);
+}
+
+vk::Result VulkanComputeApplication::execute(TaskGraph &graph) {
+	if (!m_initialized) {
+		TRACE_FULL("VulkanComputeApplication not fully initialized. aborting.");
+		return vk::Result::eErrorInitializationFailed;
+	}
+	if (!m_hasDevice) {
+		TRACE_FULL("task graphs need a device");
+		return vk::Result::eErrorFeatureNotPresent;
+	}
+	// the graph takes m_allocatorMutex itself, also when the caller releases it
+	vk::Result res = graph.compile(m_device, m_allocator, bufferQueueFamilies(), &m_allocatorMutex);
+	if (res != vk::Result::eSuccess) {
+		return res;
+	}
+
+	vk::CommandBufferAllocateInfo commandBufferAllocInfo = vk::CommandBufferAllocateInfo()
+		.setCommandPool(m_commandPool)
+		.setLevel(vk::CommandBufferLevel::ePrimary)
+		.setCommandBufferCount(1);
+	vk::CommandBuffer commandBuffer;
+	res = m_device.allocateCommandBuffers(&commandBufferAllocInfo, &commandBuffer);
+	if (res != vk::Result::eSuccess) {
+		TRACE_FULL("unable to allocate task graph command buffer");
+		return res;
+	}
+	vk::Fence fence = m_device.createFence(vk::FenceCreateInfo());
+
+	commandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	graph.record(commandBuffer, &m_profiler, m_graphProfileScope);
+	commandBuffer.end();
+
+	vk::SubmitInfo submitInfo = vk::SubmitInfo()
+		.setCommandBufferCount(1)
+		.setPCommandBuffers(&commandBuffer);
+	double submitMs = m_profiler.enabled() ? m_profiler.now() : 0.0;
+	{
+		std::lock_guard<std::mutex> lock(*m_computeQueues[0].mutex);
+		res = m_queue.submit(1, &submitInfo, fence);
+	}
+	if (res == vk::Result::eSuccess) {
+		res = m_device.waitForFences(1, &fence, VK_TRUE, UINT64_MAX);
+		if (res == vk::Result::eSuccess) {
+			m_profiler.collect(m_graphProfileScope, 0, submitMs);
+		}
+	} else {
+		TRACE_FULL("unable to submit task graph");
+	}
+	m_device.destroyFence(fence);
+	m_device.freeCommandBuffers(m_commandPool, 1, &commandBuffer);
+	return res;
+}
+
+vk::ResultValue<uint64_t> VulkanComputeApplication::submitBatch(const float* a, const float* b) {
+	if (!m_initialized) {
+		TRACE_FULL("VulkanComputeApplication not fully initialized. aborting.");
+		uint64_t none = 0;
+		return vk::ResultValue<uint64_t>(vk::Result::eErrorInitializationFailed, none);
+	}
+	vk::Result res = ensureFrames();
+	if (res != vk::Result::eSuccess) {
+		uint64_t none = 0;
+		return vk::ResultValue<uint64_t>(res, none);
+	}
+	ComputeFrame &frame = nextFrame();
+	if (frame.pending) {
+		return vk::ResultValue<uint64_t>(vk::Result::eNotReady, frame.batch);
+	}
+	{
+		ProfileScope profile(m_profiler, "upload", m_nextBatch);
+		parallelCopy(frameInputA(frame), a, m_bufferSize, m_hostPool);
+		parallelCopy(frameInputB(frame), b, m_bufferSize, m_hostPool);
+	}
+	res = submitFrame(frame);
+	return vk::ResultValue<uint64_t>(res, frame.batch);
+}
+
+vk::ResultValue<uint64_t> VulkanComputeApplication::submitBatch(const double* a, const double* b) {
+	if (!m_initialized) {
+		TRACE_FULL("VulkanComputeApplication not fully initialized. aborting.");
+		uint64_t none = 0;
+		return vk::ResultValue<uint64_t>(vk::Result::eErrorInitializationFailed, none);
+	}
+	vk::Result res = ensureFrames();
+	if (res != vk::Result::eSuccess) {
+		uint64_t none = 0;
+		return vk::ResultValue<uint64_t>(res, none);
+	}
+	ComputeFrame &frame = nextFrame();
+	if (frame.pending) {
+		return vk::ResultValue<uint64_t>(vk::Result::eNotReady, frame.batch);
+	}
+	{
+		ProfileScope profile(m_profiler, "upload", m_nextBatch);
+		convertToFloat(frameInputA(frame), a, m_numElements, m_hostPool);
+		convertToFloat(frameInputB(frame), b, m_numElements, m_hostPool);
+	}
+	res = submitFrame(frame);
+	return vk::ResultValue<uint64_t>(res, frame.batch);
+}
+
+vk::Result VulkanComputeApplication::waitBatch(uint64_t batch, float* result) {
+	if (m_frames.empty()) {
+		return vk::Result::eErrorInitializationFailed;
+	}
+	ComputeFrame &frame = m_frames[batch % m_frames.size()];
+	if (!frame.pending || frame.batch != batch) {
+		TRACE_FULL("batch is not in flight");
+		return vk::Result::eIncomplete;
+	}
+	// host batches already finished in submitFrame()
+	const bool onDevice = m_backend == ComputeBackend::eGpu;
+	if (onDevice) {
+		vk::Result res;
+		{
+			ProfileScope profile(m_profiler, "wait", batch);
+			res = m_device.waitForFences(1, &frame.fence, VK_TRUE, UINT64_MAX);
+		}
+		if (res != vk::Result::eSuccess) {
+			return res;
+		}
+		m_device.resetFences(1, &frame.fence);
+	}
+	frame.pending = false;
+	m_lastCompletedBatch = batch;
+	m_hasResult = true;
+	if (onDevice && m_profiler.gpuEnabled() && !m_calibrating) {
+		m_profiler.collect(frame.profileScope, batch, frame.submitMs);
+		if (m_useTransferQueue) m_profiler.collect(frame.transferProfileScope, batch, frame.submitMs);
+	}
+
+	ProfileScope profile(m_profiler, "readback", batch);
+	if (onDevice && m_memoryMode == MemoryMode::eDeviceLocal) {
+		m_readbackBuffer.invalidate(); // host cached memory may not be coherent
+	}
+	if (onDevice && m_validator.enabled() && !m_calibrating) {
+		validateFrame(frame);
+	}
+	if (result) {
+		parallelCopy(result, frameOutput(frame), m_bufferSize, m_hostPool);
+	}
+	return vk::Result::eSuccess;
+}
+
+void VulkanComputeApplication::validateFrame(const ComputeFrame &frame) {
+	ProfileScope profile(m_profiler, "validate", frame.batch);
+	// the inputs are still in the frame, mapped or in its staging slices
+	const float* a = frameInputA(frame);
+	const float* b = frameInputB(frame);
+	ValidationReport report = m_validator.check(frameOutput(frame), m_numElements, frame.batch * m_numElements,
+		[a, b](size_t begin, size_t end, float* expected) {
+			CpuKernels::apply(ElementwiseOp::eAdd, a + begin, b + begin, a + begin, 0.0f, expected, end - begin);
+		});
+	if (!report.passed()) {
+		TRACE_FULL("batch " + std::to_string(frame.batch) + " " + report.summary());
+	}
+	m_validationReport.merge(report, m_validator.settings().maxReported);
+}
+
+vk::Result VulkanComputeApplication::stream(uint64_t batchCount, const BatchFill &fill, const BatchDrain &drain) {
+	if (!m_initialized) {
+		TRACE_FULL("VulkanComputeApplication not fully initialized. aborting.");
+		return vk::Result::eErrorInitializationFailed;
+	}
+	vk::Result framesRes = ensureFrames();
+	if (framesRes != vk::Result::eSuccess) return framesRes;
+	// drain only sees the batches of this call, earlier ones belong to whoever submitted them
+	for (const ComputeFrame &frame : m_frames) {
+		if (frame.pending) {
+			TRACE_FULL("batch " + std::to_string(frame.batch) + " has to be waited for before streaming");
+			return vk::Result::eNotReady;
+		}
+	}
+	// batch k+1 is filled while the GPU runs batch k and batch k-1 is drained
+	auto collect = [&](ComputeFrame &frame) {
+		uint64_t batch = frame.batch;
+		vk::Result res = waitBatch(batch);
+		if (res == vk::Result::eSuccess && drain) {
+			ProfileScope profile(m_profiler, "drain", batch);
+			drain(batch, frameOutput(frame));
+		}
+		return res;
+	};
+	for (uint64_t i = 0; i < batchCount; i++) {
+		ComputeFrame &frame = nextFrame();
+		if (frame.pending) {
+			vk::Result res = collect(frame);
+			if (res != vk::Result::eSuccess) return res;
+		}
+		if (fill) {
+			ProfileScope profile(m_profiler, "upload", m_nextBatch);
+			fill(m_nextBatch, frameInputA(frame), frameInputB(frame));
+		}
+		vk::Result res = submitFrame(frame);
+		if (res != vk::Result::eSuccess) return res;
+	}
+	// drain whatever is still in flight, oldest first
+	for (uint64_t i = 0; i < m_frames.size(); i++) {
+		ComputeFrame &frame = m_frames[(m_nextBatch + i) % m_frames.size()];
+		if (frame.pending) {
+			vk::Result res = collect(frame);
+			if (res != vk::Result::eSuccess) return res;
+		}
+	}
+	return vk::Result::eSuccess;
+}
+
+vk::Result VulkanComputeApplication::streamFiles(const std::string &inputA, const std::string &inputB, const std::string &outputPath) {
+	if (!m_initialized) {
+		TRACE_FULL("VulkanComputeApplication not fully initialized. aborting.");
+		return vk::Result::eErrorInitializationFailed;
+	}
+	MappedFile fileA, fileB, output;
+	if (!fileA.openRead(inputA) || !fileB.openRead(inputB)) {
+		return vk::Result::eErrorInitializationFailed;
+	}
+	if (fileA.size() != fileB.size() || fileA.size() % sizeof(float) != 0) {
+		TRACE_FULL("input files must hold the same number of floats");
+		return vk::Result::eErrorInitializationFailed;
+	}
+	if (!output.create(outputPath, fileA.size())) {
+		return vk::Result::eErrorInitializationFailed;
+	}
+
+	return streamRange(static_cast<const float*>(fileA.data()), static_cast<const float*>(fileB.data()),
+		static_cast<float*>(output.data()), fileA.size() / sizeof(float));
+}
+
+vk::Result VulkanComputeApplication::streamRange(const float* srcA, const float* srcB, float* dst, uint64_t totalElements) {
+	if (!m_initialized) {
+		TRACE_FULL("VulkanComputeApplication not fully initialized. aborting.");
+		return vk::Result::eErrorInitializationFailed;
+	}
+	// the first batch may choose the backend and restart the batch numbers, see chooseBackend()
+	vk::Result framesRes = ensureFrames();
+	if (framesRes != vk::Result::eSuccess) return framesRes;
+	const uint64_t tileCount = (totalElements + m_numElements - 1) / m_numElements;
+	const uint64_t firstBatch = m_nextBatch;
+	auto tileElements = [&](uint64_t tile) {
+		return static_cast<size_t>(std::min<uint64_t>(m_numElements, totalElements - tile * m_numElements));
+	};
+
+	// the last tile is zero padded, only its valid part is written back
+	return stream(tileCount, [&](uint64_t batch, float* a, float* b) {
+		uint64_t tile = batch - firstBatch;
+		size_t count = tileElements(tile);
+		parallelCopy(a, srcA + tile * m_numElements, count * sizeof(float), m_hostPool);
+		parallelCopy(b, srcB + tile * m_numElements, count * sizeof(float), m_hostPool);
+		if (count < m_numElements) {
+			memset(a + count, 0, (m_numElements - count) * sizeof(float));
+			memset(b + count, 0, (m_numElements - count) * sizeof(float));
+		}
+	}, [&](uint64_t batch, const float* result) {
+		uint64_t tile = batch - firstBatch;
+		parallelCopy(dst + tile * m_numElements, result, tileElements(tile) * sizeof(float), m_hostPool);
+	});
+}
+
+void VulkanComputeApplication::fillRandom(uint64_t batch, float* a, float* b) {
+	// A and B are two Philox streams, batch k covers elements [k * n, (k + 1) * n) of each
+	const uint64_t offset = batch * m_numElements;
+	fillUniform(a, m_numElements, m_seed, offset, 1.0f, 10.0f, m_hostPool);
+	fillUniform(b, m_numElements, m_seed ^ 0x9E3779B97F4A7C15ull, offset, 1.0f, 10.0f, m_hostPool);
+}
+
+std::vector<float> VulkanComputeApplication::getResult() {
+	ResultView view = resultView();
+	return std::vector<float>(view.begin(), view.end());
+}
+
+ResultView VulkanComputeApplication::resultView() {
+	ResultView view;
+	if (!m_initialized || !m_hasResult) {
+		TRACE_FULL("no finished batch to read back. aborting.");
+		return view;
+	}
+	// waitBatch already invalidated non coherent readback memory
+	view.data = frameOutput(m_frames[m_lastCompletedBatch % m_frames.size()]);
+	view.size = m_numElements;
+	return view;
+}
+
+vk::Result VulkanComputeApplication::copyResult(float* dst) {
+	ResultView view = resultView();
+	if (view.empty()) return vk::Result::eNotReady;
+	parallelCopy(dst, view.data, view.size * sizeof(float), m_hostPool);
+	return vk::Result::eSuccess;
+}
+
+bool writeResult(const std::string &path, const ResultView &result, ResultFormat format) {
+	const size_t bytes = result.size * sizeof(float);
+	if (format == ResultFormat::eMapped) {
+		MappedFile file;
+		if (!file.create(path, bytes)) return false;
+		if (bytes) memcpy(file.data(), result.data, bytes);
+		return true;
+	}
+
+	std::ofstream file(path, format == ResultFormat::eBinary ? std::ios::binary | std::ios::trunc : std::ios::trunc);
+	if (!file.is_open()) {
+		TRACE_FULL("unable to write " + path);
+		return false;
+	}
+	if (format == ResultFormat::eBinary) {
+		file.write(reinterpret_cast<const char*>(result.data), bytes);
+	}
+	else {
+		// '\n' instead of std::endl, the stream flushes once its buffer is full rather than per value
+		for (float f : result) {
+			file << f << '\n';
+		}
+	}
+	return file.good();
+}
+
+#pragma region helperfunctions
+std::vector<char> readFile(const std::string& filename) {
+	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open()) {
+		throw std::runtime_error(ERRORSTRING("failed to open file!"));
+	}
+
+	size_t fileSize = (size_t)file.tellg();
+	std::vector<char> buffer(fileSize);
+
+	file.seekg(0);
+	file.read(buffer.data(), fileSize);
+
+	file.close();
+
+	return buffer;
+}
+
+vk::ResultValue<vk::ShaderModule> createShaderModuleFromFile(const vk::Device &device, const std::string &file) {
+	try {
+		return createShaderModule(device, readFile(file));
+	}
+	catch (const std::runtime_error& e) {
+		TRACE_FULL(e.what());
+		return vk::ResultValue<vk::ShaderModule>(vk::Result::eIncomplete, vk::ShaderModule());
+	}
+}
+
+bool isPipelineCacheCompatible(const std::vector<char> &data, const vk::PhysicalDeviceProperties &props) {
+	// header layout: length, version, vendorID, deviceID, pipelineCacheUUID
+	const size_t headerSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+	if (data.size() < headerSize) return false;
+	uint32_t header[4];
+	memcpy(header, data.data(), sizeof(header));
+	if (header[0] < headerSize || header[0] > data.size()) return false;
+	if (header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) return false;
+	if (header[2] != props.vendorID || header[3] != props.deviceID) return false;
+	return memcmp(data.data() + sizeof(header), &props.pipelineCacheUUID[0], VK_UUID_SIZE) == 0;
+}
+
+vk::ResultValue<vk::ShaderModule> createShaderModule(const vk::Device &device, const std::vector<char>& code) {
+	vk::ShaderModuleCreateInfo createInfo = vk::ShaderModuleCreateInfo()
+		.setCodeSize(code.size())
+		.setPCode(reinterpret_cast<const uint32_t*>(code.data()));
+	vk::ShaderModule module;
+	vk::Result result = device.createShaderModule(&createInfo, nullptr, &module);
+	return vk::ResultValue<vk::ShaderModule>(result, module);
+}
+
+vk::ResultValue<uint32_t> findMemoryTypeIndex(vk::PhysicalDevice device, vk::DeviceSize size, vk::MemoryPropertyFlags flags, uint32_t memoryTypeBits) {
+	vk::PhysicalDeviceMemoryProperties props = device.getMemoryProperties();
+	for (uint32_t i = 0; i < props.memoryTypeCount; i++) {
+		const vk::MemoryType memType = props.memoryTypes[i];
+		if (!(memoryTypeBits & (1u << i))) continue;
+		if ((memType.propertyFlags & flags) == flags && props.memoryHeaps[memType.heapIndex].size > size) {
+			return vk::ResultValue<uint32_t>(vk::Result::eSuccess, i);
+		}
+	}
+	uint32_t ret = 0;
+	return vk::ResultValue<uint32_t>(vk::Result::eIncomplete, ret);
+}
+
+MemoryMode resolveMemoryMode(vk::PhysicalDevice device, MemoryMode requested) {
+	if (requested != MemoryMode::eAuto) return requested;
+	// discrete GPUs expose device local memory that is not host visible, UMA devices don't
+	vk::PhysicalDeviceMemoryProperties props = device.getMemoryProperties();
+	for (uint32_t i = 0; i < props.memoryTypeCount; i++) {
+		const vk::MemoryPropertyFlags flags = props.memoryTypes[i].propertyFlags;
+		if ((flags & vk::MemoryPropertyFlagBits::eDeviceLocal) && !(flags & vk::MemoryPropertyFlagBits::eHostVisible)) {
+			return MemoryMode::eDeviceLocal;
+		}
+	}
+	return MemoryMode::eHostVisible;
+}
+
+uint32_t chooseWorkGroupSize(const vk::PhysicalDeviceLimits &limits, uint32_t requested) {
+	const uint32_t defaultWorkGroupSize = 256;
+	uint32_t maxSize = std::min(limits.maxComputeWorkGroupSize[0], limits.maxComputeWorkGroupInvocations);
+	uint32_t size = requested > 0 ? requested : defaultWorkGroupSize;
+	if (size > maxSize) {
+		TRACE_FULL("requested workgroup size exceeds device limits, clamping");
+		size = maxSize;
+	}
+	return std::max(size, 1u);
+}
+
+uint32_t computeGroupCount(const vk::PhysicalDeviceLimits &limits, uint32_t numElements, uint32_t workGroupSize) {
+	// ceil(n / local_size), capped by the device limit. the kernel walks the rest with a grid-stride loop
+	uint64_t groups = (static_cast<uint64_t>(numElements) + workGroupSize - 1) / workGroupSize;
+	groups = std::min<uint64_t>(groups, limits.maxComputeWorkGroupCount[0]);
+	return static_cast<uint32_t>(std::max<uint64_t>(groups, 1));
+}
+
+uint32_t chooseVectorsPerInvocation(uint32_t numElements, vk::DeviceSize offsetAlignment, uint32_t workGroupSize) {
+	// vec4 views of the buffers need 16 byte aligned descriptor offsets
+	if (offsetAlignment % 16 != 0) return 0;
+	// fewer than one vec4 per invocation of a single workgroup gains nothing over the scalar kernel
+	const uint64_t vectors = numElements / 4;
+	if (vectors < workGroupSize) return 0;
+	// more independent loads per invocation once there are enough of them for a few hundred workgroups
+	const uint64_t perWorkGroups = static_cast<uint64_t>(workGroupSize) * 256;
+	if (vectors >= perWorkGroups * 4) return 4;
+	if (vectors >= perWorkGroups * 2) return 2;
+	return 1;
+}
+
+bool checkDeviceExtensionSupport(vk::PhysicalDevice device, std::vector<std::string> requiredExtensions) {
+	std::vector<vk::ExtensionProperties> availableExtensions = device.enumerateDeviceExtensionProperties();
+
+	std::set<std::string> setRequiredExtensions(requiredExtensions.begin(), requiredExtensions.end());
+	for (const auto& ext : availableExtensions) {
+		setRequiredExtensions.erase(ext.extensionName);
+	}
+	return setRequiredExtensions.empty();
+}
+
+vk::ResultValue<uint32_t> findQueueFamilyIndex(vk::PhysicalDevice device) {
+	uint32_t index = 0;
+	vk::Result res = vk::Result::eIncomplete;
+	std::vector<vk::QueueFamilyProperties> props = device.getQueueFamilyProperties();
+
+	uint32_t i = 0;
+	for (const auto& queueFamily : props) {
+		if (queueFamily.queueCount > 0 && 
+			queueFamily.queueFlags & vk::QueueFlagBits::eCompute /*&& 
+			!((queueFamily.queueFlags & vk::QueueFlagBits::eTransfer) || (queueFamily.queueFlags & vk::QueueFlagBits::eSparseBinding))*/) {
+			res = vk::Result::eSuccess;
+			index = i;
+			break;
+		}
+		i++;
+	}
+	
+	return vk::ResultValue<uint32_t>(res, index);
+}
+
+std::vector<uint32_t> findComputeQueueFamilies(vk::PhysicalDevice device) {
+	// in family order, so the first one is the family findQueueFamilyIndex picks
+	std::vector<uint32_t> families;
+	std::vector<vk::QueueFamilyProperties> props = device.getQueueFamilyProperties();
+	for (uint32_t i = 0; i < props.size(); i++) {
+		if (props[i].queueCount > 0 && (props[i].queueFlags & vk::QueueFlagBits::eCompute)) {
+			families.push_back(i);
+		}
+	}
+	return families;
+}
+
+vk::ResultValue<uint32_t> findTransferQueueFamilyIndex(vk::PhysicalDevice device) {
+	// a dedicated transfer family usually maps to the copy engines of discrete GPUs
+	uint32_t index = 0;
+	vk::Result res = vk::Result::eIncomplete;
+	std::vector<vk::QueueFamilyProperties> props = device.getQueueFamilyProperties();
+
+	for (uint32_t i = 0; i < props.size(); i++) {
+		const vk::QueueFlags flags = props[i].queueFlags;
+		if (props[i].queueCount > 0 && (flags & vk::QueueFlagBits::eTransfer) &&
+			!(flags & (vk::QueueFlagBits::eCompute | vk::QueueFlagBits::eGraphics))) {
+			res = vk::Result::eSuccess;
+			index = i;
+			break;
+		}
+	}
+
+	return vk::ResultValue<uint32_t>(res, index);
+}
+
+bool isDeviceSuitable(vk::PhysicalDevice device, std::vector<std::string> requiredExtensions) {
+	auto res = findQueueFamilyIndex(device);
+	if (res.result != vk::Result::eSuccess) {
+		return false;
+	}
+	return checkDeviceExtensionSupport(device, requiredExtensions);
+}
+
+std::vector<const char*> getRequiredExtensions() {
+	std::vector<const char*> extensions;
+#ifdef _DEBUG
+	extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+#endif
+	return extensions;
+}
+
+bool checkValidationLayerSupport(const std::vector<const char*> &validationLayers) {
+	std::vector<vk::LayerProperties> availableLayers = vk::enumerateInstanceLayerProperties();
+
+	for (const char* layerName : validationLayers) {
+		bool layerFound = false;
+
+		for (const auto& layerProperties : availableLayers) {
+			if (strcmp(layerName, layerProperties.layerName) == 0) {
+				layerFound = true;
+				break;
+			}
+		}
+
+		if (!layerFound) {
+			return false;
+		}
+	}
+
+	return true;
+}
 #pragma endregion endhelperfunctions
\ No newline at end of file
@@ -1,107 +1,373 @@
-#ifndef VULKAN_COMPUTE_H
-#define VULKAN_COMPUTE_H
-
-#include <vulkan/vulkan.hpp>
-#include <glm/glm.hpp>
-
-#include "BufferExtension.h"
-#include "Helpers.h"
-
-std::vector<const char*> getRequiredExtensions();
-static std::vector<char> readFile(const std::string& filename);
-vk::ResultValue<uint32_t> findQueueFamilyIndex(vk::PhysicalDevice device);
-bool checkValidationLayerSupport(const std::vector<const char*> &validationLayers);
-vk::ResultValue<vk::ShaderModule> createShaderModule(const vk::Device &device, const std::vector<char>& code);
-vk::ResultValue<vk::ShaderModule> createShaderModuleFromFile(const vk::Device &device, const std::string &file);
-bool isDeviceSuitable(vk::PhysicalDevice device, std::vector<std::string> requiredExtensions);
-bool checkDeviceExtensionSupport(vk::PhysicalDevice device, std::vector<std::string> requiredExtensions);
-vk::ResultValue<uint32_t> findMemoryTypeIndex(vk::PhysicalDevice device, vk::DeviceSize size, vk::MemoryPropertyFlags flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-
-
-class VulkanComputeApplication {
-public:
-	vk::Result init() {
-		vk::Result res = vk::Result::eSuccess;
-		res = initInstance();
-		if (res != vk::Result::eSuccess) return res;
-		res = createDevice();
-		if (res != vk::Result::eSuccess) return res;
-		res = createBuffers();
-		if (res != vk::Result::eSuccess) return res;
-		res = createPipeline();
-		if (res != vk::Result::eSuccess) return res;
-		res = createCommandBuffer();
-		if (res == vk::Result::eSuccess) m_initialized = true;
-		return res;
-	}
-
-	void run() {
-		if (!m_initialized) {
-			TRACE_FULL("VulkanComputeApplication not fully initialized. aborting.");
-			return;
-		}
-		fillInputBuffersRandom();
-		vk::SubmitInfo submitInfo = vk::SubmitInfo()
-			.setCommandBufferCount(1)
-			.setPCommandBuffers(&m_commandBuffer);
-		m_queue.submit(submitInfo, nullptr);
-		m_queue.waitIdle();
-	}
-
-	std::vector<float> getResult();
-
-	~VulkanComputeApplication(){
-		cleanup();
-	}
-
-private:
-	/* Members */	
-	bool m_initialized;
-	std::vector<const char*> m_validationLayers = {
-		"VK_LAYER_LUNARG_standard_validation"
-	};
-
-	vk::Instance m_instance;
-	vk::PhysicalDevice m_physicalDevice;
-	vk::Device m_device;
-
-	uint32_t m_queueFamIndex;
-	vk::Queue m_queue;
-
-	vk::Pipeline m_pipeline;
-	vk::PipelineLayout m_pipelineLayout;
-
-	vk::CommandPool m_commandPool;
-	vk::CommandBuffer m_commandBuffer;
-
-	vk::DescriptorPool m_descriptorPool;
-
-	vk::DescriptorSet m_descriptorSet;
-	vk::DescriptorSetLayout m_descriptorSetLayout;
-
-	std::vector<std::string> m_requiredExtensions;
-
-	vk::DeviceMemory m_valuesBufferMemory;
-	vkExt::SharedMemory m_sharedBufferMemory;
-	vkExt::Buffer m_inputBufferA;
-	vkExt::Buffer m_inputBufferB;
-	vkExt::Buffer m_outputBuffer;
-	uint32_t m_numElements = 1024*1024;
-	uint32_t m_bufferSize = sizeof(float) * m_numElements;
-	uint32_t m_memorySize = m_bufferSize * 3;
-	uint32_t m_outputOffset = m_bufferSize * 2;
-	uint32_t m_numElemsPushConstantSize = sizeof(glm::vec4);
-
-	/* functions */
-	vk::Result initInstance();
-	vk::Result createDevice();
-	vk::Result createBuffers();
-	vk::Result createPipeline();
-	vk::Result createCommandBuffer();
-
-	void fillInputBuffersRandom();
-
-	void cleanup();
-};
-
+#ifndef VULKAN_COMPUTE_H
+#define VULKAN_COMPUTE_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <functional>
+
+#include "BufferExtension.h"
+#include "ComputeKernel.h"
+#include "Helpers.h"
+#include "HostPrep.h"
+#include "JobScheduler.h"
+#include "MappedFile.h"
+#include "Profiler.h"
+#include "SharedDevice.h"
+#include "TaskGraph.h"
+#include "Validation.h"
+
+std::vector<const char*> getRequiredExtensions();
+std::vector<char> readFile(const std::string& filename);
+vk::ResultValue<uint32_t> findQueueFamilyIndex(vk::PhysicalDevice device);
+std::vector<uint32_t> findComputeQueueFamilies(vk::PhysicalDevice device);
+bool checkValidationLayerSupport(const std::vector<const char*> &validationLayers);
+vk::ResultValue<vk::ShaderModule> createShaderModule(const vk::Device &device, const std::vector<char>& code);
+vk::ResultValue<vk::ShaderModule> createShaderModuleFromFile(const vk::Device &device, const std::string &file);
+bool isPipelineCacheCompatible(const std::vector<char> &data, const vk::PhysicalDeviceProperties &props);
+bool isDeviceSuitable(vk::PhysicalDevice device, std::vector<std::string> requiredExtensions);
+bool checkDeviceExtensionSupport(vk::PhysicalDevice device, std::vector<std::string> requiredExtensions);
+vk::ResultValue<uint32_t> findTransferQueueFamilyIndex(vk::PhysicalDevice device);
+vk::ResultValue<uint32_t> findMemoryTypeIndex(vk::PhysicalDevice device, vk::DeviceSize size, vk::MemoryPropertyFlags flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, uint32_t memoryTypeBits = ~0u);
+uint32_t chooseWorkGroupSize(const vk::PhysicalDeviceLimits &limits, uint32_t requested);
+uint32_t computeGroupCount(const vk::PhysicalDeviceLimits &limits, uint32_t numElements, uint32_t workGroupSize);
+// vec4s per invocation of the a + b kernel, 0 for the scalar kernel. vectorized variants need 16 byte
+// aligned buffer offsets and enough elements to keep every invocation busy
+uint32_t chooseVectorsPerInvocation(uint32_t numElements, vk::DeviceSize offsetAlignment, uint32_t workGroupSize);
+
+enum class MemoryMode {
+	eAuto,			// device local on discrete GPUs, host visible on UMA / integrated devices
+	eHostVisible,	// all buffers live in one host visible, host coherent allocation
+	eDeviceLocal	// working buffers in device local memory, filled and read back through staging buffers
+};
+
+enum class ComputeBackend {
+	eAuto,	// batches run on the device, or on the host when there is none or the host measured faster on the first batch
+	eGpu,	// init() fails without a suitable device
+	eCpu	// batches always run on the host, no Vulkan instance or device is created
+};
+
+// fastest measured round trip of one batch, submit to readback, 0 if it was not measured
+struct BackendCosts {
+	double gpuMs = 0.0;
+	double cpuMs = 0.0;
+};
+
+struct ComputeSettings {
+	// elements per batch
+	uint32_t numElements = 1024 * 1024;
+	// local_size_x of the compute kernel. 0 lets the application pick one from the device limits
+	uint32_t workGroupSize = 0;
+	// vec4 variants of the kernel with 4 to 16 elements per invocation where size and alignment allow,
+	// false always runs the scalar kernel
+	bool vectorize = true;
+	MemoryMode memoryMode = MemoryMode::eAuto;
+	// number of batches that can be in flight at once. every frame owns its own buffer slices,
+	// descriptor set and command buffers, so the host can fill and drain while the GPU is busy
+	uint32_t framesInFlight = 3;
+	// compiled pipelines are loaded from and saved to this file, empty disables the disk cache
+	std::string pipelineCachePath = "pipeline_cache.bin";
+	// records host timings and GPU timestamps of every stage, see profiler()
+	bool profile = false;
+	// threads for input generation and host copies, 0 uses every hardware thread
+	uint32_t hostThreads = 0;
+	// seed of the random inputs, 0 draws one from std::random_device
+	uint64_t seed = 0;
+	// index into the suitable physical devices, in enumeration order
+	uint32_t deviceIndex = 0;
+	// host threads submitting scheduler() jobs, 0 starts one per compute queue
+	uint32_t submitThreads = 0;
+	// instance and device are shared with every other application in the process on the same device
+	bool shareDevice = true;
+	// where batches run, see ComputeBackend. kernels, task graphs and the scheduler always need the device
+	ComputeBackend backend = ComputeBackend::eAuto;
+	// checks a sample of every batch computed on the device against the host, see validationReport()
+	ValidationSettings validation;
+	// record kernel buffers with VK_KHR_push_descriptor where the device has it, descriptor sets otherwise
+	bool pushDescriptors = true;
+};
+
+// per batch resources, indexed by batch % framesInFlight
+struct ComputeFrame {
+	vk::DescriptorSet descriptorSet;
+	vk::CommandBuffer commandBuffer;
+	vk::CommandBuffer transferCommandBuffer;
+	vk::Semaphore uploadSemaphore;
+	vk::Fence fence;
+	vk::DeviceSize sliceOffset = 0;		// byte offset of this frame in the values and readback buffers
+	vk::DeviceSize stagingOffsetA = 0;
+	vk::DeviceSize stagingOffsetB = 0;
+	uint64_t batch = 0;
+	bool pending = false;
+	uint32_t profileScope = 0;
+	uint32_t transferProfileScope = 0;
+	double submitMs = 0.0;
+};
+
+// fill(batch, inputA, inputB) writes one batch worth of inputs, drain(batch, output) consumes the result
+typedef std::function<void(uint64_t, float*, float*)> BatchFill;
+typedef std::function<void(uint64_t, const float*)> BatchDrain;
+
+MemoryMode resolveMemoryMode(vk::PhysicalDevice device, MemoryMode requested);
+
+// non-owning view of a finished batch in mapped (and invalidated) memory.
+// valid until its frame is submitted again or the application is destroyed
+struct ResultView {
+	const float* data = nullptr;
+	size_t size = 0;
+
+	const float* begin() const { return data; }
+	const float* end() const { return data + size; }
+	const float& operator[](size_t i) const { return data[i]; }
+	bool empty() const { return size == 0; }
+};
+
+enum class ResultFormat {
+	eText,		// one value per line
+	eBinary,	// raw little endian floats
+	eMapped		// raw floats written through a memory mapped file
+};
+
+bool writeResult(const std::string &path, const ResultView &result, ResultFormat format);
+
+
+class VulkanComputeApplication {
+public:
+	VulkanComputeApplication(ComputeSettings settings = ComputeSettings())
+		: m_settings(settings), m_hostPool(settings.hostThreads), m_profiler(settings.profile), m_validator(settings.validation, m_hostPool) {}
+
+	vk::Result init() {
+		ProfileScope profile(m_profiler, "init");
+		if (m_settings.backend == ComputeBackend::eCpu) return initHost();
+		vk::Result res = vk::Result::eSuccess;
+		res = createDevice();
+		if (res != vk::Result::eSuccess) {
+			// without a suitable device eAuto runs the batches on the host
+			if (m_settings.backend == ComputeBackend::eAuto) return initHost();
+			return res;
+		}
+		m_hasDevice = true;
+		res = createPipelineCache();
+		if (res != vk::Result::eSuccess) return res;
+		res = configureBatches();
+		if (res != vk::Result::eSuccess) return res;
+		res = createPipeline();
+		if (res != vk::Result::eSuccess) return res;
+		res = createCommandPool();
+		if (res != vk::Result::eSuccess) return res;
+		// batch buffers and frames are only created by the first batch, see ensureFrames()
+		res = m_scheduler.init(m_device, m_computeQueues, m_settings.submitThreads);
+		if (res != vk::Result::eSuccess) return res;
+		m_initialized = true;
+		// eAuto times both backends on the first batch, see chooseBackend()
+		m_calibrate = m_settings.backend == ComputeBackend::eAuto;
+		return vk::Result::eSuccess;
+	}
+
+	// runs a single batch of random inputs and waits for it
+	void run() {
+		if (!m_initialized) {
+			TRACE_FULL("VulkanComputeApplication not fully initialized. aborting.");
+			return;
+		}
+		if (ensureFrames() != vk::Result::eSuccess) return;
+		ComputeFrame &frame = nextFrame();
+		if (frame.pending) {
+			waitBatch(frame.batch);
+		}
+		{
+			ProfileScope profile(m_profiler, "upload", m_nextBatch);
+			fillRandom(m_nextBatch, frameInputA(frame), frameInputB(frame));
+		}
+		if (submitFrame(frame) == vk::Result::eSuccess) {
+			waitBatch(frame.batch);
+		}
+	}
+
+	// copies batchSize() elements of a and b into the next frame and submits it.
+	// returns eNotReady if that frame still holds a batch that has not been waited for
+	vk::ResultValue<uint64_t> submitBatch(const float* a, const float* b);
+	// the same for double inputs, converted while copying
+	vk::ResultValue<uint64_t> submitBatch(const double* a, const double* b);
+	// blocks until the batch has finished and optionally copies its batchSize() results
+	vk::Result waitBatch(uint64_t batch, float* result = nullptr);
+	// streams batchCount batches, keeping framesInFlight of them on the GPU.
+	// inputs are written in place into the frame buffers and results are drained in batch order.
+	// returns eNotReady if a batch of submitBatch() has not been waited for yet
+	vk::Result stream(uint64_t batchCount, const BatchFill &fill, const BatchDrain &drain);
+	// out of core a + b over two raw float files of equal size, written to outputPath as raw floats.
+	// all three files are memory mapped and streamed through the frames in batchSize() tiles,
+	// so they can be far larger than device memory or maxStorageBufferRange
+	vk::Result streamFiles(const std::string &inputA, const std::string &inputB, const std::string &outputPath);
+	// the same over host memory: dst[i] = srcA[i] + srcB[i] for count elements, in batchSize() tiles
+	vk::Result streamRange(const float* srcA, const float* srcB, float* dst, uint64_t count);
+
+	// batchSize() uniform random inputs in [1, 10) for a batch. the values only depend on the seed
+	// and the batch number, so runs are reproducible whatever the thread count
+	void fillRandom(uint64_t batch, float* a, float* b);
+
+	// result of the last batch that was waited for
+	std::vector<float> getResult();
+	// the same without a copy, see ResultView
+	ResultView resultView();
+	// copies batchSize() results of the last batch into dst
+	vk::Result copyResult(float* dst);
+
+	// where batches run, eGpu or eCpu. with eAuto only final once the first batch was submitted
+	ComputeBackend backend() const { return m_backend; }
+	// the measurements eAuto chose the backend from
+	const BackendCosts& backendCosts() const { return m_backendCosts; }
+	// false if init() found no suitable device, everything but the batches is unavailable then
+	bool hasDevice() const { return m_hasDevice; }
+	vk::PhysicalDevice physicalDevice() const { return m_physicalDevice; }
+	vk::Device device() const { return m_device; }
+	// number of physical devices that could run the kernel, valid after init()
+	uint32_t suitableDeviceCount() const { return m_suitableDeviceCount; }
+	// optional features enabled on the device, valid after init() with a device
+	const DeviceFeatures& features() const { return m_shared->features(); }
+	MemoryMode memoryMode() const { return m_memoryMode; }
+	uint32_t workGroupSize() const { return m_workGroupSize; }
+	uint32_t groupCount() const { return m_groupCount; }
+	// vec4s per invocation of the selected kernel variant, 0 for the scalar kernel
+	uint32_t vectorsPerInvocation() const { return m_vectorsPerInvocation; }
+	uint32_t batchSize() const { return m_numElements; }
+	uint32_t framesInFlight() const { return static_cast<uint32_t>(m_frames.size()); }
+	vkExt::MemoryStats memoryStats() const { return m_allocator.stats(); }
+	// further kernels can be loaded here, they share the device, pipeline cache and layouts
+	KernelRegistry& kernels() { return m_kernels; }
+	// threads for input generation and host copies, also builds pipelines in KernelRegistry::loadAll()
+	ThreadPool& hostPool() { return m_hostPool; }
+
+	// storage buffers for additional kernels and task graphs, sub-allocated like the batch buffers.
+	// both may be called from several threads
+	vk::Result createBuffer(vkExt::Buffer &buffer, vk::DeviceSize size, vk::MemoryPropertyFlags flags = vk::MemoryPropertyFlagBits::eDeviceLocal);
+	void destroyBuffer(vkExt::Buffer &buffer);
+	// compiles the graph, records it into one command buffer on the compute queue and waits for it.
+	// the graph keeps its transient buffers until graph.release() or its destruction, both before the application's
+	vk::Result execute(TaskGraph &graph);
+
+	// independent jobs spread over every compute queue of the device, see JobScheduler
+	JobScheduler& scheduler() { return m_scheduler; }
+	// all queues of all compute capable families, the first one also runs the batches and task graphs
+	const std::vector<ComputeQueue>& computeQueues() const { return m_computeQueues; }
+
+	// host and GPU timings, only filled when ComputeSettings::profile is set
+	Profiler& profiler() { return m_profiler; }
+	// every batch validated so far, empty unless ComputeSettings::validation samples anything.
+	// mismatches are also traced as they are found
+	const ValidationReport& validationReport() const { return m_validationReport; }
+	const Validator& validator() const { return m_validator; }
+
+	~VulkanComputeApplication(){
+		cleanup();
+	}
+
+private:
+	/* Members */	
+	bool m_initialized = false;
+	bool m_hasDevice = false;
+	ComputeSettings m_settings;
+	ComputeBackend m_backend = ComputeBackend::eGpu;
+	BackendCosts m_backendCosts;
+	bool m_calibrate = false;		// eAuto has not chosen yet, the first ensureFrames() does
+	bool m_calibrating = false;		// batches of chooseBackend() skip validation and profiling
+	ThreadPool m_hostPool;
+	uint64_t m_seed = 0;
+	std::shared_ptr<SharedDevice> m_shared;
+	vk::Instance m_instance;
+	vk::PhysicalDevice m_physicalDevice;
+	uint32_t m_suitableDeviceCount = 0;
+	vk::Device m_device;
+
+	uint32_t m_queueFamIndex;
+	vk::Queue m_queue;
+	std::vector<ComputeQueue> m_computeQueues;
+	JobScheduler m_scheduler;
+
+	uint32_t m_transferFamIndex;
+	bool m_useTransferQueue = false;
+	vk::Queue m_transferQueue;
+	vk::CommandPool m_transferCommandPool;
+
+	vk::PipelineCache m_pipelineCache;
+	KernelRegistry m_kernels;
+	// owned by m_kernels
+	const ComputeKernel* m_kernel = nullptr;
+	vk::Pipeline m_pipeline;
+	vk::PipelineLayout m_pipelineLayout;
+	vk::DescriptorSetLayout m_descriptorSetLayout;
+
+	vk::CommandPool m_commandPool;
+
+	vk::DescriptorPool m_descriptorPool;	// one set per frame, unless the kernel uses push descriptors
+
+	std::vector<ComputeFrame> m_frames;
+	bool m_framesCreated = false;
+	uint64_t m_nextBatch = 0;
+	uint64_t m_lastCompletedBatch = 0;
+	bool m_hasResult = false;
+
+	vkExt::MemoryAllocator m_allocator;
+	std::mutex m_allocatorMutex;	// createBuffer() and destroyBuffer() may run concurrently
+	vkExt::Buffer m_inputBufferA;
+	vkExt::Buffer m_inputBufferB;
+	vkExt::Buffer m_outputBuffer;
+
+	// only used with MemoryMode::eDeviceLocal
+	MemoryMode m_memoryMode = MemoryMode::eHostVisible;
+	vkExt::Buffer m_stagingBuffer;
+	vkExt::StagingRing m_stagingRing;
+	vkExt::Buffer m_readbackBuffer;
+
+	// frame slices of the host backend, created by ensureFrames()
+	std::vector<float> m_hostInputA;
+	std::vector<float> m_hostInputB;
+	std::vector<float> m_hostOutput;
+
+	uint32_t m_numElements = 1024*1024;
+	vk::DeviceSize m_bufferSize = sizeof(float) * m_numElements;	// bytes per batch and buffer
+	vk::DeviceSize m_sliceSize = m_bufferSize;					// m_bufferSize aligned for descriptor offsets
+	vk::DeviceSize m_sliceAlignment = 16;						// alignment of the frame slice offsets
+	uint32_t m_vectorsPerInvocation = 0;
+	uint32_t m_workGroupSize = 1;
+	uint32_t m_groupCount = 1;
+
+	Profiler m_profiler;
+	uint32_t m_graphProfileScope = 0;
+
+	Validator m_validator;
+	ValidationReport m_validationReport;
+
+	/* functions */
+	// batches on the host, without any Vulkan objects
+	vk::Result initHost();
+	// times a few batches on both backends, keeps the faster one for the batch size and frees the frames of the other
+	vk::Result chooseBackend();
+	vk::Result createDevice();
+	vk::Result createPipelineCache();
+	void savePipelineCache();
+	// batch sizes and limits, the buffers themselves are created by ensureFrames()
+	vk::Result configureBatches();
+	vk::Result createBuffers();
+	vk::Result createPipeline();
+	vk::Result createCommandPool();
+	vk::Result createCommandBuffers();
+	// creates the batch buffers and per frame resources on first use
+	vk::Result ensureFrames();
+	void destroyFrames();
+	void recordUploads(vk::CommandBuffer commandBuffer, const ComputeFrame &frame);
+	void recordReadback(vk::CommandBuffer commandBuffer, const ComputeFrame &frame);
+	// compares the sampled part of a finished frame with a + b on the host
+	void validateFrame(const ComputeFrame &frame);
+
+	ComputeFrame& nextFrame() { return m_frames[m_nextBatch % m_frames.size()]; }
+	float* frameInputA(const ComputeFrame &frame);
+	float* frameInputB(const ComputeFrame &frame);
+	const float* frameOutput(const ComputeFrame &frame);
+	vk::Result submitFrame(ComputeFrame &frame);
+	// queue families buffers are shared between
+	std::vector<uint32_t> bufferQueueFamilies() const;
+
+	void cleanup();
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,309 @@
+/*
+ * Vulkan Compute Benchmark
+ *
+ * Sweeps batch size, workgroup size and memory mode over the a + b kernel and
+ * writes one JSON record per configuration.
+ *
+ */
+
+#include "CpuBackend.h"
+#include "VulkanCompute.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+namespace {
+	struct BenchOptions {
+		uint32_t minElements = 1024;
+		uint32_t maxElements = 256 * 1024 * 1024;
+		uint32_t sizeStep = 4;
+		std::vector<uint32_t> workGroupSizes = { 32, 64, 128, 256, 512, 1024 };
+		std::vector<MemoryMode> memoryModes = { MemoryMode::eHostVisible, MemoryMode::eDeviceLocal };
+		uint32_t warmup = 3;
+		uint32_t repeats = 20;
+		ComputeBackend backend = ComputeBackend::eGpu;
+		std::string output;
+	};
+
+	struct BenchResult {
+		MemoryMode memoryMode = MemoryMode::eHostVisible;
+		uint32_t elements = 0;
+		uint32_t workGroupSize = 0;
+		uint32_t vectorsPerInvocation = 0;	// 0 for the scalar kernel
+		ComputeBackend backend = ComputeBackend::eGpu;	// where the batches ran
+		BackendCosts costs;
+		std::string status = "ok";
+		std::vector<double> latencyMs;	// submit to readback, per repetition
+		std::vector<double> kernelMs;	// dispatch timestamps, empty without GPU timestamps
+	};
+
+	const char* memoryModeName(MemoryMode mode) {
+		switch (mode) {
+		case MemoryMode::eHostVisible: return "host";
+		case MemoryMode::eDeviceLocal: return "device";
+		default: return "auto";
+		}
+	}
+
+	const char* backendName(ComputeBackend backend) {
+		switch (backend) {
+		case ComputeBackend::eGpu: return "gpu";
+		case ComputeBackend::eCpu: return "cpu";
+		default: return "auto";
+		}
+	}
+
+	std::vector<uint32_t> parseList(const char* arg) {
+		std::vector<uint32_t> values;
+		std::stringstream ss(arg);
+		std::string item;
+		while (std::getline(ss, item, ',')) {
+			values.push_back(static_cast<uint32_t>(strtoul(item.c_str(), nullptr, 10)));
+		}
+		return values;
+	}
+
+	double percentile(std::vector<double> values, double p) {
+		if (values.empty()) return 0.0;
+		std::sort(values.begin(), values.end());
+		size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+		return values[std::min(index, values.size() - 1)];
+	}
+
+	ComputeSettings configSettings(const BenchResult &result, const BenchOptions &options) {
+		ComputeSettings settings;
+		settings.numElements = result.elements;
+		settings.workGroupSize = result.workGroupSize;
+		settings.memoryMode = result.memoryMode;
+		settings.framesInFlight = 1;
+		settings.backend = options.backend;
+		return settings;
+	}
+
+	// dispatch timestamps of a second run with profiling on, so the latencies carry no profiling cost
+	void timeKernel(BenchResult &result, const BenchOptions &options, const std::vector<float> &a, const std::vector<float> &b) {
+		ComputeSettings settings = configSettings(result, options);
+		settings.profile = true;
+		settings.backend = ComputeBackend::eGpu;
+		VulkanComputeApplication app(settings);
+		if (app.init() != vk::Result::eSuccess) return;
+		for (uint32_t i = 0; i < 1 + options.repeats; i++) {
+			if (i == 1) app.profiler().clear();
+			vk::ResultValue<uint64_t> batch = app.submitBatch(a.data(), b.data());
+			if (batch.result != vk::Result::eSuccess || app.waitBatch(batch.value) != vk::Result::eSuccess) return;
+		}
+		for (const auto &event : app.profiler().events()) {
+			if (event.track == ProfileTrack::eCompute && event.name == "dispatch") {
+				result.kernelMs.push_back(event.durationMs);
+			}
+		}
+	}
+
+	void runConfig(BenchResult &result, const BenchOptions &options, const std::vector<float> &a, const std::vector<float> &b, std::vector<float> &out,
+		std::string &deviceName) {
+		{
+			VulkanComputeApplication app(configSettings(result, options));
+			if (app.init() != vk::Result::eSuccess) {
+				result.status = "unsupported";
+				return;
+			}
+			if (deviceName.empty()) {
+				deviceName = app.hasDevice() ? std::string(app.physicalDevice().getProperties().deviceName) : std::string("host (") + cpuSimdName() + ")";
+			}
+			result.vectorsPerInvocation = app.vectorsPerInvocation();
+			if (!app.hasDevice() && result.workGroupSize != options.workGroupSizes.front()) {
+				// the host has no workgroups, one configuration per size is enough
+				result.status = "unsupported";
+				return;
+			}
+			if (app.hasDevice() && app.workGroupSize() != result.workGroupSize) {
+				// clamped to the device limits, already covered by a smaller size
+				result.status = "unsupported";
+				return;
+			}
+
+			for (uint32_t i = 0; i < options.warmup + options.repeats; i++) {
+				auto start = std::chrono::steady_clock::now();
+				vk::ResultValue<uint64_t> batch = app.submitBatch(a.data(), b.data());
+				if (batch.result != vk::Result::eSuccess || app.waitBatch(batch.value, out.data()) != vk::Result::eSuccess) {
+					result.status = "failed";
+					return;
+				}
+				auto end = std::chrono::steady_clock::now();
+				if (i >= options.warmup) {
+					result.latencyMs.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+				}
+			}
+			// eAuto chose the backend on the first batch
+			result.backend = app.backend();
+			result.costs = app.backendCosts();
+
+			// about 64 blocks of the last result against the host, a + b rounds the same on both
+			ValidationSettings validation;
+			validation.sampleRate = std::min(1.0, 64.0 * Validator::BlockSize / result.elements);
+			validation.maxUlps = 0;
+			Validator validator(validation, app.hostPool());
+			const float* inputA = a.data();
+			const float* inputB = b.data();
+			ValidationReport report = validator.check(out.data(), result.elements, 0, [inputA, inputB](size_t begin, size_t end, float* expected) {
+				CpuKernels::apply(ElementwiseOp::eAdd, inputA + begin, inputB + begin, inputA + begin, 0.0f, expected, end - begin);
+			});
+			if (!report.passed()) {
+				std::cerr << report.summary() << std::endl;
+				result.status = "mismatch";
+				return;
+			}
+		}
+		// the first application is gone, so both never hold batch memory at the same time
+		if (result.backend == ComputeBackend::eGpu) {
+			timeKernel(result, options, a, b);
+		}
+	}
+
+	void writeResult(std::ostream &os, const BenchResult &result) {
+		// a + b reads two floats and writes one per element
+		const double bytes = 3.0 * sizeof(float) * result.elements;
+		os << "    { \"memory\": \"" << memoryModeName(result.memoryMode) << "\""
+			<< ", \"elements\": " << result.elements
+			<< ", \"workGroupSize\": " << result.workGroupSize
+			<< ", \"vectorsPerInvocation\": " << result.vectorsPerInvocation
+			<< ", \"backend\": \"" << backendName(result.backend) << "\""
+			<< ", \"status\": \"" << result.status << "\"";
+		if (!result.latencyMs.empty()) {
+			double p50 = percentile(result.latencyMs, 0.5);
+			os << ", \"repeats\": " << result.latencyMs.size()
+				<< ", \"latencyP50Ms\": " << p50
+				<< ", \"latencyP99Ms\": " << percentile(result.latencyMs, 0.99)
+				<< ", \"latencyMinMs\": " << percentile(result.latencyMs, 0.0)
+				<< ", \"elementsPerSecond\": " << result.elements / (p50 / 1000.0)
+				<< ", \"effectiveGBps\": " << bytes / (p50 / 1000.0) / 1.0e9;
+		}
+		if (result.costs.gpuMs > 0.0) {
+			os << ", \"calibrationGpuMs\": " << result.costs.gpuMs
+				<< ", \"calibrationCpuMs\": " << result.costs.cpuMs;
+		}
+		if (!result.kernelMs.empty()) {
+			double p50 = percentile(result.kernelMs, 0.5);
+			os << ", \"kernelP50Ms\": " << p50
+				<< ", \"kernelP99Ms\": " << percentile(result.kernelMs, 0.99)
+				<< ", \"kernelGBps\": " << bytes / (p50 / 1000.0) / 1.0e9;
+		}
+		os << " }";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchOptions options;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--quick") == 0) {
+			// small sweep for CI machines and software rasterizers such as lavapipe
+			options.maxElements = 1024 * 1024;
+			options.workGroupSizes = { 64, 256 };
+			options.warmup = 1;
+			options.repeats = 5;
+			continue;
+		}
+		if (i + 1 >= argc) break;
+		if (strcmp(argv[i], "--min-elements") == 0) {
+			options.minElements = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--max-elements") == 0) {
+			options.maxElements = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--step") == 0) {
+			options.sizeStep = std::max(2u, static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)));
+		}
+		else if (strcmp(argv[i], "--workgroups") == 0) {
+			options.workGroupSizes = parseList(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--memory") == 0) {
+			const char* mode = argv[++i];
+			options.memoryModes.clear();
+			if (strcmp(mode, "device") != 0) options.memoryModes.push_back(MemoryMode::eHostVisible);
+			if (strcmp(mode, "host") != 0) options.memoryModes.push_back(MemoryMode::eDeviceLocal);
+		}
+		else if (strcmp(argv[i], "--warmup") == 0) {
+			options.warmup = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--repeats") == 0) {
+			options.repeats = std::max(1u, static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)));
+		}
+		else if (strcmp(argv[i], "--backend") == 0) {
+			const char* backend = argv[++i];
+			if (strcmp(backend, "cpu") == 0) options.backend = ComputeBackend::eCpu;
+			else if (strcmp(backend, "auto") == 0) options.backend = ComputeBackend::eAuto;
+			else options.backend = ComputeBackend::eGpu;
+		}
+		else if (strcmp(argv[i], "--output") == 0) {
+			options.output = argv[++i];
+		}
+	}
+
+	std::vector<uint32_t> sizes;
+	for (uint64_t n = options.minElements; n <= options.maxElements; n *= options.sizeStep) {
+		sizes.push_back(static_cast<uint32_t>(n));
+	}
+
+	std::vector<BenchResult> results;
+	std::string deviceName;
+	std::vector<float> a, b, out;
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<float> distribution(1.0f, 10.0f);
+	for (uint32_t elements : sizes) {
+		// inputs are generated once per size and shared by all configurations
+		try {
+			a.resize(elements);
+			b.resize(elements);
+			out.resize(elements);
+		}
+		catch (const std::bad_alloc&) {
+			std::cerr << "skipping " << elements << " elements, out of host memory" << std::endl;
+			break;
+		}
+		for (uint32_t i = 0; i < elements; i++) {
+			a[i] = distribution(gen);
+			b[i] = distribution(gen);
+		}
+		for (MemoryMode mode : options.memoryModes) {
+			for (uint32_t workGroupSize : options.workGroupSizes) {
+				BenchResult result;
+				result.memoryMode = mode;
+				result.elements = elements;
+				result.workGroupSize = workGroupSize;
+				runConfig(result, options, a, b, out, deviceName);
+				std::cerr << memoryModeName(mode) << " n=" << elements << " wg=" << workGroupSize << ": " << result.status;
+				if (!result.latencyMs.empty()) std::cerr << ", p50 " << percentile(result.latencyMs, 0.5) << " ms";
+				std::cerr << "\n";
+				results.push_back(result);
+			}
+		}
+	}
+
+	std::ofstream file;
+	if (!options.output.empty()) {
+		file.open(options.output, std::ios::trunc);
+		if (!file.is_open()) {
+			std::cerr << "unable to open " << options.output << std::endl;
+			return 1;
+		}
+	}
+	std::ostream &os = options.output.empty() ? std::cout : file;
+	os << "{\n  \"device\": \"" << deviceName << "\",\n  \"results\": [";
+	for (size_t i = 0; i < results.size(); i++) {
+		os << (i == 0 ? "\n" : ",\n");
+		writeResult(os, results[i]);
+	}
+	os << "\n  ]\n}\n";
+
+	// fail the CI job if nothing ran at all or any result was wrong
+	bool anyOk = std::any_of(results.begin(), results.end(), [](const BenchResult &r) { return r.status == "ok"; });
+	bool anyMismatch = std::any_of(results.begin(), results.end(), [](const BenchResult &r) { return r.status == "mismatch"; });
+	return anyOk && !anyMismatch ? 0 : 1;
+}
\ No newline at end of file
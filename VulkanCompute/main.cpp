@@ -1,28 +1,138 @@
-/*
- * Vulkan Compute Program
- * 
- * Created by Patrick Gantner
- *
- */
-
-#include "VulkanCompute.h"
-
-#include <fstream>
-
-int main()
-{
-	auto app = VulkanComputeApplication();
-	app.init();
-	app.run();
-
-	auto result = app.getResult();
-	std::fstream out;
-	out.open("result.txt", std::fstream::out);
-	if (out.is_open()) {
-		for (const auto &f : result) {
-			out << f << std::endl;
-		}
-		out.close();
-	}
-    return 0;
-}
+/*
+ * Vulkan Compute Program
+ * 
+ * Created by Patrick Gantner
+ *
+ */
+
+#include "MultiDevice.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+	ComputeSettings settings;
+	uint64_t batches = 1;
+	uint32_t devices = 1;
+	std::string inputA;
+	std::string inputB;
+	std::string profilePath;
+	std::string outputPath = "result.txt";
+	ResultFormat outputFormat = ResultFormat::eText;
+	std::string tracePath;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "--memory") == 0) {
+			if (strcmp(argv[i + 1], "host") == 0) settings.memoryMode = MemoryMode::eHostVisible;
+			else if (strcmp(argv[i + 1], "device") == 0) settings.memoryMode = MemoryMode::eDeviceLocal;
+			else settings.memoryMode = MemoryMode::eAuto;
+		}
+		else if (strcmp(argv[i], "--backend") == 0) {
+			if (strcmp(argv[i + 1], "gpu") == 0) settings.backend = ComputeBackend::eGpu;
+			else if (strcmp(argv[i + 1], "cpu") == 0) settings.backend = ComputeBackend::eCpu;
+			else settings.backend = ComputeBackend::eAuto;
+		}
+		else if (strcmp(argv[i], "--workgroup") == 0) {
+			settings.workGroupSize = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--batches") == 0) {
+			batches = strtoull(argv[i + 1], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "--elements") == 0) {
+			settings.numElements = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--input-a") == 0) {
+			inputA = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--input-b") == 0) {
+			inputB = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--threads") == 0) {
+			settings.hostThreads = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--seed") == 0) {
+			settings.seed = strtoull(argv[i + 1], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "--devices") == 0) {
+			devices = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--frames") == 0) {
+			settings.framesInFlight = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--output") == 0) {
+			outputPath = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--format") == 0) {
+			if (strcmp(argv[i + 1], "binary") == 0) outputFormat = ResultFormat::eBinary;
+			else if (strcmp(argv[i + 1], "mmap") == 0) outputFormat = ResultFormat::eMapped;
+			else outputFormat = ResultFormat::eText;
+		}
+		else if (strcmp(argv[i], "--profile") == 0) {
+			profilePath = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--trace") == 0) {
+			tracePath = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--validate") == 0) {
+			// fraction of every batch checked against the host, 1 checks all of it
+			settings.validation.sampleRate = strtod(argv[i + 1], nullptr);
+		}
+	}
+
+	settings.profile = !profilePath.empty() || !tracePath.empty();
+
+	if (devices != 1 && (inputA.empty() || inputB.empty())) {
+		// the random batches of the plain application run on one device only
+		std::cerr << "--devices needs --input-a and --input-b" << std::endl;
+		return 1;
+	}
+	if (devices != 1) {
+		// out of core split over several devices, 0 uses all of them
+		MultiDeviceSettings multiSettings;
+		multiSettings.compute = settings;
+		multiSettings.deviceCount = devices;
+		MultiDeviceCompute multi(multiSettings);
+		if (multi.init() != vk::Result::eSuccess) return 1;
+		if (outputPath == "result.txt") outputPath = "result.bin";
+		vk::Result res = multi.streamFiles(inputA, inputB, outputPath);
+		for (uint32_t i = 0; i < multi.deviceCount(); i++) {
+			std::cout << "device " << i << " (" << multi.device(i).physicalDevice().getProperties().deviceName << "): "
+				<< multi.partition()[i] << " elements" << std::endl;
+		}
+		return res == vk::Result::eSuccess ? 0 : 1;
+	}
+
+	VulkanComputeApplication app(settings);
+	if (app.init() != vk::Result::eSuccess) return 1;
+	vk::Result res = vk::Result::eSuccess;
+	if (!inputA.empty() && !inputB.empty()) {
+		// out of core: a + b over both files, the output is always raw floats
+		if (outputPath == "result.txt") outputPath = "result.bin";
+		res = app.streamFiles(inputA, inputB, outputPath);
+	}
+	else if (batches > 1) {
+		// stream random batches, only the last one is written out
+		res = app.stream(batches, [&](uint64_t batch, float* a, float* b) {
+			app.fillRandom(batch, a, b);
+		}, nullptr);
+	}
+	else {
+		app.run();
+	}
+
+	bool succeeded = res == vk::Result::eSuccess;
+	if (succeeded && (inputA.empty() || inputB.empty())) {
+		// a failed run() leaves no result
+		ResultView result = app.resultView();
+		succeeded = !result.empty() && writeResult(outputPath, result, outputFormat);
+	}
+
+	if (!profilePath.empty()) app.profiler().writeJson(profilePath);
+	if (!tracePath.empty()) app.profiler().writeChromeTrace(tracePath);
+	if (app.validator().enabled()) {
+		std::cerr << app.validationReport().summary() << std::endl;
+		if (!app.validationReport().passed()) return 1;
+	}
+	return succeeded ? 0 : 1;
+}
@@ -0,0 +1,26 @@
+# Writes every SPIR-V file into a C++ source as a uint32_t array, see VulkanCompute/EmbeddedShaders.h
+# usage: cmake -DSPIRV_DIR=<dir> -DSPIRV_FILES=<a.spv,b.spv> -DOUTPUT=<file.cpp> -P EmbedSpirv.cmake
+
+string(REPLACE "," ";" files "${SPIRV_FILES}")
+set(arrays "")
+set(table "")
+set(index 0)
+foreach(file ${files})
+    file(READ ${SPIRV_DIR}/${file} hex HEX)
+    # SPIR-V is a stream of little endian words
+    string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1u," words "${hex}")
+    set(arrays "${arrays}\tconst uint32_t shader${index}[] = { ${words} };\n")
+    set(table "${table}\t{ \"shaders/${file}\", shader${index}, sizeof(shader${index}) / sizeof(uint32_t) },\n")
+    math(EXPR index "${index} + 1")
+endforeach()
+
+set(content "// generated by cmake/EmbedSpirv.cmake, do not edit\n#include \"EmbeddedShaders.h\"\n\nnamespace {\n${arrays}}\n\n")
+set(content "${content}extern const EmbeddedShader g_embeddedShaders[] = {\n${table}};\nextern const size_t g_embeddedShaderCount = ${index};\n")
+
+# only touch the output if it changed, so unchanged shaders don't trigger a rebuild
+if(EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} previous)
+endif()
+if(NOT "${previous}" STREQUAL "${content}")
+    file(WRITE ${OUTPUT} "${content}")
+endif()